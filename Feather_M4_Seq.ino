@@ -1,5 +1,5 @@
 /**
- * Feather M4 Seq -- An 8 track 32 step MIDI (& Analog) Gate (& CV) Sequencer for Feather M4 Express & Neotrellis 8x8, with probability, looping, swing, velocity, arpeggiator and mutes
+ * Feather M4 Seq -- An 8 track 32 step MIDI (& Analog) Gate (& CV) Sequencer for Feather M4 Express & Neotrellis 8x8, with probability, looping, grooves, velocity, arpeggiator and mutes
  * 04 Nov 2023 - @apatchworkboy / Marci
  * 28 Apr 2023 - original via @todbot / Tod Kurt https://github.com/todbot/picostepseq/
  *
@@ -9,7 +9,6 @@
  * - Adafruit Seesaw -- https://github.com/adafruit/Adafruit_Seesaw
  * - Adafruit Neopixel -- https://github.com/adafruit/Adafruit_Neopixel
  * - MIDI -- https://github.com/FortySevenEffects/arduino_midi_library
- * - ArduinoJson -- https://arduinojson.org/
  *
  * To upload:
  * - Use Arduino IDE 1.8.19+
@@ -25,9 +24,6 @@
 #include <Adafruit_NeoPixel.h>
 #include <Adafruit_NeoTrellis.h>
 #include <MIDI.h>
-#include <ArduinoJson.h>
-#include <algorithm>
-#include <vector>
 #include "wiring_digital.h"
 #include "flash_config.h"
 
@@ -53,7 +49,6 @@ Adafruit_NeoTrellis t_array[Y_DIM / 4][X_DIM / 4] = {
 Adafruit_MultiTrellis trellis((Adafruit_NeoTrellis*)t_array, Y_DIM / 4, X_DIM / 4);
 
 MIDI_CREATE_INSTANCE(Adafruit_USBD_MIDI, usb_midi, MIDIusb);  // USB MIDI
-MIDI_CREATE_INSTANCE(HardwareSerial, Serial1, serialmidi);  // Serial MIDI
 
 FatVolume fatfs;
 
@@ -79,12 +74,14 @@ uint8_t selstep;
 uint8_t shifted;  // (SHIFT)
 uint8_t transpose;
 bool hzv[2] = { 0, 0 };
+uint8_t midi_routes[16];  // MIDI in channel -> track 1 - 8, 0 = follow selected track
 bool chanedit;
 bool divedit;
 bool gateedit;
 bool lenedit;
 bool m4init;
 bool notesedit;
+bool nudgeedit;
 bool offedit;
 bool patedit;
 bool presetmode;
@@ -94,9 +91,14 @@ bool swingedit;
 bool veledit;
 bool write;
 bool resetflag;
+bool routeedit;
+bool scaleedit;
+bool songedit;
+uint32_t shown_swaps;
 
 #include "multisequencer.h"
 #include "save_locations.h"
+#include "gate_timer.h"
 
 typedef struct {
   int step_size;
@@ -113,10 +115,16 @@ Config cfg = {
 float tempo = 120;
 MultiStepSequencer<numtracks, numpresets, num_steps, numdacs, numarps> seqr;
 
+#include "clock_timer.h"
+MIDI_CREATE_INSTANCE(ClockSafeSerial, clock_safe_serial1, serialmidi);  // Serial MIDI
+
 // end hardware definitions
 uint8_t midiclk_cnt = 0;
 uint32_t midiclk_last_micros = 0;
 
+#include "clock_in.h"
+#include "song.h"
+
 //
 // -- MIDI sending & receiving functions
 //
@@ -129,15 +137,16 @@ void send_song_pos(int beat) {
 // callback used by Sequencer to trigger note on
 void send_note_on(uint8_t note, uint8_t vel, uint8_t gate, bool on, uint8_t chan) {
   if (on) {
+    active_notes.on(note, chan);
     MIDIusb.sendNoteOn(note, vel, chan);
     if (serial_midi) serialmidi.sendNoteOn(note, vel, chan);
   }
   if (midi_out_debug) { Serial.printf("noteOn:  %d %d %d %d\n", note, vel, gate, on); }
 }
 
-// callback used by Sequencer to trigger note off
+// callback used by Sequencer to trigger note off (only sent if that note is sounding)
 void send_note_off(uint8_t note, uint8_t vel, uint8_t gate, bool on, uint8_t chan) {
-  if (on) {
+  if (on && active_notes.off(note, chan)) {
     MIDIusb.sendNoteOff(note, vel, chan);
     if (serial_midi) serialmidi.sendNoteOff(note, vel, chan);
   }
@@ -163,13 +172,14 @@ void send_clock_start_stop(clock_type_t type) {
     if (serial_midi) serialmidi.sendStop();
   } else if (type == CLOCK) {
     MIDIusb.sendClock();
-    if (serial_midi) serialmidi.sendClock();
+    if (serial_midi && !clock_timer_serial) serialmidi.sendClock();  // else sent by clock timer interrupt
   }
   if (midi_out_debug) { Serial.printf("\tclk:%d\n", type); }
 }
 
 void handle_midi_in_start() {
   seqr.play();
+  clock_timer.ext_reset();
   midiclk_cnt = 0;
   if (midi_in_debug) { Serial.println("midi in start"); }
 }
@@ -179,48 +189,69 @@ void handle_midi_in_stop() {
   if (midi_in_debug) { Serial.println("midi in stop"); }
 }
 
-// FIXME: midi continue?
+// one external 24PPQN clock tick (MIDI clock, or analog clock in scaled up to 24PPQN),
+// the sequencer interpolates it up to its own ticks_per_quarternote
+void ext_clock_tick(uint32_t now_micros) {
+  clock_timer.ext_tick();
+  seqr.trigger_ext(now_micros);
+  midiclk_cnt = (midiclk_cnt + 1) % midi_ppqn;
+}
+
+// MIDI Continue: play on from the current (or last Song Position Pointer) position
+void handle_midi_in_continue() {
+  clock_timer.resuming = true;
+  seqr.resume();
+  if (midi_in_debug) { Serial.println("midi in continue"); }
+}
+
+// MIDI Song Position Pointer, in 16ths since the start
+void handle_midi_in_song_position(uint16_t beats) {
+  seqr.seek(beats);
+  clock_timer.seek((uint32_t)beats * SIXTEENTH_NOTE * ticks_per_clock);
+  midiclk_cnt = (uint32_t)beats * SIXTEENTH_NOTE % midi_ppqn;
+  if (midi_in_debug) { Serial.printf("midi in song position: %d\n", beats); }
+}
+
 void handle_midi_in_clock() {
   uint32_t now_micros = micros();
-  // once every ticks_per_step, play note (24 ticks per quarter note => 6 ticks per 16th note)
-  if (midiclk_cnt % seqr.ticks_per_step == 0) {  // ticks_per_step = 6 for 16th note
-    seqr.trigger_ext(now_micros);
-  }
-  midiclk_cnt++;
+  ext_clock_tick(now_micros);
   // once every quarter note, calculate new BPM, but be a little cautious about it
-  if (midiclk_cnt == ticks_per_quarternote) {
+  if (midiclk_cnt == 0) {
     uint32_t new_tick_micros = (now_micros - midiclk_last_micros) / ticks_per_quarternote;
     if (new_tick_micros > seqr.tick_micros / 2 && new_tick_micros < seqr.tick_micros * 2) {
       seqr.tick_micros = new_tick_micros;
     }
     midiclk_last_micros = now_micros;
-    midiclk_cnt = 0;
   }
 }
 
+// track a MIDI in channel plays / records into
+uint8_t midi_in_track(uint8_t channel) {
+  uint8_t t = channel > 0 && channel <= 16 ? midi_routes[channel - 1] : 0;
+  return t > 0 ? t - 1 : sel_track - 1;
+}
+
 void handle_midi_in_NoteOff(uint8_t channel, uint8_t note, uint8_t vel) {
-  uint8_t trk_arr = sel_track - 1;
+  uint8_t trk_arr = midi_in_track(channel);
   if (marci_debug) Serial.println("Note Stop");
   if (seqr.mutes[trk_arr] == 1) {
     if (seqr.modes[trk_arr] == TRIGATE) {
       note = seqr.track_notes[trk_arr];
     }
-    if (serial_midi) serialmidi.sendNoteOff(note, vel, seqr.track_chan[trk_arr]);
-    MIDIusb.sendNoteOff(note, vel, seqr.track_chan[trk_arr]);
+    send_note_off(note, vel, 0, true, seqr.track_chan[trk_arr]);
   } else {
     switch (seqr.modes[trk_arr]) {
       case TRIGATE:
-        MIDIusb.sendNoteOff(seqr.track_notes[trk_arr], vel, seqr.track_chan[trk_arr]);
-        if (serial_midi) serialmidi.sendNoteOff(seqr.track_notes[trk_arr], vel, seqr.track_chan[trk_arr]);
+        send_note_off(seqr.track_notes[trk_arr], vel, 0, true, seqr.track_chan[trk_arr]);
         break;
       case NOTE:
-        MIDIusb.sendNoteOff(note, vel, seqr.track_chan[trk_arr]);
-        if (serial_midi) serialmidi.sendNoteOff(note, vel, seqr.track_chan[trk_arr]);
+      case CHORD:
+        send_note_off(note, vel, 0, true, seqr.track_chan[trk_arr]);
         break;
       case ARP:
         if (marci_debug) Serial.println("Firing NoteOff to arp for");
         if (marci_debug) Serial.println(note);
-        arps[trk_arr - numarps].NoteOff(note);
+        arps[trk_arr].NoteOff(note);
         break;
       default: break;
     }
@@ -229,51 +260,55 @@ void handle_midi_in_NoteOff(uint8_t channel, uint8_t note, uint8_t vel) {
 
 void handle_midi_in_NoteOn(uint8_t channel, uint8_t note, uint8_t vel) {
   if (marci_debug) Serial.println("Note Start");
-  uint8_t trk_arr = sel_track - 1;
+  uint8_t trk_arr = midi_in_track(channel);
+  bool routed = trk_arr != sel_track - 1;
   if (seqr.mutes[trk_arr] == 1) {
     if (seqr.modes[trk_arr] == TRIGATE) {
       note = seqr.track_notes[trk_arr];
     }
-    if (serial_midi) serialmidi.sendNoteOn(note, vel, seqr.track_chan[trk_arr]);
-    MIDIusb.sendNoteOn(note, vel, seqr.track_chan[trk_arr]);
+    send_note_on(note, vel, 0, true, seqr.track_chan[trk_arr]);
   } else {
-    uint8_t _s = constrain(seqr.ticki > 3 ? seqr.multistepi[trk_arr] + 1 : seqr.multistepi[trk_arr], 0 , num_steps - 1);
+    uint8_t _s = seqr.live_step(trk_arr, true);
     switch (seqr.modes[trk_arr]) {
       case CC:
         if (marci_debug) Serial.println("CC");
         if (veledit == 1) {
           switch (shifted) {
             case 0:
-              seqr.vels[seqr.presets[trk_arr]][trk_arr][selstep] = note;
-              seqr.seqs[seqr.presets[trk_arr]][trk_arr][selstep] = 1;
+              seqr.vels[trk_arr][selstep] = note;
+              seqr.seqs[trk_arr][selstep] = 1;
+              seqr.touch_step(trk_arr, selstep);
               break;
             case 1:
               // LIVE ENTRY
-              seqr.vels[seqr.presets[trk_arr]][trk_arr][_s] = note;
-              seqr.seqs[seqr.presets[trk_arr]][trk_arr][_s] = 1;
+              seqr.vels[trk_arr][_s] = note;
+              seqr.seqs[trk_arr][_s] = 1;
+              seqr.touch_step(trk_arr, _s);
               break;
             default: break;
           }
         }
         break;
       case NOTE:
+      case CHORD:  // root, shape stays as set on the grid
         if (marci_debug) Serial.println("Note");
         if (veledit == 1 || patedit == 1) {
           switch (shifted) {
             case 0:
-              send_note_off(seqr.notes[seqr.presets[trk_arr]][trk_arr][selstep], 0, 0, 1, seqr.track_chan[trk_arr]);
-              seqr.notes[seqr.presets[trk_arr]][trk_arr][selstep] = note;
-              seqr.vels[seqr.presets[trk_arr]][trk_arr][selstep] = vel;
-              seqr.seqs[seqr.presets[trk_arr]][trk_arr][selstep] = 1;
+              send_note_off(seqr.notes[trk_arr][selstep], 0, 0, 1, seqr.track_chan[trk_arr]);
+              seqr.notes[trk_arr][selstep] = note;
+              seqr.vels[trk_arr][selstep] = vel;
+              seqr.seqs[trk_arr][selstep] = 1;
+              seqr.touch_step(trk_arr, selstep);
               break;
             case 1:
               // LIVE ENTRY
-              send_note_off(seqr.notes[seqr.presets[trk_arr]][trk_arr][_s], 0, 0, 1, seqr.track_chan[trk_arr]);
-              MIDIusb.sendNoteOn(note, vel, seqr.track_chan[trk_arr]);
-              if (serial_midi) serialmidi.sendNoteOn(note, vel, seqr.track_chan[trk_arr]);
-              seqr.notes[seqr.presets[trk_arr]][trk_arr][_s] = note;
-              seqr.vels[seqr.presets[trk_arr]][trk_arr][_s] = vel;
-              seqr.seqs[seqr.presets[trk_arr]][trk_arr][_s] = 1;
+              send_note_off(seqr.notes[trk_arr][_s], 0, 0, 1, seqr.track_chan[trk_arr]);
+              send_note_on(note, vel, 0, true, seqr.track_chan[trk_arr]);
+              seqr.notes[trk_arr][_s] = note;
+              seqr.vels[trk_arr][_s] = vel;
+              seqr.seqs[trk_arr][_s] = 1;
+              seqr.touch_step(trk_arr, _s);
               break;
             default: break;
           }
@@ -283,29 +318,30 @@ void handle_midi_in_NoteOn(uint8_t channel, uint8_t note, uint8_t vel) {
         if (marci_debug) Serial.println("Trigate");
         switch (shifted) {
           case 0:
-            seqr.vels[seqr.presets[trk_arr]][trk_arr][selstep] = note;
-            seqr.seqs[seqr.presets[trk_arr]][trk_arr][selstep] = 1;
+            seqr.vels[trk_arr][selstep] = note;
+            seqr.seqs[trk_arr][selstep] = 1;
+            seqr.touch_step(trk_arr, selstep);
             break;
           case 1:
             // LIVE ENTRY
-            MIDIusb.sendNoteOn(seqr.track_notes[trk_arr], vel, seqr.track_chan[trk_arr]);
-            if (serial_midi) serialmidi.sendNoteOn(seqr.track_notes[trk_arr], vel, seqr.track_chan[trk_arr]);
-            seqr.vels[seqr.presets[trk_arr]][trk_arr][_s] = note;
-            seqr.seqs[seqr.presets[trk_arr]][trk_arr][_s] = 1;
-            trellis.setPixelColor(_s, W100);
+            send_note_on(seqr.track_notes[trk_arr], vel, 0, true, seqr.track_chan[trk_arr]);
+            seqr.vels[trk_arr][_s] = note;
+            seqr.seqs[trk_arr][_s] = 1;
+            seqr.touch_step(trk_arr, _s);
+            if (!routed) trellis.setPixelColor(_s, W100);
             break;
           default: break;
         }
         break;
       case ARP: {
         if (marci_debug) Serial.println("Arp");
-        switch (shifted) {
+        switch (routed ? 1 : shifted) {  // a routed arp plays without SHIFT
           case 0:
             if (marci_debug) Serial.println("Unshifted - ignore");
             break;
           case 1:
             if (marci_debug) Serial.println("Sending to Arp");
-              arps[trk_arr - numarps].NoteOn(note);
+              arps[trk_arr].NoteOn(note);
             break;
           default: break;
         }
@@ -318,38 +354,12 @@ void handle_midi_in_NoteOn(uint8_t channel, uint8_t note, uint8_t vel) {
 
 void handle_midi_in_CC(uint8_t channel, uint8_t cc, uint8_t val) {
   Serial.println("CC Incoming");
-  uint8_t trk_arr = sel_track - 1;
+  uint8_t trk_arr = midi_in_track(channel);
   if (seqr.mutes[trk_arr] == 1) {
     if (serial_midi) serialmidi.sendControlChange(cc, val, seqr.track_chan[trk_arr]);
     MIDIusb.sendControlChange(cc, val, seqr.track_chan[trk_arr]);
   } else {
-    switch (seqr.modes[trk_arr]) {
-      case CC:
-        switch (shifted) {
-          case 0:
-            seqr.track_notes[trk_arr] = cc;
-            seqr.vels[seqr.presets[trk_arr]][trk_arr][selstep] = val;
-            break;
-          case 1:
-            seqr.track_notes[trk_arr] = cc;
-            seqr.vels[seqr.presets[trk_arr]][trk_arr][seqr.multistepi[trk_arr]] = val;
-            break;
-          default: break;
-        }
-        break;
-      case NOTE:
-        switch (shifted) {
-          case 0:
-            seqr.vels[seqr.presets[trk_arr]][trk_arr][selstep] = val;
-            break;
-          case 1:
-            seqr.vels[seqr.presets[trk_arr]][trk_arr][seqr.multistepi[trk_arr]] = val;
-            break;
-          default: break;
-        }
-        break;
-      default: break;
-    }
+    seqr.cc_edit(trk_arr, shifted == 1 ? seqr.live_step(trk_arr) : selstep, cc, val);
   }
 }
 
@@ -364,6 +374,12 @@ void midi_read_and_forward() {
       case midi::Stop:
         handle_midi_in_stop();
         break;
+      case midi::Continue:
+        handle_midi_in_continue();
+        break;
+      case midi::SongPosition:
+        handle_midi_in_song_position(MIDIusb.getData1() | (MIDIusb.getData2() << 7));
+        break;
       case midi::Clock:
         handle_midi_in_clock();
         break;
@@ -374,7 +390,25 @@ void midi_read_and_forward() {
 
 // Analog IO
 void analog_gate(uint8_t pin, uint8_t direction) {
-  if (analog_feats) digitalWrite(pin, direction == 1 ? HIGH : LOW);
+  if (analog_feats) {
+    if (direction == 1) {
+      digitalWrite(pin, HIGH);
+    } else {
+      gate_timer.release(pin);
+    }
+  }
+}
+
+// timed gate / trigger: rising edge now, falling edge scheduled on the gate timer
+void analog_pulse(uint8_t track, uint32_t len_micros) {
+  if (analog_feats) gate_timer.pulse(track, len_micros);
+}
+
+// callback used by Sequencer to poll software timers (no-op when hardware timed) & the analog clock input
+void hw_timers_poll(uint32_t now_micros) {
+  gate_timer_poll(now_micros);
+  clock_timer_poll(now_micros);
+  if (analog_feats) clock_in.poll(now_micros);
 }
 
 void analog_cv(uint8_t pin, uint16_t value) {
@@ -382,6 +416,10 @@ void analog_cv(uint8_t pin, uint16_t value) {
 }
 
 void update_display() {
+  if (presetmode == 1 && seqr.swaps != shown_swaps) {
+    shown_swaps = seqr.swaps;  // a queued preset / song entry went live
+    show_presets();
+  }
   if (presetmode == 1 || chanedit == 1 || sure == 1 || divedit == 1) {
     return;
   }
@@ -390,32 +428,35 @@ void update_display() {
   uint8_t trk_arr = sel_track - 1;
 
   //active step ticker
-  if (gateedit == 1) {
-    hit = seqr.gates[seqr.presets[trk_arr]][trk_arr][seqr.multistepi[trk_arr]] > 0 ? PURPLE : W100;
-    color = seqr.gates[seqr.presets[trk_arr]][trk_arr][seqr.laststeps[trk_arr]] < 15 ? Wheel(seqr.gates[seqr.presets[trk_arr]][trk_arr][seqr.laststeps[trk_arr]] * 5) : seq_col(sel_track);
+  if (nudgeedit == 1) {
+    hit = seqr.multistepi[trk_arr] != selstep ? seqr.seqs[trk_arr][seqr.multistepi[trk_arr]] > 0 ? PURPLE : W100 : W100;
+    color = seqr.laststeps[trk_arr] != selstep ? nudge_col(sel_track, seqr.nudges[trk_arr][seqr.laststeps[trk_arr]]) : W100;
+  } else if (gateedit == 1) {
+    hit = seqr.gates[trk_arr][seqr.multistepi[trk_arr]] > 0 ? PURPLE : W100;
+    color = seqr.gates[trk_arr][seqr.laststeps[trk_arr]] < 15 ? Wheel(seqr.gates[trk_arr][seqr.laststeps[trk_arr]] * 5) : seq_col(sel_track);
   } else if (probedit == 1) {
-    hit = seqr.seqs[seqr.presets[trk_arr]][trk_arr][seqr.multistepi[trk_arr]] > 0 ? PURPLE : W100;
-    color = seqr.probs[seqr.presets[trk_arr]][trk_arr][seqr.laststeps[trk_arr]] < 10 ? Wheel(seqr.probs[seqr.presets[trk_arr]][trk_arr][seqr.laststeps[trk_arr]] * 10) : seq_col(sel_track);
+    hit = seqr.seqs[trk_arr][seqr.multistepi[trk_arr]] > 0 ? PURPLE : W100;
+    color = seqr.probs[trk_arr][seqr.laststeps[trk_arr]] < 10 ? Wheel(seqr.probs[trk_arr][seqr.laststeps[trk_arr]] * 10) : seq_col(sel_track);
   } else if (veledit == 1) {
-    hit = seqr.multistepi[trk_arr] != selstep ? seqr.seqs[seqr.presets[trk_arr]][trk_arr][seqr.multistepi[trk_arr]] > 0 ? PURPLE : W100 : W100;
-    if (seqr.modes[trk_arr] == CC || seqr.modes[trk_arr] == NOTE) {
-      color = Wheel(seqr.vels[seqr.presets[trk_arr]][trk_arr][seqr.laststeps[trk_arr]]);
+    hit = seqr.multistepi[trk_arr] != selstep ? seqr.seqs[trk_arr][seqr.multistepi[trk_arr]] > 0 ? PURPLE : W100 : W100;
+    if (seqr.modes[trk_arr] == CC || seqr.modes[trk_arr] == NOTE || seqr.modes[trk_arr] == CHORD) {
+      color = Wheel(seqr.vels[trk_arr][seqr.laststeps[trk_arr]]);
     } else {
-      color = seq_dim(sel_track, seqr.vels[seqr.presets[trk_arr]][trk_arr][seqr.laststeps[trk_arr]]);
+      color = seq_dim(sel_track, seqr.vels[trk_arr][seqr.laststeps[trk_arr]]);
     }
   } else if (notesedit == 1) {
-    hit = seqr.multistepi[trk_arr] != selstep ? seqr.seqs[seqr.presets[trk_arr]][trk_arr][seqr.multistepi[trk_arr]] > 0 ? PURPLE : W100 : W100;
-    if (seqr.modes[trk_arr] == CC || seqr.modes[trk_arr] == NOTE) {
-      color = Wheel(seqr.notes[seqr.presets[trk_arr]][trk_arr][seqr.laststeps[trk_arr]]);
+    hit = seqr.multistepi[trk_arr] != selstep ? seqr.seqs[trk_arr][seqr.multistepi[trk_arr]] > 0 ? PURPLE : W100 : W100;
+    if (seqr.modes[trk_arr] == CC || seqr.modes[trk_arr] == NOTE || seqr.modes[trk_arr] == CHORD) {
+      color = Wheel(seqr.notes[trk_arr][seqr.laststeps[trk_arr]]);
     } else {
-      color = seq_dim(sel_track, seqr.notes[seqr.presets[trk_arr]][trk_arr][seqr.laststeps[trk_arr]]);
+      color = seq_dim(sel_track, seqr.notes[trk_arr][seqr.laststeps[trk_arr]]);
     }
   } else {
-    hit = seqr.seqs[seqr.presets[trk_arr]][trk_arr][seqr.multistepi[trk_arr]] > 0 ? PURPLE : W100;
-    color = seqr.seqs[seqr.presets[trk_arr]][trk_arr][seqr.laststeps[trk_arr]] > 0 ? seq_col(sel_track) : 0;
+    hit = seqr.seqs[trk_arr][seqr.multistepi[trk_arr]] > 0 ? PURPLE : W100;
+    color = seqr.seqs[trk_arr][seqr.laststeps[trk_arr]] > 0 ? seq_col(sel_track) : 0;
   }
   trellis.setPixelColor(seqr.multistepi[trk_arr], hit);
-  strip.setPixelColor(0, seqr.seqs[seqr.presets[trk_arr]][trk_arr][seqr.multistepi[trk_arr]] > 0 ? seq_col(sel_track) : (seqr.pulse == 1 ? W40 : 0));
+  strip.setPixelColor(0, seqr.seqs[trk_arr][seqr.multistepi[trk_arr]] > 0 ? seq_col(sel_track) : (seqr.pulse == 1 ? W40 : 0));
   if (seqr.modes[trk_arr] == CC && veledit == 1) {
     trellis.setPixelColor(seqr.laststeps[trk_arr], seqr.laststeps[trk_arr] != selstep ? color : W100);
   } else {
@@ -425,7 +466,9 @@ void update_display() {
   if (seqr.lengths[trk_arr] < num_steps) trellis.setPixelColor(seqr.lengths[trk_arr] - 1, trk_arr != 4 ? C127 : G127);
 
   if (seqr.resetflag == 1) {
-    if (gateedit == 1) {
+    if (nudgeedit == 1) {
+      show_nudges(sel_track);
+    } else if (gateedit == 1) {
       show_gates(sel_track);
     } else if (veledit == 1) {
       show_accents(sel_track);
@@ -445,13 +488,13 @@ void reset_display() {
   uint32_t hit = 0;
   uint8_t trk_arr = sel_track - 1;
   if (patedit == 1) {
-    hit = seqr.seqs[seqr.presets[trk_arr]][trk_arr][seqr.multistepi[trk_arr]] > 0 ? seq_col(sel_track) : W10;
+    hit = seqr.seqs[trk_arr][seqr.multistepi[trk_arr]] > 0 ? seq_col(sel_track) : W10;
   } else if (gateedit == 1) {
-    hit = seqr.gates[seqr.presets[trk_arr]][trk_arr][seqr.multistepi[trk_arr]] > 0 ? seq_col(sel_track) : W10;
+    hit = seqr.gates[trk_arr][seqr.multistepi[trk_arr]] > 0 ? seq_col(sel_track) : W10;
   } else if (veledit == 1) {
-    hit = seqr.vels[seqr.presets[trk_arr]][trk_arr][seqr.multistepi[trk_arr]] > 0 ? seq_col(sel_track) : W10;
+    hit = seqr.vels[trk_arr][seqr.multistepi[trk_arr]] > 0 ? seq_col(sel_track) : W10;
   } else if (probedit == 1) {
-    hit = seqr.probs[seqr.presets[trk_arr]][trk_arr][seqr.multistepi[trk_arr]] > 0 ? seq_col(sel_track) : W10;
+    hit = seqr.probs[trk_arr][seqr.multistepi[trk_arr]] > 0 ? seq_col(sel_track) : W10;
   } else {
     hit = W10;
   }
@@ -472,13 +515,13 @@ void toggle_selected(uint8_t keyId) {
 void show_sequence(uint8_t& seq) {
   patedit = 1;
   for (uint8_t i = 0; i < num_steps; ++i) {
-    trellis.setPixelColor(i, seqr.seqs[seqr.presets[seq - 1]][seq - 1][i] > 0 ? seq_col(sel_track) : 0);
+    trellis.setPixelColor(i, seqr.seqs[seq - 1][i] > 0 ? seq_col(sel_track) : 0);
   }
   if (!seqr.playing) { trellis.show(); }
 }
 
 void set_gate(uint8_t gid, uint8_t stp, int c) {
-  uint32_t col = seqr.gates[seqr.presets[gid]][gid][stp] >= 15 ? c : Wheel(seqr.gates[seqr.presets[gid]][gid][stp] * 5);
+  uint32_t col = seqr.gates[gid][stp] >= 15 ? c : Wheel(seqr.gates[gid][stp] * 5);
   trellis.setPixelColor(stp, col);
   if (!seqr.playing) { trellis.show(); }
 }
@@ -493,11 +536,25 @@ void show_gates(uint8_t& seq) {
   if (!seqr.playing) { trellis.show(); }
 }
 
+// microtiming: on-grid steps in track colour, early steps toward blue, late steps toward red
+uint32_t nudge_col(uint8_t seq, int8_t nudge) {
+  return nudge == 0 ? seq_dim(seq, 40) : Wheel(nudge < 0 ? 170 - constrain(-nudge * 5, 0, 80) : 255 - constrain(nudge * 5, 0, 80));
+}
+
+void show_nudges(uint8_t& seq) {
+  uint8_t trk_arr = seq - 1;
+  nudgeedit = 1;
+  for (uint8_t i = 0; i < num_steps; ++i) {
+    trellis.setPixelColor(i, i == selstep ? W100 : nudge_col(seq, seqr.nudges[trk_arr][i]));
+  }
+  if (!seqr.playing) { trellis.show(); }
+}
+
 void show_probabilities(uint8_t& seq) {
   probedit = 1;
   uint32_t col = 0;
   for (uint8_t i = 0; i < num_steps; ++i) {
-    col = seqr.probs[seqr.presets[seq - 1]][seq - 1][i] == 10 ? seq_col(seq) : Wheel(seqr.probs[seqr.presets[seq - 1]][seq - 1][i] * 10);
+    col = seqr.probs[seq - 1][i] == 10 ? seq_col(seq) : Wheel(seqr.probs[seq - 1][i] * 10);
     trellis.setPixelColor(i, col);
   }
   if (!seqr.playing) { trellis.show(); }
@@ -509,11 +566,11 @@ void show_accents(uint8_t& seq) { // velocities
   uint32_t col = 0;
   if (seqr.modes[seq - 1] == CC) {
     for (uint8_t i = 0; i < num_steps; ++i) {
-      trellis.setPixelColor(i, Wheel(seqr.vels[seqr.presets[trk_arr]][seq - 1][i]));
+      trellis.setPixelColor(i, Wheel(seqr.vels[seq - 1][i]));
     }
   } else {
     for (uint8_t i = 0; i < num_steps; ++i) {
-      trellis.setPixelColor(i, seq_dim(seq, seqr.vels[seqr.presets[trk_arr]][seq - 1][i]));
+      trellis.setPixelColor(i, seq_dim(seq, seqr.vels[seq - 1][i]));
     }
   }
   if (!seqr.playing) { trellis.show(); }
@@ -523,13 +580,13 @@ void show_notes(uint8_t& seq) {
   uint8_t trk_arr = sel_track - 1;
   notesedit = 1;
   uint32_t col = 0;
-  if (seqr.modes[seq - 1] == NOTE) {
+  if (seqr.modes[seq - 1] == NOTE || seqr.modes[seq - 1] == CHORD) {
     for (uint8_t i = 0; i < num_steps; ++i) {
-      trellis.setPixelColor(i, Wheel(seqr.notes[seqr.presets[trk_arr]][seq - 1][i]));
+      trellis.setPixelColor(i, Wheel(seqr.notes[seq - 1][i]));
     }
   } else {
     for (uint8_t i = 0; i < num_steps; ++i) {
-      trellis.setPixelColor(i, seq_dim(seq, seqr.notes[seqr.presets[trk_arr]][seq - 1][i]));
+      trellis.setPixelColor(i, seq_dim(seq, seqr.notes[seq - 1][i]));
     }
   }
   if (!seqr.playing) { trellis.show(); }
@@ -537,24 +594,78 @@ void show_notes(uint8_t& seq) {
 
 void show_presets() {
   uint8_t trk_arr = sel_track - 1;
+  if (songedit == 1) {
+    show_song();
+    return;
+  }
   for (uint8_t i = 0; i < num_steps; ++i) {
     trellis.setPixelColor(i, i < (num_steps / 2) ? 0 : W10);
   }
+  if (seqr.queued[trk_arr] >= 0) trellis.setPixelColor(seqr.queued[trk_arr], W40);  // swaps in at loop start
   trellis.setPixelColor(seqr.presets[trk_arr], W100);
+  song_keys();
+  trellis.show();
+}
+
+// running: queued, swaps in at the track's next loop start; stopped: straight away
+void change_preset(uint8_t trk, uint8_t p) {
+  if (seqr.playing) {
+    seqr.queue_preset(trk, p, seqr.loops);
+  } else {
+    seqr.set_preset(trk, p);
+  }
+}
+
+// song pane: row 1 & 2 entries (playing = white, selected = track colour, first empty slot = add),
+// row 3 & 4 repeats of the selected entry
+void show_song() {
+  for (uint8_t i = 0; i < song_max; ++i) {
+    uint32_t col = i < song_len ? seq_dim(sel_track, 20 + song[i].repeats * 5) : 0;
+    if (i == song_sel && i < song_len) col = seq_col(sel_track);
+    if (song_on && i == song_pos) col = W100;
+    if (i == song_len) col = G40;
+    trellis.setPixelColor(i, col);
+  }
+  for (uint8_t i = 0; i < song_max_repeats; ++i) {
+    trellis.setPixelColor(song_max + i, song_sel < song_len && i < song[song_sel].repeats ? Y80 : 0);
+  }
+  song_keys();
   trellis.show();
 }
 
+void song_keys() {
+  trellis.setPixelColor(48, songedit == 1 ? W100 : W10);
+  trellis.setPixelColor(49, song_on ? G127 : G40);
+  trellis.setPixelColor(50, songedit == 1 ? R40 : 0);
+}
+
+// track rate = x(mute row key) / (step key)
 void show_divisions() {
   uint8_t trk_arr = sel_track - 1;
   for (uint8_t i = 0; i < num_steps; ++i) {
     trellis.setPixelColor(i, 0);
   }
   trellis.setPixelColor(seqr.divs[trk_arr], seq_col(sel_track));
+  for (uint8_t i = 0; i < X_DIM; ++i) {
+    trellis.setPixelColor(40 + i, i == seqr.muls[trk_arr] ? seq_col(sel_track) : W10);
+  }
   trellis.setPixelColor(53, O80);
   trellis.setPixelColor(52, W100);
   trellis.show();
 }
 
+// Groove key shows the selected track's groove template (red = straight)
+void groove_led() {
+  uint8_t trk_arr = sel_track - 1;
+  trellis.setPixelColor(55, seqr.grooves[trk_arr] == 0 ? R127 : Wheel(seqr.grooves[trk_arr] * (255 / grooves_cnt)));
+}
+
+void mute_leds() {
+  for (uint8_t i = 0; i < numtracks; ++i) {
+    trellis.setPixelColor(40 + i, seqr.mutes[i] == 1 ? R80 : G40);
+  }
+}
+
 // Update Transpose Key
 void transpose_led() {
   switch (transpose) {
@@ -573,6 +684,31 @@ void transpose_led() {
   if (!seqr.playing) { trellis.show(); }
 }
 
+// Update Channel Config analog clock out (24 / 4 / 1) & clock in (1 / 2 / 4 / 24) PPQN buttons
+void clk_leds() {
+  for (uint8_t i = 0; i < clk_out_ppqns_cnt; ++i) {
+    trellis.setPixelColor(16 + i, clock_timer.out_ppqn == clk_out_ppqns[i] ? W100 : W10);
+  }
+  for (uint8_t i = 0; i < clk_in_ppqns_cnt; ++i) {
+    trellis.setPixelColor(20 + i, clock_in.ppqn == clk_in_ppqns[i] ? C127 : C40);
+  }
+}
+
+// Update Channel Config GATE/TRIGGER button (gate = dim, 1ms trig = mid, 5ms trig = bright)
+void trig_led(uint8_t& track) {
+  switch (seqr.trig_lens[track - 1]) {
+    case 1:
+      trellis.setPixelColor(29, O80);
+      break;
+    case 5:
+      trellis.setPixelColor(29, O127);
+      break;
+    default:
+      trellis.setPixelColor(29, O40);
+      break;
+  }
+}
+
 // Update Channel Config MODE buttons
 void mode_leds(uint8_t& track) {
   for (uint8_t i = X_DIM * 3; i < num_steps; ++i) {
@@ -603,22 +739,40 @@ void mode_leds(uint8_t& track) {
       }
       break;
     case ARP:
-      if (track - 1 >= 4) trellis.setPixelColor(27, W100);
+      trellis.setPixelColor(27, W100);
       break;
     case CHORD:
       trellis.setPixelColor(28, W100);
       break;
     default: break;
   }
+  trig_led(track);
   trellis.show();
 }
 
 // Initialise Channel Config display...
+// rows 1 & 2: selected track's output channel, or (key 30) the MIDI in channels routed to it,
+// dimmed in their own colour when routed to another track
+void chan_leds(uint8_t& track) {
+  for (uint8_t i = 0; i < 16; ++i) {
+    if (routeedit == 1) {
+      trellis.setPixelColor(i, midi_routes[i] == track ? seq_col(track) : (midi_routes[i] > 0 ? seq_dim(midi_routes[i], 20) : 0));
+    } else if (scaleedit == 1) {
+      trellis.setPixelColor(i, i == seqr.scales[track - 1] ? seq_col(track) : W10);
+    } else {
+      trellis.setPixelColor(i, i == seqr.track_chan[track - 1] - 1 ? seq_col(track) : 0);
+    }
+  }
+  trellis.setPixelColor(19, scaleedit == 1 ? W100 : W10);
+  trellis.setPixelColor(30, routeedit == 1 ? W100 : W10);
+}
+
 void init_chan_conf(uint8_t& track) {
   for (uint8_t i = 0; i < num_steps; ++i) {
     trellis.setPixelColor(i, 0);
   }
-  trellis.setPixelColor(seqr.track_chan[track - 1] - 1, seq_col(track));
+  chan_leds(track);
+  clk_leds();
   switch (seqr.modes[track - 1]) {
     case TRIGATE:
       trellis.setPixelColor(24, W100);
@@ -644,16 +798,35 @@ void init_chan_conf(uint8_t& track) {
       }
       break;
     case ARP:
-      if (track - 1 >= 4) trellis.setPixelColor(27, W100);
+      trellis.setPixelColor(27, W100);
       break;
     case CHORD:
-      if (track - 1 >= 4) trellis.setPixelColor(28, W100);
+      trellis.setPixelColor(28, W100);
       break;
     default: break;
   }
+  trig_led(track);
   trellis.show();
 }
 
+// redraw the steps of whichever edit pane is up (after undo / redo)
+void show_pane() {
+  if (presetmode == 1 || chanedit == 1 || sure == 1 || divedit == 1) return;
+  if (nudgeedit == 1) {
+    show_nudges(sel_track);
+  } else if (gateedit == 1) {
+    show_gates(sel_track);
+  } else if (probedit == 1) {
+    show_probabilities(sel_track);
+  } else if (veledit == 1) {
+    show_accents(sel_track);
+  } else if (notesedit == 1) {
+    show_notes(sel_track);
+  } else {
+    show_sequence(sel_track);
+  }
+}
+
 // Show "Are you sure, Y/N" display...
 void sure_pane() {
   for (uint8_t i = 0; i < t_size; ++i) {
@@ -685,6 +858,14 @@ void set_brightness() {
 }
 
 // Initialise Neotrellis interactions and static control rows...
+// edit pane buttons
+void pane_leds() {
+  trellis.setPixelColor(48, patedit == 1 ? R127 : R40);
+  trellis.setPixelColor(49, veledit == 1 ? Y127 : Y40);
+  trellis.setPixelColor(50, probedit == 1 ? P127 : P40);
+  trellis.setPixelColor(51, nudgeedit == 1 ? C127 : (gateedit == 1 ? B127 : B40));
+}
+
 void init_interface() {
   if (m4init == 0) {
     for (int y = 0; y < Y_DIM; y++) {
@@ -708,19 +889,8 @@ void init_interface() {
   trellis.setPixelColor(38, sel_track == 7 ? seq_col(sel_track) : seq_dim(7, 40));
   trellis.setPixelColor(39, sel_track == 8 ? seq_col(sel_track) : seq_dim(8, 40));
   //seqr.mutes
-  trellis.setPixelColor(40, seqr.mutes[0] == 1 ? R80 : G40);
-  trellis.setPixelColor(41, seqr.mutes[1] == 1 ? R80 : G40);
-  trellis.setPixelColor(42, seqr.mutes[2] == 1 ? R80 : G40);
-  trellis.setPixelColor(43, seqr.mutes[3] == 1 ? R80 : G40);
-  trellis.setPixelColor(44, seqr.mutes[4] == 1 ? R80 : G40);
-  trellis.setPixelColor(45, seqr.mutes[5] == 1 ? R80 : G40);
-  trellis.setPixelColor(46, seqr.mutes[6] == 1 ? R80 : G40);
-  trellis.setPixelColor(47, seqr.mutes[7] == 1 ? R80 : G40);
-  //Panes
-  trellis.setPixelColor(48, patedit == 1 ? R127 : R40);
-  trellis.setPixelColor(49, veledit == 1 ? Y127 : Y40);
-  trellis.setPixelColor(50, probedit == 1 ? P127 : P40);
-  trellis.setPixelColor(51, gateedit == 1 ? B127 : B40);
+  mute_leds();
+  pane_leds();
   //Globals
   trellis.setPixelColor(52, shifted == 1 ? W100 : PK40);
   if (chanedit == 0) {
@@ -768,7 +938,13 @@ void init_interface() {
   trellis.show();
 }
 
+#include "json_stream.h"
+#include "journal.h"
 #include "saveload.h"  /// FIXME:
+#include "undo.h"
+#include "sysex.h"
+#include "editor.h"
+#include "memory_map.h"
 
 // in vast need of improvements for efficiency:
 TrellisCallback onKey(keyEvent evt) {
@@ -796,17 +972,22 @@ TrellisCallback onKey(keyEvent evt) {
       } else if (divedit == 1) { // TRACK CLOCK DIVIDER STEP EDIT
         if (keyId < (num_steps)) {
           seqr.divs[trk_arr] = keyId;
-          seqr.divcounts[trk_arr] = -1;
+          seqr.touch(trk_arr);
+          show_divisions();
+        } else if (keyId > 39 && keyId < 48) { // TRACK CLOCK MULTIPLIER
+          seqr.set_mul(trk_arr, keyId - 40);
           show_divisions();
         } else if (keyId == 52) {
           divedit = 0;
           shifted = 0;
           trellis.setPixelColor(52, PK40);
           trellis.setPixelColor(53, B40);
+          mute_leds();
           show_sequence(sel_track);
         } else if (keyId == 53) {
           divedit = 0;
           trellis.setPixelColor(53, B40);
+          mute_leds();
           show_sequence(sel_track);
         } else if (keyId == 58) {
           seqr.reset();
@@ -817,21 +998,43 @@ TrellisCallback onKey(keyEvent evt) {
           toggle_selected(keyId);
           show_divisions();
         } 
+      } else if (presetmode == 1 && songedit == 1 && (keyId < num_steps || keyId > 47 && keyId < 51)) { // SONG EDIT
+        if (keyId < song_max) {
+          if (keyId < song_len) {
+            song_sel = keyId;
+          } else {
+            song_add();  // first empty slot: append current presets
+          }
+        } else if (keyId < song_max + song_max_repeats) {
+          if (song_sel < song_len) song[song_sel].repeats = keyId - song_max + 1;
+        } else if (keyId == 48) {
+          songedit = 0;
+        } else if (keyId == 49) {
+          song_on = !song_on && song_len > 0;
+          if (song_on) song_start();
+        } else if (keyId == 50) {
+          song_remove(song_sel);
+        }
+        show_presets();
       } else if (presetmode == 1 && (keyId < num_steps || keyId > 39 && keyId < 56)) { // PRESET STEP EDIT
-        if (keyId < (numpresets)) {
+        if (keyId == 48) {
+          songedit = 1;
+        } else if (keyId == 49) {
+          song_on = !song_on && song_len > 0;
+          if (song_on) song_start();
+        } else if (keyId < (numpresets)) {
           for (uint8_t i = 0; i < numpresets; ++i) {
             trellis.setPixelColor(i, 0);
           }
           trellis.setPixelColor(seqr.presets[trk_arr], 0);
           trellis.setPixelColor(keyId, W100);
-          seqr.presets[trk_arr] = keyId;
+          change_preset(trk_arr, keyId);
           // seqr.reset();
         } else if (keyId > ((numpresets - 1)) && keyId < (numpresets * 2)) {
           trellis.setPixelColor(seqr.presets[trk_arr], 0);
           trellis.setPixelColor(keyId - (X_DIM * 2), W100);
-          for (uint8_t i = 0; i < numpresets; ++i) {
-            seqr.presets[i] = (keyId - (X_DIM * 2));
-            // seqr.reset();
+          for (uint8_t i = 0; i < numtracks; ++i) {
+            change_preset(i, keyId - (X_DIM * 2));
           }
         } else if (keyId > 39 && keyId < 48) {
           if (seqr.mutes[keyId - 40] == 0) {
@@ -845,34 +1048,76 @@ TrellisCallback onKey(keyEvent evt) {
         show_presets();
       } else if (chanedit == 1 && keyId < num_steps) { // CHANNEL STEP EDIT
         if (keyId < 16) {
-          uint8_t chan = keyId + 1;
-          seqr.track_chan[trk_arr] = chan;
-          for (uint8_t i = 0; i < 16; ++i) {
-            trellis.setPixelColor(i, 0);
+          if (routeedit == 1) {
+            // route MIDI in on this channel to the selected track, again to unroute
+            midi_routes[keyId] = midi_routes[keyId] == sel_track ? 0 : sel_track;
+          } else if (scaleedit == 1) {
+            seqr.scales[trk_arr] = keyId;
+            seqr.set_scale(trk_arr);
+            if (marci_debug) Serial.println(scale_defs[keyId].name);
+          } else {
+            uint8_t chan = keyId + 1;
+            seqr.track_chan[trk_arr] = chan;
           }
-          trellis.setPixelColor(keyId, seq_col(sel_track));
+          chan_leds(sel_track);
         } else {
           switch (keyId) {
             case 24:
               seqr.modes[trk_arr] = TRIGATE;
+              seqr.touch(trk_arr);
               break;
             case 25:
               seqr.modes[trk_arr] = CC;
+              seqr.touch(trk_arr);
               break;
             case 26:
               seqr.modes[trk_arr] = NOTE;
+              seqr.touch(trk_arr);
               break;
             case 27:
-              if (trk_arr >= 4) {
-                seqr.modes[sel_track-1] = ARP;
-              }
+              seqr.modes[trk_arr] = ARP;
+              seqr.touch(trk_arr);
               break;
             case 28:
-              //seqr.modes[sel_track-1] = CHORD;
+              seqr.modes[trk_arr] = CHORD;
+              seqr.touch(trk_arr);
+              break;
+            case 16:
+            case 17:
+            case 18:
+              clock_timer.out_ppqn = clk_out_ppqns[keyId - 16];
+              clk_leds();
+              break;
+            case 20:
+            case 21:
+            case 22:
+            case 23:
+              clock_in.ppqn = clk_in_ppqns[keyId - 20];
+              clk_leds();
+              break;
+            case 29: {
+              // cycle analog output: gate -> 1ms trigger -> 5ms trigger
+              uint8_t w = 0;
+              for (uint8_t i = 0; i < trig_widths_cnt; ++i) {
+                if (trig_widths[i] == seqr.trig_lens[trk_arr]) w = (i + 1) % trig_widths_cnt;
+              }
+              seqr.trig_lens[trk_arr] = trig_widths[w];
+              break;
+            }
+            case 19:
+              scaleedit = scaleedit == 0 ? 1 : 0;
+              routeedit = 0;
+              chan_leds(sel_track);
+              break;
+            case 30:
+              routeedit = routeedit == 0 ? 1 : 0;
+              scaleedit = 0;
+              chan_leds(sel_track);
               break;
             case 31:
-              if ((seqr.modes[trk_arr] == CC || seqr.modes[trk_arr] == NOTE) && (trk_arr > 5)) {
+              if ((seqr.modes[trk_arr] == CC || seqr.modes[trk_arr] == NOTE || seqr.modes[trk_arr] == CHORD) && (trk_arr > 5)) {
                 hzv[(trk_arr) - 6] = hzv[(trk_arr) - 6] == 0 ? 1 : 0;
+                seqr.touch(trk_arr);
               }
               break;
             default: break;
@@ -899,177 +1144,184 @@ TrellisCallback onKey(keyEvent evt) {
           trellis.setPixelColor(54, B40);
           configure_sequencer();
         }
+      } else if (nudgeedit == 1 && keyId < num_steps) { // MICROTIMING STEP SELECT
+        uint8_t prev_selstep = selstep;
+        selstep = keyId;
+        trellis.setPixelColor(prev_selstep, nudge_col(sel_track, seqr.nudges[trk_arr][prev_selstep]));
+        trellis.setPixelColor(selstep, W100);
       } else if (gateedit == 1 && keyId < num_steps) { // GATE STEP EDIT
         uint8_t gateId = trk_arr;
-        if (seqr.gates[seqr.presets[trk_arr]][gateId][keyId] >= 15) {
-          seqr.gates[seqr.presets[trk_arr]][gateId][keyId] = 0;
+        if (seqr.gates[gateId][keyId] >= 15) {
+          seqr.gates[gateId][keyId] = 0;
         }
-        seqr.gates[seqr.presets[trk_arr]][gateId][keyId] += 3;
+        seqr.gates[gateId][keyId] += 3;
+        seqr.touch_step(gateId, keyId);
         set_gate(gateId, keyId, seq_col(sel_track));
       } else if (probedit == 1 && keyId < num_steps) { // PROBABILITY STEP EDIT
-        if (seqr.probs[seqr.presets[trk_arr]][trk_arr][keyId] == 10) {
-          seqr.probs[seqr.presets[trk_arr]][trk_arr][keyId] = 0;
+        if (seqr.probs[trk_arr][keyId] == 10) {
+          seqr.probs[trk_arr][keyId] = 0;
         }
-        seqr.probs[seqr.presets[trk_arr]][trk_arr][keyId] += 1;
-        col = seqr.probs[seqr.presets[trk_arr]][trk_arr][keyId] == 10 ? seq_col(sel_track) : Wheel(seqr.probs[seqr.presets[trk_arr]][trk_arr][keyId] * 10);
+        seqr.probs[trk_arr][keyId] += 1;
+        seqr.touch_step(trk_arr, keyId);
+        col = seqr.probs[trk_arr][keyId] == 10 ? seq_col(sel_track) : Wheel(seqr.probs[trk_arr][keyId] * 10);
         trellis.setPixelColor(keyId, col);
         if (!seqr.playing) { trellis.show(); }
       } else if (notesedit == 1 & keyId < num_steps) { // NOTES STEP EDIT
-        if (seqr.modes[trk_arr] == CC || seqr.modes[trk_arr] == NOTE) {
+        if (seqr.modes[trk_arr] == CC || seqr.modes[trk_arr] == NOTE || seqr.modes[trk_arr] == CHORD) {
           uint8_t prev_selstep = selstep;
           selstep = keyId;
-          trellis.setPixelColor(prev_selstep, Wheel(seqr.notes[seqr.presets[trk_arr]][trk_arr][prev_selstep]));
+          trellis.setPixelColor(prev_selstep, Wheel(seqr.notes[trk_arr][prev_selstep]));
           trellis.setPixelColor(selstep, W100);
         }
       } else if (veledit == 1 & keyId < num_steps) { // VELOCITY STEP EDIT
-        if (seqr.modes[trk_arr] == CC || seqr.modes[trk_arr] == NOTE) {
+        if (seqr.modes[trk_arr] == CC || seqr.modes[trk_arr] == NOTE || seqr.modes[trk_arr] == CHORD) {
           uint8_t prev_selstep = selstep;
           selstep = keyId;
-          trellis.setPixelColor(prev_selstep, Wheel(seqr.vels[seqr.presets[trk_arr]][trk_arr][prev_selstep]));
+          trellis.setPixelColor(prev_selstep, Wheel(seqr.vels[trk_arr][prev_selstep]));
           trellis.setPixelColor(selstep, W100);
         } else {
           switch (sel_track) {
             case 0:
               break;
             case 1:
-              switch (seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId]) {
+              switch (seqr.vels[trk_arr][keyId]) {
                 case 127:
                   trellis.setPixelColor(keyId, R40);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 40;
+                  seqr.vels[trk_arr][keyId] = 40;
                   break;
                 case 80:
                   trellis.setPixelColor(keyId, R127);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 127;
+                  seqr.vels[trk_arr][keyId] = 127;
                   break;
                 case 40:
                   trellis.setPixelColor(keyId, R80);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 80;
+                  seqr.vels[trk_arr][keyId] = 80;
                   break;
                 default:
                   break;
               }
               break;
             case 2:
-              switch (seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId]) {
+              switch (seqr.vels[trk_arr][keyId]) {
                 case 127:
                   trellis.setPixelColor(keyId, O40);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 40;
+                  seqr.vels[trk_arr][keyId] = 40;
                   break;
                 case 80:
                   trellis.setPixelColor(keyId, O127);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 127;
+                  seqr.vels[trk_arr][keyId] = 127;
                   break;
                 case 40:
                   trellis.setPixelColor(keyId, O80);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 80;
+                  seqr.vels[trk_arr][keyId] = 80;
                   break;
                 default:
                   break;
               }
               break;
             case 3:
-              switch (seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId]) {
+              switch (seqr.vels[trk_arr][keyId]) {
                 case 127:
                   trellis.setPixelColor(keyId, Y40);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 40;
+                  seqr.vels[trk_arr][keyId] = 40;
                   break;
                 case 80:
                   trellis.setPixelColor(keyId, Y127);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 127;
+                  seqr.vels[trk_arr][keyId] = 127;
                   break;
                 case 40:
                   trellis.setPixelColor(keyId, Y80);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 80;
+                  seqr.vels[trk_arr][keyId] = 80;
                   break;
                 default:
                   break;
               }
               break;
             case 4:
-              switch (seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId]) {
+              switch (seqr.vels[trk_arr][keyId]) {
                 case 127:
                   trellis.setPixelColor(keyId, G40);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 40;
+                  seqr.vels[trk_arr][keyId] = 40;
                   break;
                 case 80:
                   trellis.setPixelColor(keyId, G127);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 127;
+                  seqr.vels[trk_arr][keyId] = 127;
                   break;
                 case 40:
                   trellis.setPixelColor(keyId, G80);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 80;
+                  seqr.vels[trk_arr][keyId] = 80;
                   break;
                 default:
                   break;
               }
               break;
             case 5:
-              switch (seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId]) {
+              switch (seqr.vels[trk_arr][keyId]) {
                 case 127:
                   trellis.setPixelColor(keyId, C40);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 40;
+                  seqr.vels[trk_arr][keyId] = 40;
                   break;
                 case 80:
                   trellis.setPixelColor(keyId, C127);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 127;
+                  seqr.vels[trk_arr][keyId] = 127;
                   break;
                 case 40:
                   trellis.setPixelColor(keyId, C80);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 80;
+                  seqr.vels[trk_arr][keyId] = 80;
                   break;
                 default:
                   break;
               }
               break;
             case 6:
-              switch (seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId]) {
+              switch (seqr.vels[trk_arr][keyId]) {
                 case 127:
                   trellis.setPixelColor(keyId, B40);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 40;
+                  seqr.vels[trk_arr][keyId] = 40;
                   break;
                 case 80:
                   trellis.setPixelColor(keyId, B127);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 127;
+                  seqr.vels[trk_arr][keyId] = 127;
                   break;
                 case 40:
                   trellis.setPixelColor(keyId, B80);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 80;
+                  seqr.vels[trk_arr][keyId] = 80;
                   break;
                 default:
                   break;
               }
               break;
             case 7:
-              switch (seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId]) {
+              switch (seqr.vels[trk_arr][keyId]) {
                 case 127:
                   trellis.setPixelColor(keyId, P40);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 40;
+                  seqr.vels[trk_arr][keyId] = 40;
                   break;
                 case 80:
                   trellis.setPixelColor(keyId, P127);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 127;
+                  seqr.vels[trk_arr][keyId] = 127;
                   break;
                 case 40:
                   trellis.setPixelColor(keyId, P80);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 80;
+                  seqr.vels[trk_arr][keyId] = 80;
                   break;
                 default:
                   break;
               }
               break;
             case 8:
-              switch (seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId]) {
+              switch (seqr.vels[trk_arr][keyId]) {
                 case 127:
                   trellis.setPixelColor(keyId, PK40);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 40;
+                  seqr.vels[trk_arr][keyId] = 40;
                   break;
                 case 80:
                   trellis.setPixelColor(keyId, PK127);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 127;
+                  seqr.vels[trk_arr][keyId] = 127;
                   break;
                 case 40:
                   trellis.setPixelColor(keyId, PK80);
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][keyId] = 80;
+                  seqr.vels[trk_arr][keyId] = 80;
                   break;
                 default:
                   break;
@@ -1078,18 +1330,20 @@ TrellisCallback onKey(keyEvent evt) {
             default:
               break;
           }
+          seqr.touch_step(trk_arr, keyId);
         }
       } else if (keyId < num_steps) { // STEP EDIT
         col = W10;
-        switch (seqr.seqs[seqr.presets[trk_arr]][trk_arr][keyId]) {
+        switch (seqr.seqs[trk_arr][keyId]) {
           case 1:
-            seqr.seqs[seqr.presets[trk_arr]][trk_arr][keyId] = 0;
+            seqr.seqs[trk_arr][keyId] = 0;
             break;
           case 0:
             col = seq_col(sel_track);
-            seqr.seqs[seqr.presets[trk_arr]][trk_arr][keyId] = 1;
+            seqr.seqs[trk_arr][keyId] = 1;
             break;
         }
+        seqr.touch_step(trk_arr, keyId);
         trellis.setPixelColor(keyId, col);
       } else if (keyId < 40) { // SELECT TRACK 1 - 8
         lastsel = sel_track;
@@ -1097,6 +1351,12 @@ TrellisCallback onKey(keyEvent evt) {
         toggle_selected(keyId);
         if (presetmode == 1) {
           show_presets();
+        } else if (nudgeedit == 1) {
+          patedit = 0;
+          probedit = 0;
+          veledit = 0;
+          gateedit = 0;
+          show_nudges(sel_track);
         } else if (gateedit == 1) {
           patedit = 0;
           probedit = 0;
@@ -1104,6 +1364,7 @@ TrellisCallback onKey(keyEvent evt) {
           show_gates(sel_track);
         } else if (probedit == 1) {
           gateedit = 0;
+          nudgeedit = 0;
           patedit = 0;
           veledit = 0;
           show_probabilities(sel_track);
@@ -1111,18 +1372,21 @@ TrellisCallback onKey(keyEvent evt) {
           patedit = 0;
           probedit = 0;
           gateedit = 0;
+          nudgeedit = 0;
           show_accents(sel_track);
         } else if (chanedit == 1) {
           patedit = 0;
           probedit = 0;
           veledit = 0;
           gateedit = 0;
+          nudgeedit = 0;
           init_chan_conf(sel_track);
         } else {
           patedit = 1;
           probedit = 0;
           veledit = 0;
           gateedit = 0;
+          nudgeedit = 0;
           show_sequence(sel_track);
         }
       } else {
@@ -1205,6 +1469,7 @@ TrellisCallback onKey(keyEvent evt) {
               veledit = 0;
               probedit = 0;
               gateedit = 0;
+              nudgeedit = 0;
               trellis.setPixelColor(48, R127);
               trellis.setPixelColor(49, Y40);
               trellis.setPixelColor(50, P40);
@@ -1218,6 +1483,7 @@ TrellisCallback onKey(keyEvent evt) {
               patedit = 0;
               probedit = 0;
               gateedit = 0;
+              nudgeedit = 0;
               trellis.setPixelColor(48, R40);
               trellis.setPixelColor(49, Y127);
               trellis.setPixelColor(50, P40);
@@ -1231,6 +1497,7 @@ TrellisCallback onKey(keyEvent evt) {
               patedit = 0;
               veledit = 0;
               gateedit = 0;
+              nudgeedit = 0;
               trellis.setPixelColor(48, R40);
               trellis.setPixelColor(49, Y40);
               trellis.setPixelColor(50, P127);
@@ -1238,9 +1505,23 @@ TrellisCallback onKey(keyEvent evt) {
               show_probabilities(sel_track);
             }
             break;
-          case 51: // SHOW GATES
-            if (gateedit == 0) {
+          case 51: // SHOW GATES | ^SHOW MICROTIMING
+            if (shifted == 1) {
+              if (nudgeedit == 0) {
+                nudgeedit = 1;
+                gateedit = 0;
+                probedit = 0;
+                patedit = 0;
+                veledit = 0;
+                trellis.setPixelColor(48, R40);
+                trellis.setPixelColor(49, Y40);
+                trellis.setPixelColor(50, P40);
+                trellis.setPixelColor(51, C127);
+                show_nudges(sel_track);
+              }
+            } else if (gateedit == 0) {
               gateedit = 1;
+              nudgeedit = 0;
               probedit = 0;
               patedit = 0;
               veledit = 0;
@@ -1267,6 +1548,7 @@ TrellisCallback onKey(keyEvent evt) {
                 veledit = 0;
                 probedit = 0;
                 gateedit = 0;
+                nudgeedit = 0;
                 chanedit = 0;
                 trellis.setPixelColor(48, R127);
                 trellis.setPixelColor(49, Y40);
@@ -1318,6 +1600,8 @@ TrellisCallback onKey(keyEvent evt) {
               } else {
                 if (chanedit == 0) {
                   chanedit = 1;
+                  routeedit = 0;
+                  scaleedit = 0;
                   trellis.setPixelColor(53, R127);
                   init_chan_conf(sel_track);
                 } else {
@@ -1326,6 +1610,7 @@ TrellisCallback onKey(keyEvent evt) {
                   veledit = 0;
                   probedit = 0;
                   gateedit = 0;
+                  nudgeedit = 0;
                   chanedit = 0;
                   trellis.setPixelColor(48, R127);
                   trellis.setPixelColor(49, Y40);
@@ -1365,7 +1650,7 @@ TrellisCallback onKey(keyEvent evt) {
               }
             }
             break;
-          case 55: // BASE CLOCK DIVIDER | ^SWING
+          case 55: // BASE CLOCK DIVIDER | ^GROOVE (selected track)
             if (shifted == 0) {
               switch (cfg.step_size) {
                 case SIXTEENTH_NOTE:
@@ -1386,7 +1671,7 @@ TrellisCallback onKey(keyEvent evt) {
               configure_sequencer();
             } else {
               if (swingedit == 0) {
-                trellis.setPixelColor(55, R127);
+                groove_led();
                 swingedit = 1;
               } else {
                 swingedit = 0;
@@ -1411,9 +1696,25 @@ TrellisCallback onKey(keyEvent evt) {
             break;
           case 57: // STOP
             if (chanedit == 0) { seqr.stop(); }
+            if (marci_debug) {
+              seqr.report();
+              gate_timer.report();
+              clock_timer.report();
+              clock_in.report();
+              journal_report();
+              undo_report();
+              sysex_report();
+              editor_report();
+              json_report();
+              memory_report();
+            }
             break;
-          case 58: // RESET
-            if (chanedit == 0) { 
+          case 58: // RESET | ^UNDO
+            if (chanedit == 0 && shifted == 1) {
+              undo();
+              show_pane();
+            } else if (chanedit == 0) { 
+              clock_timer.ext_reset();
               if (!seqr.playing) {
                 seqr.reset();
               } else { 
@@ -1421,8 +1722,11 @@ TrellisCallback onKey(keyEvent evt) {
               }
             }
             break;
-          case 59: // WRITE
-            if (chanedit == 0) {
+          case 59: // WRITE | ^REDO
+            if (chanedit == 0 && shifted == 1) {
+              redo();
+              show_pane();
+            } else if (chanedit == 0) {
               trellis.setPixelColor(59, P80);
               sequences_write();
             }
@@ -1440,22 +1744,39 @@ TrellisCallback onKey(keyEvent evt) {
                 show_presets();
               } else {
                 presetmode = 0;
+                songedit = 0;
                 trellis.setPixelColor(60, C40);
+                pane_leds();
                 show_sequence(sel_track);
               }
             }
             break;
           case 61: // CLOCK ON/OFF
             if (swingedit == 1) {
-              seqr.swing= 0;
+              seqr.grooves[trk_arr] = 0;
+              seqr.touch(trk_arr);
+              groove_led();
+            } else if (veledit == 1 && shifted == 1 && seqr.modes[trk_arr] == CHORD) {
+              for (uint8_t i = 0; i < num_steps; ++i) {
+                seqr.chords[trk_arr][i] = 0;
+              }
+              seqr.touch(trk_arr);
             } else if (veledit == 1) {
               for (uint8_t i = 0; i < num_steps; ++i) {
-                seqr.vels[seqr.presets[trk_arr]][trk_arr][i] = 72;
+                seqr.vels[trk_arr][i] = 72;
               }
+              seqr.touch(trk_arr);
             } else if (notesedit == 1) {
               for (uint8_t i = 0; i < num_steps; ++i) {
-                seqr.notes[seqr.presets[trk_arr]][trk_arr][i] = 0;
+                seqr.notes[trk_arr][i] = 0;
+              }
+              seqr.touch(trk_arr);
+            } else if (nudgeedit == 1) {
+              for (uint8_t i = 0; i < num_steps; ++i) {
+                seqr.nudges[trk_arr][i] = 0;
               }
+              seqr.touch(trk_arr);
+              show_nudges(sel_track);
             } else {
               if (cfg.midi_send_clock == true) {
                 cfg.midi_send_clock = false;
@@ -1469,41 +1790,66 @@ TrellisCallback onKey(keyEvent evt) {
             break;
           case 62: // PARAM -
             if (seqr.modes[trk_arr] == ARP && patedit == 1) {
-              uint8_t arp_id = trk_arr - numarps;
+              uint8_t arp_id = trk_arr;
               if (shifted == 0) {
                 arp_patterns[arp_id] = arp_patterns[arp_id] > 1 ? arp_patterns[arp_id] - 1 : 7;
               } else if (shifted == 1) {
                 arp_octaves[arp_id] = arp_octaves[arp_id] > 1 ? arp_octaves[arp_id] - 1 : 4;
               }
+            } else if (chanedit == 1 && scaleedit == 1) {
+              if (shifted == 1) {
+                seqr.degrees[trk_arr] = seqr.degrees[trk_arr] > -scale_max_degrees ? seqr.degrees[trk_arr] - 1 : -scale_max_degrees;
+              } else {
+                seqr.roots[trk_arr] = seqr.roots[trk_arr] > 0 ? seqr.roots[trk_arr] - 1 : 11;
+              }
+              seqr.set_scale(trk_arr);
+              if (marci_debug) Serial.printf("root %d, degrees %d\n", seqr.roots[trk_arr], seqr.degrees[trk_arr]);
             } else if (chanedit == 1) {
               brightness = brightness > 15 ? brightness - 10 : 5;
               init_interface();
               init_chan_conf(sel_track);
+            } else if (nudgeedit == 1 && swingedit == 0) {
+              int8_t lim = seqr.ticks_per_step / 2 - 1;
+              seqr.nudges[trk_arr][selstep] = seqr.nudges[trk_arr][selstep] > -lim ? seqr.nudges[trk_arr][selstep] - 1 : -lim;
+              seqr.touch_step(trk_arr, selstep);
             } else if (gateedit == 1 && swingedit == 0) {
               for (uint8_t i = 0; i < num_steps; ++i) {
-                seqr.gates[seqr.presets[trk_arr]][trk_arr][i] = seqr.gates[seqr.presets[trk_arr]][trk_arr][i] - 1 > 1 ? seqr.gates[seqr.presets[trk_arr]][trk_arr][i] - 1 : 1;
+                seqr.gates[trk_arr][i] = seqr.gates[trk_arr][i] - 1 > 1 ? seqr.gates[trk_arr][i] - 1 : 1;
                 if (!seqr.playing) set_gate(trk_arr, i, seq_col(sel_track));
               }
+              seqr.touch(trk_arr);
               if (!seqr.playing) { trellis.show(); }
+            } else if (veledit == 1 && shifted == 1 && seqr.modes[trk_arr] == CHORD) {
+              uint8_t& shape = seqr.chords[trk_arr][selstep];
+              shape = shape > 0 ? shape - 1 : chord_shapes_cnt - 1;
+              seqr.touch_step(trk_arr, selstep);
+              if (marci_debug) Serial.println(chord_shapes[shape].name);
             } else if (shifted == 1 && swingedit == 0) {
               seqr.track_notes[trk_arr] = seqr.track_notes[trk_arr] > 0 ? seqr.track_notes[trk_arr] - 1 : 127;
+              seqr.touch(trk_arr);
             } else if (shifted == 1 && swingedit == 1) {
-              seqr.swing= seqr.swing> 0 ? seqr.swing- 1 : 0;
+              seqr.grooves[trk_arr] = seqr.grooves[trk_arr] > 0 ? seqr.grooves[trk_arr] - 1 : grooves_cnt - 1;
+              seqr.touch(trk_arr);
+              groove_led();
             } else if (probedit == 1) {
               for (uint8_t i = 0; i < num_steps; ++i) {
-                seqr.probs[seqr.presets[trk_arr]][trk_arr][i] = seqr.probs[seqr.presets[trk_arr]][trk_arr][i] > 1 ? seqr.probs[seqr.presets[trk_arr]][trk_arr][i] - 1 : 1;
+                seqr.probs[trk_arr][i] = seqr.probs[trk_arr][i] > 1 ? seqr.probs[trk_arr][i] - 1 : 1;
               }
+              seqr.touch(trk_arr);
             } else if (veledit == 1) {
-              if (seqr.modes[trk_arr] == CC || seqr.modes[trk_arr] == NOTE) {
-                seqr.vels[seqr.presets[trk_arr]][trk_arr][selstep] = seqr.vels[seqr.presets[trk_arr]][trk_arr][selstep] > 5 ? seqr.vels[seqr.presets[trk_arr]][trk_arr][selstep] - 1 : 0;
+              if (seqr.modes[trk_arr] == CC || seqr.modes[trk_arr] == NOTE || seqr.modes[trk_arr] == CHORD) {
+                seqr.vels[trk_arr][selstep] = seqr.vels[trk_arr][selstep] > 5 ? seqr.vels[trk_arr][selstep] - 1 : 0;
+                seqr.touch_step(trk_arr, selstep);
               } else {
                 for (uint8_t i = 0; i < num_steps; ++i) {
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][i] = seqr.vels[seqr.presets[trk_arr]][trk_arr][i] > 5 ? seqr.vels[seqr.presets[trk_arr]][trk_arr][i] - 5 : 0;
+                  seqr.vels[trk_arr][i] = seqr.vels[trk_arr][i] > 5 ? seqr.vels[trk_arr][i] - 5 : 0;
                 }
+                seqr.touch(trk_arr);
               }
             } else if (notesedit == 1) {
-              if (seqr.modes[trk_arr] == CC || seqr.modes[trk_arr] == NOTE) {
-                seqr.notes[seqr.presets[trk_arr]][trk_arr][selstep] = seqr.notes[seqr.presets[trk_arr]][trk_arr][selstep] > 0 ? seqr.notes[seqr.presets[trk_arr]][trk_arr][selstep] - 1 : 0;
+              if (seqr.modes[trk_arr] == CC || seqr.modes[trk_arr] == NOTE || seqr.modes[trk_arr] == CHORD) {
+                seqr.notes[trk_arr][selstep] = seqr.notes[trk_arr][selstep] > 0 ? seqr.notes[trk_arr][selstep] - 1 : 0;
+                seqr.touch_step(trk_arr, selstep);
               }
             } else {
               tempo = tempo - 1;
@@ -1512,41 +1858,66 @@ TrellisCallback onKey(keyEvent evt) {
             break;
           case 63: // PARAM +
             if (seqr.modes[trk_arr] == ARP && patedit == 1) {
-              uint8_t arp_id = trk_arr - numarps;
+              uint8_t arp_id = trk_arr;
               if (shifted == 0) {
                 arp_patterns[arp_id] = arp_patterns[arp_id] < 7 ? arp_patterns[arp_id] + 1 : 1;
               } else if (shifted == 1) {
                 arp_octaves[arp_id] = arp_octaves[arp_id] < 4 ? arp_octaves[arp_id] + 1 : 1;
               }
+            } else if (chanedit == 1 && scaleedit == 1) {
+              if (shifted == 1) {
+                seqr.degrees[trk_arr] = seqr.degrees[trk_arr] < scale_max_degrees ? seqr.degrees[trk_arr] + 1 : scale_max_degrees;
+              } else {
+                seqr.roots[trk_arr] = (seqr.roots[trk_arr] + 1) % 12;
+              }
+              seqr.set_scale(trk_arr);
+              if (marci_debug) Serial.printf("root %d, degrees %d\n", seqr.roots[trk_arr], seqr.degrees[trk_arr]);
             } else if (chanedit == 1) {
               brightness = brightness < 117 ? brightness + 10 : 127;
               init_interface();
               init_chan_conf(sel_track);
+            } else if (nudgeedit == 1 && swingedit == 0) {
+              int8_t lim = seqr.ticks_per_step / 2 - 1;
+              seqr.nudges[trk_arr][selstep] = seqr.nudges[trk_arr][selstep] < lim ? seqr.nudges[trk_arr][selstep] + 1 : lim;
+              seqr.touch_step(trk_arr, selstep);
             } else if (gateedit == 1 && swingedit == 0) {
               for (uint8_t i = 0; i < num_steps; ++i) {
-                seqr.gates[seqr.presets[trk_arr]][trk_arr][i] = seqr.gates[seqr.presets[trk_arr]][trk_arr][i] + 1 < 15 ? seqr.gates[seqr.presets[trk_arr]][trk_arr][i] + 1 : 15;
+                seqr.gates[trk_arr][i] = seqr.gates[trk_arr][i] + 1 < 15 ? seqr.gates[trk_arr][i] + 1 : 15;
                 if (!seqr.playing) set_gate(trk_arr, i, seq_col(sel_track));
               }
+              seqr.touch(trk_arr);
               if (!seqr.playing) { trellis.show(); }
+            } else if (veledit == 1 && shifted == 1 && seqr.modes[trk_arr] == CHORD) {
+              uint8_t& shape = seqr.chords[trk_arr][selstep];
+              shape = (shape + 1) % chord_shapes_cnt;
+              seqr.touch_step(trk_arr, selstep);
+              if (marci_debug) Serial.println(chord_shapes[shape].name);
             } else if (shifted == 1 && swingedit == 0) {
               seqr.track_notes[trk_arr] = seqr.track_notes[trk_arr] < 127 ? seqr.track_notes[trk_arr] + 1 : 1;
+              seqr.touch(trk_arr);
             } else if (shifted == 1 && swingedit == 1) {
-              seqr.swing= seqr.swing< 30 ? seqr.swing+ 1 : 30;
+              seqr.grooves[trk_arr] = (seqr.grooves[trk_arr] + 1) % grooves_cnt;
+              seqr.touch(trk_arr);
+              groove_led();
             } else if (probedit == 1) {
               for (uint8_t i = 0; i < num_steps; ++i) {
-                seqr.probs[seqr.presets[trk_arr]][trk_arr][i] = seqr.probs[seqr.presets[trk_arr]][trk_arr][i] < 10 ? seqr.probs[seqr.presets[trk_arr]][trk_arr][i] + 1 : 10;
+                seqr.probs[trk_arr][i] = seqr.probs[trk_arr][i] < 10 ? seqr.probs[trk_arr][i] + 1 : 10;
               }
+              seqr.touch(trk_arr);
             } else if (veledit == 1) {
-              if (seqr.modes[trk_arr] == CC || seqr.modes[trk_arr] == NOTE) {
-                seqr.vels[seqr.presets[trk_arr]][trk_arr][selstep] = seqr.vels[seqr.presets[trk_arr]][trk_arr][selstep] < 122 ? seqr.vels[seqr.presets[trk_arr]][trk_arr][selstep] + 1 : 127;
+              if (seqr.modes[trk_arr] == CC || seqr.modes[trk_arr] == NOTE || seqr.modes[trk_arr] == CHORD) {
+                seqr.vels[trk_arr][selstep] = seqr.vels[trk_arr][selstep] < 122 ? seqr.vels[trk_arr][selstep] + 1 : 127;
+                seqr.touch_step(trk_arr, selstep);
               } else {
                 for (uint8_t i = 0; i < num_steps; ++i) {
-                  seqr.vels[seqr.presets[trk_arr]][trk_arr][i] = seqr.vels[seqr.presets[trk_arr]][trk_arr][i] < 122 ? seqr.vels[seqr.presets[trk_arr]][trk_arr][i] + 5 : 127;
+                  seqr.vels[trk_arr][i] = seqr.vels[trk_arr][i] < 122 ? seqr.vels[trk_arr][i] + 5 : 127;
                 }
+                seqr.touch(trk_arr);
               }
             } else if (notesedit == 1) {
-              if (seqr.modes[trk_arr] == CC || seqr.modes[trk_arr] == NOTE) {
-                seqr.notes[seqr.presets[trk_arr]][trk_arr][selstep] = seqr.notes[seqr.presets[trk_arr]][trk_arr][selstep] < 127 ? seqr.notes[seqr.presets[trk_arr]][trk_arr][selstep] + 1 : 127;
+              if (seqr.modes[trk_arr] == CC || seqr.modes[trk_arr] == NOTE || seqr.modes[trk_arr] == CHORD) {
+                seqr.notes[trk_arr][selstep] = seqr.notes[trk_arr][selstep] < 127 ? seqr.notes[trk_arr][selstep] + 1 : 127;
+                seqr.touch_step(trk_arr, selstep);
               }
             } else {
               tempo = tempo + 1;
@@ -1568,7 +1939,7 @@ TrellisCallback onKey(keyEvent evt) {
 void configure_sequencer() {
   if (marci_debug) Serial.println(F("Configuring sequencer"));
   seqr.set_tempo(tempo);
-  seqr.ticks_per_step = cfg.step_size;
+  seqr.ticks_per_step = cfg.step_size * ticks_per_clock;
   if (m4init == 0) {
     seqr.on_func = send_note_on;
     seqr.off_func = send_note_off;
@@ -1579,6 +1950,8 @@ void configure_sequencer() {
     seqr.reset_func = reset_display;
     if (analog_feats) {
       seqr.gate_func = analog_gate;
+      seqr.pulse_func = analog_pulse;
+      seqr.poll_func = hw_timers_poll;
       seqr.cv_func = analog_cv;
       seqr.analog_io = analog_feats;
     }
@@ -1586,6 +1959,7 @@ void configure_sequencer() {
   seqr.send_clock = cfg.midi_send_clock;
   seqr.length = length;
   seqr.transpose = transpose;
+  seqr.touch_all();  // tempo, step size, transpose & modes are baked into the event lists
 };
 
 void init_flash() {
@@ -1636,12 +2010,14 @@ int freeMemory() {
 // ---  DO ALL THE THINGS
 //
 void setup() {
+  memory_paint();
   TinyUSBDevice.setManufacturerDescriptor("aPatchworkBoy");
   TinyUSBDevice.setProductDescriptor("M4StepSeq");
 
   MIDIusb.setHandleNoteOn(handle_midi_in_NoteOn);
   MIDIusb.setHandleNoteOff(handle_midi_in_NoteOff);
   MIDIusb.setHandleControlChange(handle_midi_in_CC);
+  MIDIusb.setHandleSystemExclusive(handle_sysex);
   MIDIusb.begin(MIDI_CHANNEL_OMNI);
   MIDIusb.turnThruOff();  // turn off echo
   serialmidi.begin(MIDI_CHANNEL_OMNI);
@@ -1651,6 +2027,16 @@ void setup() {
     for (uint8_t i = 0; i < sizeof(gatepins); ++i) {
       pinMode(gatepins[i], OUTPUT);  //digtal (gate) out
     }
+    for (uint8_t i = 0; i < sizeof(clkpins); ++i) {
+      pinMode(clkpins[i], OUTPUT);  //analog clock & reset out
+    }
+    for (uint8_t i = 0; i < numtracks; ++i) {
+      gate_timer.attach(i, gatepins[i]);
+    }
+    gate_timer.attach(clk_out_idx, clkpins[0]);
+    gate_timer.attach(rst_out_idx, clkpins[1]);
+    gate_timer_begin();
+    clock_in_begin();
   }
 
   Serial.begin(115200);
@@ -1661,23 +2047,29 @@ void setup() {
   // For the sake of sanity and...
   for (uint8_t t = 0; t < numtracks; t++) {
     seqr.divs[t] = 0;
+    seqr.muls[t] = 0;
     seqr.lengths[t] = t_size / 2;
-    seqr.divcounts[t] = -1;
     seqr.offsets[t] = 0;
     seqr.outcomes[t] = 1;
     seqr.multistepi[t] = -1;
+    seqr.trig_lens[t] = 0;
   }
   patedit = patedit == 0 ? 1 : patedit;
   sel_track = sel_track == 0 ? 1 : sel_track;
   lastsel = lastsel == 0 ? 1 : sel_track;
 
   // Load in saved slots...
+  journal_recover();
   sequences_read();
   notes_read();
   velocities_read();
   probabilities_read();
   gates_read();
+  nudges_read();
+  chords_read();
   settings_read();
+  song_read();
+  journal_begin();  // edits since the last checkpoint
   configure_sequencer();
 
   if (!trellis.begin()) {
@@ -1694,12 +2086,14 @@ void setup() {
   randomSeed(analogRead(0));  // for probability
 
   init_interface();
+  heap_at_boot = heap_top();
   if (marci_debug) { 
-    Serial.println(freeMemory());
+    memory_report();
     Serial.println(F("GO!"));
   }
 
   show_sequence(sel_track);
+  clock_timer_begin();
 }
 
 //
@@ -1707,5 +2101,9 @@ void setup() {
 //
 void loop() {
   midi_read_and_forward();
-  seqr.update();  // will call send_note_{on,off} callbacks
+  song_update();
+  journal_update();
+  sysex_update();
+  editor_read();
+  editor_update(seqr.update());  // will call send_note_{on,off} callbacks, then editor commands
 }
\ No newline at end of file
@@ -0,0 +1,91 @@
+/**
+ * active_notes.h -- Sounding-note bitmap for Multitrack Sequencer (for Feather M4 Express)
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * One bit per note per MIDI channel (16 x 128 bits), set by every note on & cleared by every
+ * note off we send. Offs for notes that aren't sounding are dropped, and stop / panic / preset
+ * changes walk only the set bits, so they cost one message per note actually left hanging.
+ */
+#ifndef MULTI_SEQUENCER_ACTIVE_NOTES
+#define MULTI_SEQUENCER_ACTIVE_NOTES
+
+template<uint8_t chans = 16>
+class ActiveNotes {
+public:
+  uint32_t bits[chans][4];
+  // stats
+  uint32_t released;  // note-offs sent by release() / release_all()
+  uint32_t dropped;   // note-offs not sent, note wasn't sounding
+
+  ActiveNotes() {
+    for (uint8_t c = 0; c < chans; ++c) {
+      for (uint8_t w = 0; w < 4; ++w) bits[c][w] = 0;
+    }
+    clear_stats();
+  }
+
+  // chan is 1 - 16, as sent
+  void on(uint8_t note, uint8_t chan) {
+    if (chan == 0 || chan > chans || note > 127) return;
+    bits[chan - 1][note >> 5] |= 1UL << (note & 31);
+  }
+
+  // true = was sounding, so the off needs sending
+  bool off(uint8_t note, uint8_t chan) {
+    if (chan == 0 || chan > chans || note > 127 || !(bits[chan - 1][note >> 5] & (1UL << (note & 31)))) {
+      dropped++;
+      return false;
+    }
+    bits[chan - 1][note >> 5] &= ~(1UL << (note & 31));
+    return true;
+  }
+
+  bool sounding(uint8_t note, uint8_t chan) {
+    if (chan == 0 || chan > chans || note > 127) return false;
+    return bits[chan - 1][note >> 5] & (1UL << (note & 31));
+  }
+
+  // note-off for everything sounding on one channel
+  void release(uint8_t chan, TriggerFunc off_func) {
+    if (chan == 0 || chan > chans) return;
+    for (uint8_t w = 0; w < 4; ++w) {
+      uint32_t word = bits[chan - 1][w];  // off_func clears bits as it goes
+      while (word) {
+        uint8_t b = __builtin_ctz(word);
+        word &= word - 1;
+        off_func((w << 5) | b, 0, 1, true, chan);
+        released++;
+      }
+    }
+  }
+
+  void release_all(TriggerFunc off_func) {
+    for (uint8_t c = 1; c <= chans; ++c) release(c, off_func);
+  }
+
+  uint16_t count() {
+    uint16_t n = 0;
+    for (uint8_t c = 0; c < chans; ++c) {
+      for (uint8_t w = 0; w < 4; ++w) n += __builtin_popcount(bits[c][w]);
+    }
+    return n;
+  }
+
+  void clear_stats() {
+    released = 0;
+    dropped = 0;
+  }
+
+  void report() {
+    Serial.print(F("Notes sounding: "));
+    Serial.print(count());
+    Serial.print(F(", offs released: "));
+    Serial.print(released);
+    Serial.print(F(", offs dropped: "));
+    Serial.println(dropped);
+  }
+};
+
+ActiveNotes<> active_notes;
+#endif
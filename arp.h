@@ -4,6 +4,9 @@
  * 04 Nov 2023 - @apatchworkboy / Marci, derived from & inspired by...
  * 26 Feb 2020 - @shampton https://gitlab.com/hampton-harmonics/hampton-harmonics-modules
  *
+ * Held notes for every arp live in one fixed pool (arp_pool), each arp keeping its own notes as a
+ * linked list in the order they were played. Nothing is allocated at runtime: a step builds its
+ * octave-expanded pitches in a small stack buffer and indexes the pattern straight out of it.
  */
 
 #ifndef MULTI_SEQUENCER_ARP
@@ -11,135 +14,151 @@
 
 #include <stdint.h>
 
-template<uint8_t capacity> // max 10, cos 10 fingers.
-class Arp {
+const uint8_t arp_capacity = 10;     // notes per arp, cos 10 fingers
+const uint8_t arp_max_octaves = 4;
+const uint8_t arp_pool_size = 40;    // held notes shared by all arps
+const uint8_t arp_nil = 0xFF;
+
+template<uint8_t size>
+class ArpNotePool {
   public:
-    std::vector<uint8_t> pitches;
-    std::vector<uint8_t> octpitches;
-    byte _sequencePattern;
-    byte _octaves;
-    short int _step;
-    uint8_t _maxSteps;
-    uint8_t _pitchOut;
+    uint8_t notes[size];
+    uint8_t next[size];   // next slot in the owning arp's list, or the free list
+    uint8_t free_head;
+    uint8_t used;
+    uint8_t peak;
+    uint32_t refused;     // notes dropped because the pool was full
 
-	Arp(){
-    std::vector<uint8_t> pitches;
-    byte _sequencePattern = 1;
-    byte _octaves = 1;
-    short int _step = 0;
-    uint8_t _maxSteps = 0;
-    uint8_t _pitchOut = 0.0f;
-    pitches.reserve(capacity); //realistically should never end up larger than 10;
-    octpitches.reserve(capacity * 4); //this could hit 40. Do we have memory for that??
+  ArpNotePool() {
+    for (uint8_t i = 0; i < size; ++i) next[i] = i + 1 < size ? i + 1 : arp_nil;
+    free_head = 0;
+    used = 0;
+    peak = 0;
+    refused = 0;
   }
 
-  uint8_t getUpPatternPitch() {
-    std::sort(octpitches.begin(), octpitches.end());
-    return octpitches.at(this->_step);
+  uint8_t alloc() {
+    uint8_t slot = free_head;
+    if (slot == arp_nil) {
+      refused++;
+      return arp_nil;
+    }
+    free_head = next[slot];
+    next[slot] = arp_nil;
+    used++;
+    if (used > peak) peak = used;
+    return slot;
   }
 
-  uint8_t getDownPatternPitch() {
-    std::sort(octpitches.begin(), octpitches.end(), std::greater<uint8_t>());
-    return octpitches.at(this->_step);
+  void release(uint8_t slot) {
+    next[slot] = free_head;
+    free_head = slot;
+    used--;
   }
 
-  uint8_t getInclusivePatternPitch() {
-    std::vector<uint8_t> downPitches = octpitches;
-    std::sort(octpitches.begin(), octpitches.end());
-    std::sort(downPitches.begin(), downPitches.end(), std::greater<uint8_t>());
-    std::vector<uint8_t> combinedPitches;
-    combinedPitches.reserve(octpitches.size() + downPitches.size());
-    combinedPitches.insert(combinedPitches.end(), octpitches.begin(), octpitches.end());
-    combinedPitches.insert(combinedPitches.end(), downPitches.begin(), downPitches.end());
-    return combinedPitches.at(this->_step);
+  void report() {
+    Serial.print(F("Arp notes peak: "));
+    Serial.print(peak);
+    Serial.print(F("/"));
+    Serial.print(size);
+    Serial.print(F(", refused: "));
+    Serial.println(refused);
   }
+};
 
-  uint8_t getExclusivePatternPitch() {
-    std::vector<uint8_t> downPitches = octpitches;
-    std::sort(octpitches.begin(), octpitches.end());
-    std::sort(downPitches.begin(), downPitches.end(), std::greater<uint8_t>());
-    std::vector<uint8_t> combinedPitches;
-    combinedPitches.reserve(octpitches.size() + downPitches.size());
-    combinedPitches.insert(combinedPitches.end(), octpitches.begin(), octpitches.end() - 1);
-    combinedPitches.insert(combinedPitches.end(), downPitches.begin(), downPitches.end());
-    return combinedPitches.at(this->_step);
-  }
+ArpNotePool<arp_pool_size> arp_pool;
+
+template<uint8_t capacity> // max 10, cos 10 fingers.
+class Arp {
+  public:
+    uint8_t head;   // oldest held note (slot in arp_pool)
+    uint8_t tail;   // newest
+    uint8_t count;
+    byte _sequencePattern;
+    byte _octaves;
+    short int _step;
+    uint8_t _maxSteps;
+    uint8_t _pitchOut;
 
-  uint8_t getOutsideInPatternPitch() {
-    std::vector<uint8_t> downPitches = octpitches;
-    std::sort(octpitches.begin(), octpitches.end());
-    std::sort(downPitches.begin(), downPitches.end(), std::greater<uint8_t>());
-    std::vector<uint8_t> outsideInPitches;
-    uint8_t length = octpitches.size() / 2 + 1; // the plus one helps odd numbers, but also isn't reached in even numbers
-    outsideInPitches.reserve(length);
-    for (uint8_t  i = 0; i < length; ++i) {
-      outsideInPitches.push_back(octpitches.at(i));
-      outsideInPitches.push_back(downPitches.at(i));
-    }
-    return outsideInPitches.at(this->_step);
+	Arp(){
+    head = arp_nil;
+    tail = arp_nil;
+    count = 0;
+    _sequencePattern = 1;
+    _octaves = 1;
+    _step = -1;
+    _maxSteps = 0;
+    _pitchOut = 0;
   }
 
-  uint8_t getOrderPatternPitch() {
-    return octpitches.at(this->_step);
+  // held notes over the chosen octaves, in play order (octave by octave)
+  uint8_t getOctavePitches(uint8_t* out) {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < this->_octaves; i++) {
+      for (uint8_t s = head; s != arp_nil; s = arp_pool.next[s]) {
+        out[n++] = constrain(arp_pool.notes[s] + (i*12), 0, 127);
+      }
+    }
+    return n;
   }
 
-  uint8_t getRandomPatternPitch() {
-    int randomStep = random(32) % this->_maxSteps;
-    return octpitches.at(randomStep);
+  static void sortPitches(uint8_t* p, uint8_t n) {
+    for (uint8_t i = 1; i < n; ++i) {
+      uint8_t v = p[i];
+      uint8_t j = i;
+      for (; j > 0 && p[j - 1] > v; --j) p[j] = p[j - 1];
+      p[j] = v;
+    }
   }
 
-  void setPitchOut() {
+  // pick = any number, chooses the note of the random pattern
+  void setPitchOut(uint32_t pick) {
+    uint8_t p[capacity * arp_max_octaves];
+    uint8_t m = getOctavePitches(p);
+    if (this->_sequencePattern <= 5) sortPitches(p, m);
+    uint8_t k = this->_step;
     switch (this->_sequencePattern) {
       case 1: {
         if (marci_debug) Serial.println("UP");
-        this->_pitchOut = getUpPatternPitch();
+        this->_pitchOut = p[k];
         break;
       }
       case 2: {
         if (marci_debug) Serial.println("DN");
-        this->_pitchOut = getDownPatternPitch();
+        this->_pitchOut = p[m - 1 - k];
         break;
       }
       case 3: {
+        // up, then down (top & bottom twice)
         if (marci_debug) Serial.println("INC");
-        this->_pitchOut = getInclusivePatternPitch();
+        this->_pitchOut = k < m ? p[k] : p[2 * m - 1 - k];
         break;
       }
       case 4: {
+        // up, then down (top & bottom once)
         if (marci_debug) Serial.println("EXC");
-        this->_pitchOut = getExclusivePatternPitch();
+        this->_pitchOut = k + 1 < m ? p[k] : p[2 * m - 2 - k];
         break;
       }
       case 5: {
+        // lowest, highest, 2nd lowest, 2nd highest...
         if (marci_debug) Serial.println("OUTIN");
-        this->_pitchOut = getOutsideInPatternPitch();
+        this->_pitchOut = k % 2 == 0 ? p[k / 2] : p[m - 1 - k / 2];
         break;
       }
       case 6: {
         if (marci_debug) Serial.println("ORD");
-        this->_pitchOut = getOrderPatternPitch();
+        this->_pitchOut = p[k];
         break;
       }
       case 7: {
         if (marci_debug) Serial.println("RAN");
-        this->_pitchOut = getRandomPatternPitch();
+        this->_pitchOut = p[pick % m];
         break;
       }
     }
   }
 
-  std::vector<uint8_t> getOctavePitches() {
-    std::vector<uint8_t> result;
-    int numberOfPitches = pitches.size();
-    for (int i = 0; i < this->_octaves; i++) {
-      for (int j = 0; j < numberOfPitches; j++) {
-        uint8_t p = constrain(pitches.at(j) + (i*12), 0, 127);
-        result.push_back(p);
-      }
-    }
-    return result;
-  }
-
   void setStep(short int nextStep, int numberOfPitches) {
     if (marci_debug) Serial.println("setStep");
     this->_step = nextStep;
@@ -152,59 +171,68 @@ class Arp {
     if (this->_sequencePattern == 3) { // inclusive
       this->_maxSteps *= 2; // double the max steps since we're going up and back down
     }
-    else if (this->_sequencePattern == 4) { // exclusive
+    else if (this->_sequencePattern == 4 && this->_maxSteps > 1) { // exclusive
       this->_maxSteps += this->_maxSteps - 2; // double the max steps, but subtract 2 since we're not doubling the top and bottom
     }
 
-    if (this->_step >= this->_maxSteps) {
+    if (this->_step >= this->_maxSteps || this->_step < 0) {
       this->_step = 0;
     }
   }
 
+  // unlink a held note, true if it was there
+  bool remove(uint8_t note) {
+    uint8_t prev = arp_nil;
+    for (uint8_t s = head; s != arp_nil; prev = s, s = arp_pool.next[s]) {
+      if (arp_pool.notes[s] != note) continue;
+      if (prev == arp_nil) head = arp_pool.next[s]; else arp_pool.next[prev] = arp_pool.next[s];
+      if (tail == s) tail = prev;
+      arp_pool.release(s);
+      count--;
+      return true;
+    }
+    return false;
+  }
+
   void NoteOn(uint8_t& note){
-    uint8_t numberOfPitches = pitches.size();
     if (marci_debug) {
       Serial.println("Adding note to stack");
       Serial.println(note);
     }
-    if (numberOfPitches == capacity){
-      // full, bin note at 0 (ie: oldest)
+    if (count != 0) {
+      // does note already exist?
       if (marci_debug) {
-        Serial.println("Full - erasing oldest from stack");
+        Serial.println("Checking for duplicates");
       }
-      pitches.erase(pitches.begin());
+      if (remove(note) && marci_debug) Serial.println("Found and erased");
     }
-    if (numberOfPitches != 0) {
-      // does note already exist?
+    if (count == capacity || (count != 0 && arp_pool.free_head == arp_nil)) {
+      // full (or pool is), bin oldest note
       if (marci_debug) {
-        Serial.println("Checking for duplicates");
+        Serial.println("Full - erasing oldest from stack");
       }
-      auto i = find(pitches.begin(), pitches.end(), note);
-      if (i != pitches.end()){
-        pitches.erase(i);
-        if (marci_debug) Serial.println("Found and erased");
-      }      
+      remove(arp_pool.notes[head]);
     }
     // add the note
-    pitches.push_back(note);
+    uint8_t s = arp_pool.alloc();
+    if (s == arp_nil) return;
+    arp_pool.notes[s] = note;
+    if (tail == arp_nil) head = s; else arp_pool.next[tail] = s;
+    tail = s;
+    count++;
     if (marci_debug) {
       Serial.println("Added!");
     }
   }
 
   void NoteOff(uint8_t& note){
-    uint8_t numberOfPitches = pitches.size();
-    if (numberOfPitches != 0) {
+    if (count != 0) {
       if (marci_debug) {
         Serial.println("Finding and erasing note from stack");
         Serial.println(note);
       }
-      auto i = find(pitches.begin(), pitches.end(), note);
-      if (i != pitches.end()){
-        pitches.erase(i);
-        if (marci_debug) {
-          Serial.println("Removed!");
-        }
+      if (remove(note) && marci_debug) {
+        Serial.println("Removed!");
       }
     } else {
       if (marci_debug) Serial.println("Stack is empty");
@@ -215,24 +243,32 @@ class Arp {
     this->_step = -1;
   }
 
-  uint8_t process(byte pattern, byte octaves) {
+  // where the arp would be after `played` steps with the notes held now (song position)
+  void seek(uint32_t played) {
+    if (count == 0 || played == 0) {
+      reset();
+      return;
+    }
+    setStep(0, count);  // works out _maxSteps for the last pattern & octaves
+    this->_step = (played - 1) % this->_maxSteps;
+  }
+
+  uint8_t process(byte pattern, byte octaves, uint32_t pick) {
     // Set params
-    uint8_t numberOfPitches = pitches.size();
+    uint8_t numberOfPitches = count;
     if (marci_debug) {
       Serial.print(numberOfPitches);
       Serial.println(" pitches");
     }
     if (numberOfPitches != 0){
       this->_sequencePattern = (byte) constrain(pattern, 1, 7);
-      this->_octaves = (byte) constrain(octaves, 1, 4);
+      this->_octaves = (byte) constrain(octaves, 1, arp_max_octaves);
       setStep(this->_step + 1, numberOfPitches);
-      octpitches = getOctavePitches();
-      setPitchOut();
-      octpitches.clear();
+      setPitchOut(pick);
       return constrain(this->_pitchOut, 1, 127);
     } else {
       return 0;
     }
   }
 };
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,171 @@
+/**
+ * chords.h -- Chord shapes & voice pool for Multitrack Sequencer (for Feather M4 Express)
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * A CHORD step is its root (notes layer) plus an index into chord_shapes. Every note it sounds
+ * takes a voice from a fixed pool kept as a min-heap on note-off time, so the scheduler only ever
+ * looks at the earliest deadline: nothing due costs one compare per tick, however many voices.
+ */
+#ifndef MULTI_SEQUENCER_CHORDS
+#define MULTI_SEQUENCER_CHORDS
+
+const uint8_t chord_max_notes = 4;
+const uint8_t chord_voices = 16;   // notes sounding at once, across all CHORD tracks
+
+typedef struct {
+  const char* name;
+  uint8_t size;
+  int8_t intervals[chord_max_notes];  // semitones above the root
+} ChordShape;
+
+constexpr ChordShape chord_shapes[] = {
+  { "maj", 3, { 0, 4, 7 } },
+  { "min", 3, { 0, 3, 7 } },
+  { "maj7", 4, { 0, 4, 7, 11 } },
+  { "min7", 4, { 0, 3, 7, 10 } },
+  { "7", 4, { 0, 4, 7, 10 } },
+  { "sus2", 3, { 0, 2, 7 } },
+  { "sus4", 3, { 0, 5, 7 } },
+  { "dim", 3, { 0, 3, 6 } },
+  { "aug", 3, { 0, 4, 8 } },
+  { "m7b5", 4, { 0, 3, 6, 10 } },
+  { "add9", 4, { 0, 4, 7, 14 } },
+  { "6", 4, { 0, 4, 7, 9 } },
+  { "5", 2, { 0, 7 } },
+  { "oct", 2, { 0, 12 } },
+  { "min6", 4, { 0, 3, 7, 9 } },
+  { "root", 1, { 0 } },
+};
+constexpr uint8_t chord_shapes_cnt = sizeof(chord_shapes) / sizeof(chord_shapes[0]);
+static_assert(chord_shapes_cnt == 16, "chord shape index is edited as 0 - 15");
+
+typedef struct {
+  uint32_t off_at;  // micros() deadline
+  uint8_t note;
+  uint8_t chan;
+} Voice;
+
+template<uint8_t size = chord_voices>
+class VoicePool {
+public:
+  Voice heap[size];  // heap[0] = next to release
+  uint8_t count;
+  // stats
+  uint8_t peak;
+  uint32_t steals;   // voices cut short because the pool was full
+
+  VoicePool() {
+    count = 0;
+    peak = 0;
+    steals = 0;
+  }
+
+  // sound a note until off_at: re-articulates it if it's already held, steals the
+  // voice closest to its own release if the pool is full
+  void start(uint8_t note, uint8_t chan, uint32_t off_at, TriggerFunc off) {
+    for (uint8_t v = 0; v < count; ++v) {
+      if (heap[v].note == note && heap[v].chan == chan) {
+        off(note, 0, 1, true, chan);
+        bool later = before(heap[v].off_at, off_at);
+        heap[v].off_at = off_at;
+        later ? sift_down(v) : sift_up(v);
+        return;
+      }
+    }
+    if (count == size) {
+      off(heap[0].note, 0, 1, true, heap[0].chan);
+      steals++;
+      heap[0] = { off_at, note, chan };
+      sift_down(0);
+      return;
+    }
+    heap[count] = { off_at, note, chan };
+    sift_up(count++);
+    if (count > peak) peak = count;
+  }
+
+  // note-offs for everything due by now
+  void release_due(uint32_t now, TriggerFunc off) {
+    while (count > 0 && !before(now, heap[0].off_at)) {
+      off(heap[0].note, 0, 1, true, heap[0].chan);
+      heap[0] = heap[--count];
+      sift_down(0);
+    }
+  }
+
+  void release_all(TriggerFunc off) {
+    for (uint8_t v = 0; v < count; ++v) {
+      off(heap[v].note, 0, 1, true, heap[v].chan);
+    }
+    count = 0;
+  }
+
+  // note-offs for one channel's voices (track changed preset)
+  void release_chan(uint8_t chan, TriggerFunc off) {
+    uint8_t kept = 0;
+    for (uint8_t v = 0; v < count; ++v) {
+      if (heap[v].chan == chan) {
+        off(heap[v].note, 0, 1, true, chan);
+      } else {
+        heap[kept++] = heap[v];
+      }
+    }
+    count = kept;
+    for (int8_t v = count / 2 - 1; v >= 0; --v) sift_down(v);
+  }
+
+  // forget every voice without sending offs (caller releases the notes some other way)
+  void clear() {
+    count = 0;
+  }
+
+  void clear_stats() {
+    peak = count;
+    steals = 0;
+  }
+
+  void report() {
+    Serial.print(F("Chord voices peak: "));
+    Serial.print(peak);
+    Serial.print(F("/"));
+    Serial.print(size);
+    Serial.print(F(", steals: "));
+    Serial.println(steals);
+  }
+
+private:
+  // micros() wraps, so compare deadlines by difference
+  static bool before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+  }
+
+  void sift_up(uint8_t v) {
+    while (v > 0) {
+      uint8_t parent = (v - 1) / 2;
+      if (!before(heap[v].off_at, heap[parent].off_at)) return;
+      swap(v, parent);
+      v = parent;
+    }
+  }
+
+  void sift_down(uint8_t v) {
+    while (true) {
+      uint8_t l = v * 2 + 1;
+      uint8_t r = l + 1;
+      uint8_t m = v;
+      if (l < count && before(heap[l].off_at, heap[m].off_at)) m = l;
+      if (r < count && before(heap[r].off_at, heap[m].off_at)) m = r;
+      if (m == v) return;
+      swap(v, m);
+      v = m;
+    }
+  }
+
+  void swap(uint8_t a, uint8_t b) {
+    Voice t = heap[a];
+    heap[a] = heap[b];
+    heap[b] = t;
+  }
+};
+#endif
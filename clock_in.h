@@ -0,0 +1,191 @@
+/**
+ * clock_in.h -- Analog clock & reset input for Multitrack Sequencer (for Feather M4 Express)
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Rising edges on the clock in pin are timestamped in the pin interrupt and queued; the main
+ * loop drains the queue, tracks the pulse period, and turns every pulse into 24PPQN ticks
+ * fed through the same path as MIDI clock. Works for any input PPQN: each pulse is worth
+ * 24/ppqn ticks, remainders carry over. Once the period is steady (locked) a pulse's ticks are
+ * spread across it; until then they go in a burst on the edge, so position is never lost
+ * while the tempo settles. tools/test_clock_in.cpp drives it with pulse trains on the host.
+ */
+#ifndef MULTI_SEQUENCER_CLOCK_IN
+#define MULTI_SEQUENCER_CLOCK_IN
+
+// selectable analog clock input rates (pulses per quarter note)
+const uint8_t clk_in_ppqns[] = { 1, 2, 4, 24 };
+const uint8_t clk_in_ppqns_cnt = 4;
+const byte clkinpins[2] = { 18, 19 };     // analog clock in on A4, reset in on A5
+const uint32_t clk_in_debounce = 500;     // us, ignore edges closer than this
+const uint8_t clk_in_lock_pulses = 4;     // consistent pulses needed before we follow tempo
+const uint8_t clk_in_tolerance = 4;       // 1/4 = 25% period change drops lock
+
+void ext_clock_tick(uint32_t now_micros);  // Feather_M4_Seq.ino
+
+template<uint8_t depth = 8>
+class ClockIn {
+public:
+  volatile uint32_t stamps[depth];  // edge timestamps, written by the pin interrupt
+  volatile uint8_t head;
+  volatile bool reset_pending;
+  uint8_t tail;
+  uint8_t ppqn;
+  uint32_t last_edge;
+  uint32_t period;      // smoothed micros between input pulses
+  uint8_t consistent;   // pulses in a row within tolerance
+  bool locked;
+  // interpolated ticks still owed for the current pulse
+  uint8_t sub_remaining;
+  uint32_t sub_next;
+  uint32_t sub_period;
+  uint8_t carry;        // 24PPQN remainder for input rates that don't divide 24
+  // jitter & lock stats
+  uint32_t pulses;
+  uint32_t overflows;
+  uint32_t jitter_max;  // biggest deviation of an interval from the estimate, while locked
+  uint32_t lock_losses;
+
+  ClockIn() {
+    head = 0;
+    tail = 0;
+    reset_pending = false;
+    ppqn = 24;
+    last_edge = 0;
+    period = 0;
+    consistent = 0;
+    locked = false;
+    sub_remaining = 0;
+    carry = 0;
+    clear_stats();
+  }
+
+  void clear_stats() {
+    pulses = 0;
+    overflows = 0;
+    jitter_max = 0;
+    lock_losses = 0;
+  }
+
+  // pin interrupt: timestamp only
+  void capture(uint32_t stamp) {
+    uint8_t next = (head + 1) % depth;
+    if (next == tail) {
+      overflows = overflows + 1;
+      return;
+    }
+    stamps[head] = stamp;
+    head = next;
+  }
+
+  // main loop: drain captured edges, emit due interpolated ticks
+  void poll(uint32_t now) {
+    if (reset_pending) {
+      reset_pending = false;
+      sub_remaining = 0;
+      carry = 0;
+      midiclk_cnt = 0;
+      clock_timer.ext_reset();
+      if (!seqr.playing) {
+        seqr.reset();
+      } else {
+        seqr.resetflag = 1;
+      }
+    }
+    while (tail != head) {
+      uint32_t stamp = stamps[tail];
+      tail = (tail + 1) % depth;
+      edge(stamp);
+    }
+    while (sub_remaining > 0 && (int32_t)(now - sub_next) >= 0) {
+      sub_remaining--;
+      ext_clock_tick(sub_next);
+      sub_next += sub_period;
+    }
+    // clock stopped: drop lock after two missing pulses
+    if (locked && (now - last_edge) > period * 2) {
+      locked = false;
+      consistent = 0;
+      lock_losses++;
+    }
+  }
+
+  void report() {
+    Serial.print(F("Clock in pulses: "));
+    Serial.print(pulses);
+    Serial.print(F(", period us: "));
+    Serial.print(period);
+    Serial.print(F(", locked: "));
+    Serial.print(locked);
+    Serial.print(F(", jitter max us: "));
+    Serial.print(jitter_max);
+    Serial.print(F(", lock losses: "));
+    Serial.print(lock_losses);
+    Serial.print(F(", overflows: "));
+    Serial.println(overflows);
+  }
+
+private:
+  void edge(uint32_t stamp) {
+    uint32_t interval = stamp - last_edge;
+    if (pulses > 0 && interval < clk_in_debounce) return;
+    pulses++;
+    last_edge = stamp;
+    if (pulses > 1) follow(interval);
+
+    // flush anything still owed from the previous pulse, then this pulse's ticks: every pulse
+    // is worth its ticks, locked or not, so we never fall behind the master
+    while (sub_remaining > 0) {
+      sub_remaining--;
+      ext_clock_tick(stamp);
+    }
+    uint16_t owed = carry + midi_ppqn;
+    carry = owed % ppqn;
+    owed = owed / ppqn;
+    if (owed == 0) return;
+    ext_clock_tick(stamp);
+    if (!locked) {
+      // no steady period to spread them over yet: all at once
+      for (uint16_t k = 1; k < owed; ++k) ext_clock_tick(stamp);
+      return;
+    }
+    sub_remaining = owed - 1;
+    sub_period = period / owed;
+    sub_next = stamp + sub_period;
+  }
+
+  // tempo estimate: running average, reseeded on big jumps. Locked = steady enough to follow
+  void follow(uint32_t interval) {
+    uint32_t dev = interval > period ? interval - period : period - interval;
+    if (period == 0 || dev > period / clk_in_tolerance) {
+      if (locked) lock_losses++;
+      period = interval;
+      consistent = 0;
+      locked = false;
+      return;
+    }
+    if (locked && dev > jitter_max) jitter_max = dev;
+    period = period + ((int32_t)(interval - period) / 8);
+    if (consistent < clk_in_lock_pulses) consistent++;
+    locked = consistent >= clk_in_lock_pulses;
+    if (locked) seqr.tick_micros = period * ppqn / ticks_per_quarternote;
+  }
+};
+
+ClockIn<> clock_in;
+
+void clock_in_isr() {
+  clock_in.capture(micros());
+}
+
+void reset_in_isr() {
+  clock_in.reset_pending = true;
+}
+
+void clock_in_begin() {
+  pinMode(clkinpins[0], INPUT);
+  pinMode(clkinpins[1], INPUT);
+  attachInterrupt(digitalPinToInterrupt(clkinpins[0]), clock_in_isr, RISING);
+  attachInterrupt(digitalPinToInterrupt(clkinpins[1]), reset_in_isr, RISING);
+}
+#endif
@@ -0,0 +1,260 @@
+/**
+ * clock_timer.h -- Hardware-timed master clock for Multitrack Sequencer (for Feather M4 Express)
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * The master clock (ticks_per_quarternote, 96PPQN) runs off a TC4 compare interrupt scheduled against
+ * absolute deadlines, so it neither drifts nor waits on the display or a flash save. Each tick the interrupt:
+ * - every ticks_per_clock ticks, writes the 24PPQN MIDI clock byte straight to the DIN (Serial1) port
+ *   (realtime bytes are legal mid-message),
+ * - pulses the analog clock out at the selected PPQN (and the reset out on play),
+ * - hands the tick to the sequencer, which consumes it from update() (USB clock, steps, display).
+ *   After a long main loop stall (a flash write, say) it catches up on at most clk_backlog_max of
+ *   them; the rest are dropped & counted rather than played as a burst of steps.
+ * Non-SAMD51 builds poll the deadline instead (clock_timer_poll()), same as gate_timer.h.
+ */
+#ifndef MULTI_SEQUENCER_CLOCK
+#define MULTI_SEQUENCER_CLOCK
+
+// analog clock output rates (pulses per quarter note)
+const uint8_t clk_out_ppqns[] = { 24, 4, 1 };
+const uint8_t clk_out_ppqns_cnt = 3;
+const byte clkpins[2] = { 16, 17 };          // analog clock out on A2, reset out on A3
+const uint8_t clk_out_idx = numtracks;       // gate_timer outputs after the track gates
+const uint8_t rst_out_idx = numtracks + 1;
+const uint32_t clk_out_width_micros = 5000;  // 5ms pulses, clamped to half a period
+const uint32_t clk_jitter_threshold = 100;   // us, ticks later than this count as jittered
+const uint8_t clk_backlog_max = ticks_per_clock;  // ticks a stalled main loop catches up on, the rest are dropped
+#if defined(__SAMD51__)
+const bool clock_timer_serial = true;        // DIN clock bytes are written by the interrupt
+#else
+const bool clock_timer_serial = false;       // polled, DIN clock stays in update()
+#endif
+
+void clock_timer_arm(uint32_t delay_micros);
+void clock_timer_hold();
+void clock_timer_release();
+
+class ClockTimer {
+public:
+  volatile uint32_t next_due;    // absolute micros() of the next tick
+  volatile uint8_t out_ppqn;     // analog clock out rate
+  volatile uint8_t out_count;
+  volatile uint8_t clk_sub;      // engine ticks into the current MIDI clock
+  volatile bool was_playing;
+  volatile bool resuming;        // play is a MIDI Continue: keep the clock phase, no reset pulse
+  bool running;
+  // jitter stats (lateness of each tick vs. its deadline)
+  volatile uint32_t ticks;
+  volatile uint32_t late_max;
+  volatile uint32_t late_over;   // ticks later than clk_jitter_threshold
+  volatile uint32_t overruns;    // ticks the sequencer hadn't consumed before the next arrived
+  volatile uint32_t dropped;     // ...& ones never handed over, clk_backlog_max already waiting
+
+  ClockTimer() {
+    next_due = 0;
+    out_ppqn = 24;
+    out_count = 0;
+    clk_sub = 0;
+    was_playing = false;
+    resuming = false;
+    running = false;
+    clear_stats();
+  }
+
+  void clear_stats() {
+    ticks = 0;
+    late_max = 0;
+    late_over = 0;
+    overruns = 0;
+    dropped = 0;
+  }
+
+  void begin(uint32_t now) {
+    next_due = now + seqr.tick_micros;
+    running = true;
+    seqr.timer_clocked = true;
+    clock_timer_arm(seqr.tick_micros);
+  }
+
+  // analog clock out pulse, at out_ppqn (used by both internal & external clock), n = engine ticks elapsed
+  void clock_out(uint32_t now, uint32_t period, uint8_t n) {
+    if (out_count == 0) {
+      uint32_t w = period * (ticks_per_quarternote / out_ppqn) / 2;
+      gate_timer.pulse_from_isr(clk_out_idx, now, w < clk_out_width_micros ? w : clk_out_width_micros);
+    }
+    out_count = (out_count + n) % (ticks_per_quarternote / out_ppqn);
+  }
+
+  // realign analog clock divider & fire the reset out
+  void reset_out(uint32_t now) {
+    out_count = 0;
+    gate_timer.pulse_from_isr(rst_out_idx, now, clk_out_width_micros);
+  }
+
+  // external (MIDI) clock tick: analog clock out follows it
+  void ext_tick() {
+    noInterrupts();
+    clock_out(micros(), seqr.tick_micros, ticks_per_clock);
+    interrupts();
+  }
+
+  void ext_reset() {
+    noInterrupts();
+    reset_out(micros());
+    interrupts();
+  }
+
+  // line the clock outs up with a song position, ticks = engine ticks from the start
+  void seek(uint32_t ticks) {
+    noInterrupts();
+    clk_sub = ticks % ticks_per_clock;
+    out_count = ticks % (ticks_per_quarternote / out_ppqn);
+    interrupts();
+  }
+
+  // one master clock tick, called from the compare interrupt
+  void service(uint32_t now) {
+    if ((int32_t)(now - next_due) < 0) {
+      // long periods need more than one 16bit shot
+      clock_timer_arm(next_due - now);
+      return;
+    }
+    uint32_t late = now - next_due;
+    ticks = ticks + 1;
+    if (late > late_max) late_max = late;
+    if (late > clk_jitter_threshold) late_over = late_over + 1;
+
+    if (!seqr.extclk_micros) {
+      if (seqr.ticks_pending >= clk_backlog_max) {
+        dropped = dropped + 1;
+      } else {
+        if (seqr.ticks_pending > 0) overruns = overruns + 1;
+        seqr.ticks_pending = seqr.ticks_pending + 1;
+      }
+    }
+
+    bool playing = seqr.playing;
+    if (playing && !was_playing) {
+      if (!resuming) {
+        reset_out(now);
+        clk_sub = 0;  // play() restarts the step at tick 0 too
+      }
+      resuming = false;
+    }
+    was_playing = playing;
+
+    // straight clock, grooves are applied per track by the sequencer's scheduler
+    uint32_t period = seqr.tick_micros;
+
+    if (playing && !seqr.extclk_micros) {
+      if (clk_sub == 0 && clock_timer_serial && serial_midi && seqr.send_clock) Serial1.write((uint8_t)0xF8);
+      clk_sub = (clk_sub + 1) % ticks_per_clock;
+      clock_out(now, period, 1);
+    }
+
+    next_due = next_due + period;
+    if ((int32_t)(next_due - now) <= 0) next_due = now + period;  // way behind, don't burst
+    clock_timer_arm(next_due - now);
+  }
+
+  void report() {
+    Serial.print(F("Clock ticks: "));
+    Serial.print(ticks);
+    Serial.print(F(", late max us: "));
+    Serial.print(late_max);
+    Serial.print(F(", jittered: "));
+    Serial.print(late_over);
+    Serial.print(F(", overruns: "));
+    Serial.print(overruns);
+    Serial.print(F(", dropped: "));
+    Serial.println(dropped);
+  }
+};
+
+ClockTimer clock_timer;
+
+// Serial1 wrapper for the MIDI library: holds off the clock interrupt while a byte is queued,
+// so the interrupt's own clock bytes can't race the UART's TX ring buffer
+class ClockSafeSerial {
+public:
+  void begin(unsigned long baud) { Serial1.begin(baud); }
+  int available() { return Serial1.available(); }
+  int read() { return Serial1.read(); }
+  size_t write(uint8_t b) {
+    clock_timer_hold();
+    size_t n = Serial1.write(b);
+    clock_timer_release();
+    return n;
+  }
+};
+ClockSafeSerial clock_safe_serial1;
+
+#if defined(__SAMD51__)
+// TC4 @ GCLK1 (48MHz) / 16 = 3 counts per us, one-shot re-armed to each absolute deadline
+const uint32_t clock_timer_counts_per_us = 3;
+
+void clock_timer_begin() {
+  GCLK->PCHCTRL[TC4_GCLK_ID].reg = GCLK_PCHCTRL_GEN_GCLK1 | GCLK_PCHCTRL_CHEN;
+  while (!(GCLK->PCHCTRL[TC4_GCLK_ID].reg & GCLK_PCHCTRL_CHEN));
+  TC4->COUNT16.CTRLA.bit.ENABLE = 0;
+  while (TC4->COUNT16.SYNCBUSY.bit.ENABLE);
+  TC4->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_PRESCALER_DIV16 | TC_CTRLA_PRESCSYNC_PRESC;
+  TC4->COUNT16.WAVE.reg = TC_WAVE_WAVEGEN_MFRQ;
+  TC4->COUNT16.CTRLBSET.reg = TC_CTRLBSET_ONESHOT;
+  while (TC4->COUNT16.SYNCBUSY.bit.CTRLB);
+  TC4->COUNT16.INTENSET.reg = TC_INTENSET_MC0;
+  NVIC_SetPriority(TC4_IRQn, 0);
+  NVIC_EnableIRQ(TC4_IRQn);
+  TC4->COUNT16.CTRLA.bit.ENABLE = 1;
+  while (TC4->COUNT16.SYNCBUSY.bit.ENABLE);
+  clock_timer.begin(micros());
+}
+
+void clock_timer_arm(uint32_t delay_micros) {
+  uint32_t counts = delay_micros * clock_timer_counts_per_us;
+  TC4->COUNT16.CC[0].reg = counts > 0xFFFF ? 0xFFFF : (counts > 0 ? counts : 1);
+  while (TC4->COUNT16.SYNCBUSY.bit.CC0);
+  TC4->COUNT16.CTRLBSET.reg = TC_CTRLBSET_CMD_RETRIGGER;
+  while (TC4->COUNT16.SYNCBUSY.bit.CTRLB);
+}
+
+void clock_timer_hold() {
+  NVIC_DisableIRQ(TC4_IRQn);
+}
+
+void clock_timer_release() {
+  NVIC_EnableIRQ(TC4_IRQn);
+}
+
+void TC4_Handler() {
+  TC4->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+  clock_timer.service(micros());
+}
+
+void clock_timer_poll(uint32_t now_micros) {}
+#else
+// no hardware compare: poll the deadline (also the host mock)
+uint32_t clock_timer_due = 0;
+bool clock_timer_pending = false;
+
+void clock_timer_begin() {
+  clock_timer.begin(micros());
+}
+
+void clock_timer_arm(uint32_t delay_micros) {
+  clock_timer_due = micros() + delay_micros;
+  clock_timer_pending = true;
+}
+
+void clock_timer_hold() {}
+void clock_timer_release() {}
+
+void clock_timer_poll(uint32_t now_micros) {
+  if (clock_timer_pending && (int32_t)(now_micros - clock_timer_due) >= 0) {
+    clock_timer_pending = false;
+    clock_timer.service(now_micros);
+  }
+}
+#endif
+#endif
@@ -0,0 +1,267 @@
+/**
+ * editor.h -- Binary live-edit protocol over USB serial for Multitrack Sequencer (for Feather M4 Express)
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Lets a desktop editor read & write steps over the USB serial port while the grid is in use.
+ * Frames are E5 <len> <command> <len bytes> <sum>, sum making len .. last byte add up to 0
+ * (mod 256); anything else on the port (debug prints) just fails the sum and is skipped.
+ * Frames are parsed a few bytes per main loop pass into a small queue, and run straight after
+ * a tick, editor_per_tick at a time, so an edit never lands on top of one. A full queue answers
+ * busy rather than waiting. Writes to a track's current preset go straight into its working slot,
+ * where the journal (and undo) pick them up like a grid edit; other presets go via the store.
+ *
+ * Commands (p FF = the track's current preset), each answered with its command | 80:
+ *   01 p t l s v      set step s of layer l (see bank_layer)     -> 81 cmd status
+ *   02 p t l v[32]    write a whole track layer                  -> 81 cmd status
+ *   03 p t l          read a track layer                         -> 83 p t l v[32]
+ *   04                read state                                 -> 84 playing tempo*10(lo hi) track mutes presets[8] steps[8]
+ *   05 on             playhead: 85 steps[8] after each tick a step changed on (on = 1)
+ * status: 0 ok, 1 bad command, 2 preset store full, 3 busy
+ */
+#ifndef MULTI_SEQUENCER_EDITOR
+#define MULTI_SEQUENCER_EDITOR
+
+const uint8_t editor_sync = 0xE5;
+const uint8_t editor_payload_max = 3 + num_steps;
+const uint8_t editor_queue_size = 8;
+const uint8_t editor_per_tick = 4;
+const uint8_t editor_read_max = 64;       // bytes parsed per main loop pass
+const uint32_t editor_idle_millis = 20;   // no ticks (clock held): run the queue anyway
+const uint8_t editor_set_step = 0x01;
+const uint8_t editor_write_row = 0x02;
+const uint8_t editor_read_row = 0x03;
+const uint8_t editor_read_state = 0x04;
+const uint8_t editor_playhead = 0x05;
+const uint8_t editor_reply = 0x80;
+const uint8_t editor_ack = editor_reply | 0x01;
+const uint8_t editor_ok = 0;
+const uint8_t editor_bad = 1;
+const uint8_t editor_full = 2;
+const uint8_t editor_busy = 3;
+const uint8_t editor_current = 0xFF;
+
+typedef struct {
+  uint8_t cmd;
+  uint8_t len;
+  uint8_t d[editor_payload_max];
+} EditorFrame;
+
+EditorFrame editor_queue[editor_queue_size];
+uint8_t editor_head;   // next to run
+uint8_t editor_count;
+EditorFrame editor_rx;  // being parsed
+uint8_t editor_state;   // 0 sync, 1 len, 2 command, 3 payload, 4 sum
+uint8_t editor_pos;
+uint8_t editor_rx_sum;
+bool editor_subscribed;
+short int editor_sent_steps[numtracks];
+uint32_t editor_last_run;
+// stats
+uint32_t editor_frames;      // run
+uint32_t editor_bad_frames;  // failed the sum
+uint32_t editor_busy_count;  // answered busy
+uint32_t editor_drops;       // replies dropped, host not reading
+uint32_t editor_micros_max;  // longest command
+uint16_t editor_rate;        // commands this second
+uint16_t editor_rate_peak;   // most in one second
+uint32_t editor_rate_at;
+
+void editor_send(uint8_t cmd, const uint8_t* d, uint8_t n) {
+  uint8_t f[editor_payload_max + 4];
+  f[0] = editor_sync;
+  f[1] = n;
+  f[2] = cmd;
+  memcpy(f + 3, d, n);
+  uint8_t sum = 0;
+  for (uint8_t i = 1; i < n + 3; ++i) sum += f[i];
+  f[n + 3] = -sum;
+  if (Serial.availableForWrite() < n + 4) {  // never wait on the host
+    editor_drops++;
+    return;
+  }
+  Serial.write(f, n + 4);
+}
+
+void editor_status(uint8_t cmd, uint8_t status) {
+  uint8_t d[2] = { cmd, status };
+  editor_send(editor_ack, d, 2);
+}
+
+// frame checked: queue it, or busy
+void editor_queue_frame() {
+  editor_frames++;
+  if (editor_count == editor_queue_size) {
+    editor_busy_count++;
+    editor_status(editor_rx.cmd, editor_busy);
+    return;
+  }
+  editor_queue[(editor_head + editor_count) % editor_queue_size] = editor_rx;
+  editor_count++;
+}
+
+// main loop: parse what's arrived
+void editor_read() {
+  for (uint8_t i = 0; i < editor_read_max && Serial.available() > 0; ++i) {
+    uint8_t b = Serial.read();
+    switch (editor_state) {
+      case 0:
+        if (b == editor_sync) editor_state = 1;
+        break;
+      case 1:
+        editor_rx.len = b;
+        editor_rx_sum = b;
+        editor_pos = 0;
+        editor_state = b <= editor_payload_max ? 2 : 0;
+        break;
+      case 2:
+        editor_rx.cmd = b;
+        editor_rx_sum += b;
+        editor_state = editor_rx.len ? 3 : 4;
+        break;
+      case 3:
+        editor_rx.d[editor_pos++] = b;
+        editor_rx_sum += b;
+        if (editor_pos == editor_rx.len) editor_state = 4;
+        break;
+      default:
+        if ((uint8_t)(editor_rx_sum + b) == 0) {
+          editor_queue_frame();
+        } else {
+          editor_bad_frames++;
+        }
+        editor_state = 0;
+        break;
+    }
+  }
+}
+
+// n values from step first of layer l, preset p of track t
+uint8_t editor_write(uint8_t p, uint8_t t, uint8_t l, uint8_t first, const uint8_t* v, uint8_t n) {
+  if (t >= numtracks || l >= preset_layers || first + n > num_steps) return editor_bad;
+  if (p == editor_current) p = seqr.presets[t];
+  if (p >= numpresets) return editor_bad;
+  for (uint8_t s = 0; s < n; ++s) {
+    if (v[s] > layer_max[l]) return editor_bad;
+  }
+  if (p == seqr.presets[t]) {
+    memcpy(seqr.slot_layer(t, l) + first, v, n);  // the journal's next scan has it
+    for (uint8_t s = first; s < first + n; ++s) seqr.touch_step(t, s);
+    return editor_ok;
+  }
+  uint8_t row[num_steps];
+  uint8_t old[num_steps];
+  seqr.get_layer(p, t, l, old);
+  memcpy(row, old, num_steps);
+  memcpy(row + first, v, n);
+  if (!seqr.set_layer(p, t, l, row)) return editor_full;
+  for (uint8_t s = first; s < first + n; ++s) {
+    if (row[s] != old[s]) journal_edit(l, p, t, s, row[s]);
+  }
+  return editor_ok;
+}
+
+void editor_send_row(uint8_t p, uint8_t t, uint8_t l) {
+  if (p == editor_current && t < numtracks) p = seqr.presets[t];
+  if (t >= numtracks || l >= preset_layers || p >= numpresets) {
+    editor_status(editor_read_row, editor_bad);
+    return;
+  }
+  uint8_t d[3 + num_steps] = { p, t, l };
+  seqr.get_layer(p, t, l, d + 3);
+  editor_send(editor_reply | editor_read_row, d, sizeof(d));
+}
+
+void editor_send_state() {
+  uint8_t d[5 + 2 * numtracks];
+  uint16_t t10 = seqr.tempo() * 10 + 0.5f;
+  d[0] = seqr.playing;
+  d[1] = t10 & 0xFF;
+  d[2] = t10 >> 8;
+  d[3] = sel_track;
+  d[4] = 0;
+  for (uint8_t t = 0; t < numtracks; ++t) {
+    d[4] |= seqr.mutes[t] << t;
+    d[5 + t] = seqr.presets[t];
+    d[5 + numtracks + t] = seqr.laststeps[t];
+  }
+  editor_send(editor_reply | editor_read_state, d, sizeof(d));
+}
+
+void editor_send_playhead() {
+  bool moved = false;
+  uint8_t d[numtracks];
+  for (uint8_t t = 0; t < numtracks; ++t) {
+    moved |= seqr.laststeps[t] != editor_sent_steps[t];
+    editor_sent_steps[t] = seqr.laststeps[t];
+    d[t] = seqr.laststeps[t];
+  }
+  if (moved) editor_send(editor_reply | editor_playhead, d, sizeof(d));
+}
+
+void editor_run(const EditorFrame& f) {
+  const uint8_t* d = f.d;
+  switch (f.cmd) {
+    case editor_set_step:
+      editor_status(f.cmd, f.len == 5 ? editor_write(d[0], d[1], d[2], d[3], d + 4, 1) : editor_bad);
+      break;
+    case editor_write_row:
+      editor_status(f.cmd, f.len == 3 + num_steps ? editor_write(d[0], d[1], d[2], 0, d + 3, num_steps) : editor_bad);
+      break;
+    case editor_read_row:
+      if (f.len == 3) {
+        editor_send_row(d[0], d[1], d[2]);
+      } else {
+        editor_status(f.cmd, editor_bad);
+      }
+      break;
+    case editor_read_state:
+      editor_send_state();
+      break;
+    case editor_playhead:
+      editor_subscribed = f.len && d[0];
+      for (uint8_t t = 0; t < numtracks; ++t) editor_sent_steps[t] = -2;
+      editor_status(f.cmd, editor_ok);
+      break;
+    default:
+      editor_status(f.cmd, editor_bad);
+      break;
+  }
+}
+
+// main loop, straight after seqr.update(): run queued commands if a tick just went
+void editor_update(bool ticked) {
+  uint32_t now = millis();
+  if (!ticked && now - editor_last_run < editor_idle_millis) return;
+  editor_last_run = now;
+  if (now - editor_rate_at >= 1000) {
+    editor_rate_at = now;
+    editor_rate = 0;
+  }
+  for (uint8_t i = 0; i < editor_per_tick && editor_count; ++i) {
+    uint32_t start = micros();
+    editor_run(editor_queue[editor_head]);
+    editor_head = (editor_head + 1) % editor_queue_size;
+    editor_count--;
+    uint32_t took = micros() - start;
+    if (took > editor_micros_max) editor_micros_max = took;
+    if (++editor_rate > editor_rate_peak) editor_rate_peak = editor_rate;
+  }
+  if (editor_subscribed && ticked) editor_send_playhead();
+}
+
+void editor_report() {
+  Serial.print(F("Editor frames: "));
+  Serial.print(editor_frames);
+  Serial.print(F(", bad: "));
+  Serial.print(editor_bad_frames);
+  Serial.print(F(", busy: "));
+  Serial.print(editor_busy_count);
+  Serial.print(F(", replies dropped: "));
+  Serial.print(editor_drops);
+  Serial.print(F(", max us: "));
+  Serial.print(editor_micros_max);
+  Serial.print(F(", peak per second: "));
+  Serial.println(editor_rate_peak);
+}
+#endif
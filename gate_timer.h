@@ -0,0 +1,181 @@
+/**
+ * gate_timer.h -- Timer-compare Gate/Trigger scheduler for Multitrack Sequencer (for Feather M4 Express)
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Gate rising edges happen at step time; falling edges are parked here as absolute micros()
+ * deadlines and fired from a one-shot compare on TC3, so gate & trigger lengths no longer
+ * depend on how often update() gets called. On anything that isn't a SAMD51 the compare is
+ * emulated by polling (gate_timer_poll()), which doubles as a mock for host builds.
+ */
+#ifndef MULTI_SEQUENCER_GATES
+#define MULTI_SEQUENCER_GATES
+
+// valid trigger-pulse widths in ms (0 = plain gate, length from gate layer)
+const uint8_t trig_widths[] = { 0, 1, 5 };
+const uint8_t trig_widths_cnt = 3;
+
+void gate_timer_arm(uint32_t delay_micros);
+
+template<uint8_t outs = 1>
+class GateTimer {
+public:
+  byte pins[outs];
+  bool attached[outs];
+  volatile uint32_t off_at[outs];  // micros() deadline of the falling edge
+  volatile bool armed[outs];
+  // edge accuracy stats (lateness of falling edge vs. requested deadline)
+  volatile uint32_t edges;
+  volatile uint32_t late_max;
+  volatile uint32_t late_total;
+
+  GateTimer() {
+    for (uint8_t i = 0; i < outs; ++i) {
+      pins[i] = 0;
+      attached[i] = false;
+      off_at[i] = 0;
+      armed[i] = false;
+    }
+    clear_stats();
+  }
+
+  void attach(uint8_t idx, byte pin) {
+    if (idx >= outs) return;
+    pins[idx] = pin;
+    attached[idx] = true;
+  }
+
+  void clear_stats() {
+    edges = 0;
+    late_max = 0;
+    late_total = 0;
+  }
+
+  // raise gate on output idx now, drop it len_micros later
+  void pulse(uint8_t idx, uint32_t len_micros) {
+    noInterrupts();
+    pulse_from_isr(idx, micros(), len_micros);
+    interrupts();
+  }
+
+  // as pulse(), for use inside another timer interrupt (no nested interrupt toggling)
+  void pulse_from_isr(uint8_t idx, uint32_t now, uint32_t len_micros) {
+    if (idx >= outs || !attached[idx]) return;
+    digitalWrite(pins[idx], HIGH);
+    off_at[idx] = now + (len_micros > 0 ? len_micros : 1);
+    armed[idx] = true;
+    rearm(now);
+  }
+
+  // drop gate immediately & forget any pending edge for that pin
+  void release(uint8_t pin) {
+    noInterrupts();
+    for (uint8_t i = 0; i < outs; ++i) {
+      if (attached[i] && pins[i] == pin) armed[i] = false;
+    }
+    digitalWrite(pin, LOW);
+    interrupts();
+  }
+
+  // fire every due edge, then re-arm compare for the soonest remaining one
+  // (called from the TC3 compare interrupt, or polled when there's no hardware timer)
+  void service(uint32_t now) {
+    for (uint8_t i = 0; i < outs; ++i) {
+      if (armed[i] && (int32_t)(now - off_at[i]) >= 0) {
+        digitalWrite(pins[i], LOW);
+        armed[i] = false;
+        uint32_t late = now - off_at[i];
+        edges = edges + 1;
+        late_total = late_total + late;
+        if (late > late_max) late_max = late;
+      }
+    }
+    rearm(now);
+  }
+
+  void report() {
+    Serial.print(F("Gate edges: "));
+    Serial.print(edges);
+    Serial.print(F(", late max us: "));
+    Serial.print(late_max);
+    Serial.print(F(", late avg us: "));
+    Serial.println(edges ? late_total / edges : 0);
+  }
+
+private:
+  void rearm(uint32_t now) {
+    bool any = false;
+    uint32_t soonest = 0;
+    for (uint8_t i = 0; i < outs; ++i) {
+      if (armed[i]) {
+        int32_t d = (int32_t)(off_at[i] - now);
+        uint32_t wait = d > 0 ? d : 1;
+        if (!any || wait < soonest) {
+          soonest = wait;
+          any = true;
+        }
+      }
+    }
+    if (any) gate_timer_arm(soonest);
+  }
+};
+
+// one output per track gate, plus analog clock & reset outs (see clock_timer.h)
+GateTimer<numtracks + 2> gate_timer;
+
+#if defined(__SAMD51__)
+// TC3 @ GCLK1 (48MHz) / 16 = 3 counts per us, 16bit one-shot => max ~21.8ms per shot,
+// longer gates simply re-arm for the remainder when the compare fires
+const uint32_t gate_timer_counts_per_us = 3;
+
+void gate_timer_begin() {
+  GCLK->PCHCTRL[TC3_GCLK_ID].reg = GCLK_PCHCTRL_GEN_GCLK1 | GCLK_PCHCTRL_CHEN;
+  while (!(GCLK->PCHCTRL[TC3_GCLK_ID].reg & GCLK_PCHCTRL_CHEN));
+  TC3->COUNT16.CTRLA.bit.ENABLE = 0;
+  while (TC3->COUNT16.SYNCBUSY.bit.ENABLE);
+  TC3->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_PRESCALER_DIV16 | TC_CTRLA_PRESCSYNC_PRESC;
+  TC3->COUNT16.WAVE.reg = TC_WAVE_WAVEGEN_MFRQ;
+  TC3->COUNT16.CTRLBSET.reg = TC_CTRLBSET_ONESHOT;
+  while (TC3->COUNT16.SYNCBUSY.bit.CTRLB);
+  TC3->COUNT16.INTENSET.reg = TC_INTENSET_MC0;
+  NVIC_SetPriority(TC3_IRQn, 0);
+  NVIC_EnableIRQ(TC3_IRQn);
+  TC3->COUNT16.CTRLA.bit.ENABLE = 1;
+  while (TC3->COUNT16.SYNCBUSY.bit.ENABLE);
+}
+
+void gate_timer_arm(uint32_t delay_micros) {
+  uint32_t counts = delay_micros * gate_timer_counts_per_us;
+  TC3->COUNT16.CC[0].reg = counts > 0xFFFF ? 0xFFFF : counts;
+  while (TC3->COUNT16.SYNCBUSY.bit.CC0);
+  TC3->COUNT16.CTRLBSET.reg = TC_CTRLBSET_CMD_RETRIGGER;
+  while (TC3->COUNT16.SYNCBUSY.bit.CTRLB);
+}
+
+void TC3_Handler() {
+  TC3->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+  gate_timer.service(micros());
+}
+
+void gate_timer_poll(uint32_t now_micros) {}
+#else
+// no hardware compare: emulate it by polling against the armed deadline (also the host mock)
+uint32_t gate_timer_due = 0;
+bool gate_timer_pending = false;
+
+void gate_timer_begin() {}
+
+void gate_timer_arm(uint32_t delay_micros) {
+  gate_timer_due = micros() + delay_micros;
+  gate_timer_pending = true;
+}
+
+void gate_timer_poll(uint32_t now_micros) {
+  if (gate_timer_pending && (int32_t)(now_micros - gate_timer_due) >= 0) {
+    gate_timer_pending = false;
+    gate_timer.service(now_micros);
+  }
+}
+#endif
+
+#endif
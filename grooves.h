@@ -0,0 +1,55 @@
+/**
+ * grooves.h -- Groove templates for Multitrack Sequencer (for Feather M4 Express)
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Per-step timing offsets (percent of a track step, + late / - early) and velocity offsets,
+ * repeating every groove_len steps. Each track picks one; the offset is added to the step's
+ * microtiming when it is scheduled, so the master clock itself stays straight.
+ */
+#ifndef MULTI_SEQUENCER_GROOVES
+#define MULTI_SEQUENCER_GROOVES
+
+const uint8_t groove_len = 16;
+const uint8_t grooves_cnt = 8;
+
+typedef struct {
+  int8_t timing[groove_len];  // % of a step
+  int8_t vel[groove_len];     // added to step velocity (notes only, not CC values)
+} Groove;
+
+const Groove groove_templates[grooves_cnt] = {
+  // 0: straight
+  { { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+  // 1: swing 8% (54%)
+  { { 0, 8, 0, 8, 0, 8, 0, 8, 0, 8, 0, 8, 0, 8, 0, 8 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+  // 2: swing 16% (58%)
+  { { 0, 16, 0, 16, 0, 16, 0, 16, 0, 16, 0, 16, 0, 16, 0, 16 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+  // 3: swing 25% (62%)
+  { { 0, 25, 0, 25, 0, 25, 0, 25, 0, 25, 0, 25, 0, 25, 0, 25 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+  // 4: triplet shuffle (66%), softer offbeats
+  { { 0, 33, 0, 33, 0, 33, 0, 33, 0, 33, 0, 33, 0, 33, 0, 33 },
+    { 0, -12, 0, -12, 0, -12, 0, -12, 0, -12, 0, -12, 0, -12, 0, -12 } },
+  // 5: laid back, backbeat dragged
+  { { 0, 10, 0, 10, 6, 10, 0, 10, 0, 10, 0, 10, 6, 10, 0, 10 },
+    { 8, -8, 0, -8, 12, -8, 0, -8, 8, -8, 0, -8, 12, -8, 0, -8 } },
+  // 6: pushed, offbeats rushed
+  { { 0, -8, 0, -8, 0, -8, 0, -8, 0, -8, 0, -8, 0, -8, 0, -8 },
+    { 6, 0, -6, 0, 6, 0, -6, 0, 6, 0, -6, 0, 6, 0, -6, 0 } },
+  // 7: accent shuffle, downbeats up, swung & ghosted offbeats
+  { { 0, 20, 0, 20, 0, 20, 0, 20, 0, 20, 0, 20, 0, 20, 0, 20 },
+    { 16, -24, 0, -24, 10, -24, 0, -24, 16, -24, 0, -24, 10, -24, 0, -24 } },
+};
+
+// nearest template for the old global swing setting (0 - 30%), used when loading older settings
+uint8_t groove_from_swing(uint8_t swing) {
+  if (swing == 0) return 0;
+  if (swing < 12) return 1;
+  if (swing < 20) return 2;
+  return 3;
+}
+#endif
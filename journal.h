@@ -0,0 +1,306 @@
+/**
+ * journal.h -- Append-only edit journal for Multitrack Sequencer (for Feather M4 Express)
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Pattern edits are saved as they happen, as 4 byte records (layer, preset, track, step, value)
+ * appended to one file, rather than by rewriting every bank. The bank files are the checkpoint:
+ * at boot the journal is replayed over them. Once it passes journal_compact_at records, the banks
+ * it touched are rewritten one per main loop pass while stopped and the journal starts again. A
+ * full SAVE is a checkpoint too. Every file is replaced the same way, banks, settings & song alike:
+ * written aside, then renamed over the old one, between begin/done marks in the journal, so a
+ * power cut mid-way is recovered at boot and never loses the file.
+ *
+ * Edits are found by comparing each track's current preset against a shadow copy every
+ * journal_scan_millis, so nothing that edits a pattern has to know about the journal. The undo
+ * history (undo.h) is fed from the same scan.
+ */
+#ifndef MULTI_SEQUENCER_JOURNAL
+#define MULTI_SEQUENCER_JOURNAL
+
+const uint8_t journal_layers = preset_layers;  // layers by bank_layer, see preset_store.h
+const uint16_t journal_compact_at = 1024;      // records (4KB)
+const uint32_t journal_scan_millis = 5;
+const uint32_t journal_sync_millis = 1000;     // while running, flash syncs stall the main loop
+const char *const *const layer_files[journal_layers] = { pfiles, nfiles, vfiles, prbfiles, gfiles, nudgefiles, chordfiles };
+const uint8_t journal_settings = journal_layers;  // begin/done mark files after the banks
+const uint8_t journal_song = journal_layers + 1;
+
+typedef size_t (*FileWriter)(uint8_t id, uint8_t p, const char* path);  // bytes written, 0 = failed
+
+TrackPreset<num_steps> journal_shadow[numtracks];  // each track's current preset, as last journaled
+uint8_t journal_shadow_preset[numtracks];
+uint16_t journal_dirty[journal_layers];  // banks (bit per preset) with journaled edits not yet compacted
+File32 journal;
+uint32_t journal_last_scan;
+uint32_t journal_last_sync;
+bool journal_unsynced;
+bool compact_failed;  // flash trouble: stop trying until next boot, the journal still holds the edits
+// stats
+uint32_t journal_records;  // in the journal now
+uint32_t journal_bytes;    // appended since boot
+uint32_t compactions;      // banks rewritten by compaction
+uint32_t compact_bytes;    // ...bytes they took
+uint32_t bank_writes;      // by SAVE
+uint32_t bank_skips;       // ...left alone, flash already had them
+uint32_t save_millis;      // last SAVE took
+uint32_t bank_hashes[journal_layers][numpresets];  // content of each bank file on flash, 0 = unknown
+
+void undo_record(uint8_t layer, uint8_t p, uint8_t t, uint8_t s, uint8_t old, uint8_t v);  // undo.h
+void undo_close();  // undo.h
+
+// record: layer << 4 | preset, track << 5 | step, value, check
+void journal_pack(uint8_t* r, uint8_t layer, uint8_t p, uint8_t t, uint8_t s, uint8_t v) {
+  r[0] = layer << 4 | (p & 0x0F);
+  r[1] = t << 5 | (s & 0x1F);
+  r[2] = v;
+  r[3] = r[0] ^ r[1] ^ r[2] ^ 0x5A;
+}
+
+bool journal_valid(const uint8_t* r) {
+  return r[3] == (r[0] ^ r[1] ^ r[2] ^ 0x5A);
+}
+
+void journal_append(uint8_t layer, uint8_t p, uint8_t t, uint8_t s, uint8_t v) {
+  if (!journal) return;
+  uint8_t r[4];
+  journal_pack(r, layer, p, t, s, v);
+  if (journal.write(r, 4) != 4) return;
+  journal_records++;
+  journal_bytes += 4;
+  journal_unsynced = true;
+  if (layer < journal_layers) journal_dirty[layer] |= 1 << p;
+}
+
+// an edit the scan won't see (undo, SysEx restore): journal it, and keep the shadow in step
+void journal_edit(uint8_t layer, uint8_t p, uint8_t t, uint8_t s, uint8_t v) {
+  if (journal_shadow_preset[t] == p) journal_shadow[t].layer[layer][s] = v;
+  journal_append(layer, p, t, s, v);
+}
+
+void journal_sync() {
+  if (!journal_unsynced) return;
+  journal.sync();
+  journal_unsynced = false;
+  journal_last_sync = millis();
+}
+
+// shadow = track's current preset, without journaling it
+void journal_shadow_track(uint8_t t) {
+  journal_shadow_preset[t] = seqr.presets[t];
+  seqr.get_preset(seqr.presets[t], t, journal_shadow[t]);
+}
+
+// journal (and keep for undo) whatever differs between the shadow & preset p of track t
+void journal_diff(uint8_t t, uint8_t p) {
+  TrackPreset<num_steps> now;
+  seqr.get_preset(p, t, now);
+  for (uint8_t l = 0; l < journal_layers; ++l) {
+    for (uint8_t s = 0; s < num_steps; ++s) {
+      uint8_t v = now.layer[l][s];
+      if (v == journal_shadow[t].layer[l][s]) continue;
+      undo_record(l, p, t, s, journal_shadow[t].layer[l][s], v);
+      journal_shadow[t].layer[l][s] = v;
+      journal_append(l, p, t, s, v);
+    }
+  }
+}
+
+// file a begin/done mark is about: bank layer id of preset p, the settings or the song
+const char* journal_path(uint8_t id, uint8_t p) {
+  if (id < journal_layers) return layer_files[id][p];
+  return id == journal_settings ? settings_file : song_file;
+}
+
+char* journal_tmp_path(char* buf, size_t len, uint8_t id, uint8_t p) {
+  snprintf(buf, len, "%s.tmp", journal_path(id, p));
+  return buf;
+}
+
+// before any file is read: finish (or undo) a replace a power cut interrupted
+void journal_recover() {
+  File32 file = fatfs.open(journal_file, FILE_READ);
+  if (!file) return;
+  int8_t layer = -1;
+  uint8_t p = 0;
+  uint8_t r[4];
+  while (file.read(r, 4) == 4 && journal_valid(r)) {
+    if (r[0] >> 4 != MARK_LAYER) continue;
+    layer = r[2] == 0 ? (r[1] & 0x1F) : -1;  // begin / done
+    p = r[0] & 0x0F;
+  }
+  file.close();
+  if (layer < 0 || layer > journal_song) return;
+  char tmp[48];
+  journal_tmp_path(tmp, sizeof(tmp), layer, p);
+  if (!fatfs.exists(journal_path(layer, p)) && fatfs.exists(tmp)) {
+    if (marci_debug) Serial.println(F("journal: finishing interrupted save"));
+    fatfs.rename(tmp, journal_path(layer, p));
+  } else {
+    fatfs.remove(tmp);
+  }
+}
+
+// after the banks are read: replay the journal over them, then carry on appending to it
+void journal_begin() {
+  journal = fatfs.open(journal_file, FILE_WRITE);
+  if (!journal) {
+    if (marci_debug) Serial.println(F("journal_begin: Failed to open journal"));
+    return;
+  }
+  journal.seek(0);
+  uint32_t valid = 0;
+  uint8_t r[4];
+  TrackPreset<num_steps> tp;
+  while (journal.read(r, 4) == 4 && journal_valid(r)) {
+    valid += 4;
+    uint8_t layer = r[0] >> 4;
+    uint8_t p = r[0] & 0x0F;
+    uint8_t t = r[1] >> 5;
+    uint8_t s = r[1] & 0x1F;
+    if (layer >= journal_layers || p >= numpresets || t >= numtracks || s >= num_steps) continue;
+    seqr.get_preset(p, t, tp);
+    tp.layer[layer][s] = layer == SEQ_LAYER ? r[2] != 0 : r[2];
+    if (!seqr.put_preset(p, t, tp) && marci_debug) Serial.println(F("journal_begin: preset store full"));
+    journal_dirty[layer] |= 1 << p;
+  }
+  journal.truncate(valid);  // drop a record torn by a power cut, so appends stay readable
+  journal.seek(valid);
+  journal_records = valid / 4;
+  if (marci_debug) {
+    Serial.print(F("journal: replayed records: "));
+    Serial.println(journal_records);
+  }
+  for (uint8_t t = 0; t < numtracks; ++t) journal_shadow_track(t);
+}
+
+// everything is in the bank files (full SAVE / compaction done): start an empty journal
+void journal_clear() {
+  if (journal) journal.close();
+  fatfs.remove(journal_file);
+  journal = fatfs.open(journal_file, FILE_WRITE);
+  journal_records = 0;
+  journal_unsynced = false;
+  for (uint8_t l = 0; l < journal_layers; ++l) journal_dirty[l] = 0;
+  for (uint8_t t = 0; t < numtracks; ++t) journal_shadow_track(t);
+}
+
+// one bank file as JSON (see json_stream.h), returns bytes written (0 = failed)
+size_t bank_write(uint8_t layer, uint8_t p, const char* path) {
+  uint8_t bank[numtracks][num_steps];
+  for (uint8_t t = 0; t < numtracks; ++t) seqr.get_layer(p, t, layer, bank[t]);
+  File32 file = fatfs.open(path, FILE_WRITE);
+  if (!file) return 0;
+  size_t n;
+  if (layer == SEQ_LAYER) {
+    n = json_write_rows(file, (const bool*)&bank[0][0], numtracks, num_steps);
+  } else if (layer == NUDGE_LAYER) {
+    n = json_write_rows(file, (const int8_t*)&bank[0][0], numtracks, num_steps);
+  } else {
+    n = json_write_rows(file, &bank[0][0], numtracks, num_steps);
+  }
+  file.close();
+  return n;
+}
+
+uint32_t bank_hash(uint8_t layer, uint8_t p) {
+  uint8_t row[num_steps];
+  uint32_t h = content_hash(&layer, 1);
+  for (uint8_t t = 0; t < numtracks; ++t) {
+    seqr.get_layer(p, t, layer, row);
+    h = content_hash(row, num_steps, h);
+  }
+  return h ? h : 1;
+}
+
+// write file id (see journal_path()) aside with write(), then swap it in, between begin/done
+// marks (see journal_recover()). Returns bytes written, 0 = failed & the old file left alone
+size_t journal_replace(uint8_t id, uint8_t p, FileWriter write) {
+  char tmp[48];
+  journal_tmp_path(tmp, sizeof(tmp), id, p);
+  journal_append(MARK_LAYER, p, 0, id, 0);
+  journal_sync();
+  fatfs.remove(tmp);
+  size_t n = write(id, p, tmp);
+  if (n == 0) {
+    fatfs.remove(tmp);
+    return 0;
+  }
+  fatfs.remove(journal_path(id, p));
+  fatfs.rename(tmp, journal_path(id, p));
+  journal_append(MARK_LAYER, p, 0, id, 1);
+  journal_sync();
+  return n;
+}
+
+// SAVE: write layer l of preset p, unless flash already holds exactly that
+bool bank_save(uint8_t layer, uint8_t p) {
+  uint32_t h = bank_hash(layer, p);
+  if (h == bank_hashes[layer][p] && fatfs.exists(layer_files[layer][p])) {
+    bank_skips++;
+    return true;
+  }
+  if (journal_replace(layer, p, bank_write) == 0) return false;
+  bank_hashes[layer][p] = h;
+  bank_writes++;
+  return true;
+}
+
+// rewrite one bank the journal has edits for
+bool compact_bank(uint8_t layer, uint8_t p) {
+  size_t n = journal_replace(layer, p, bank_write);
+  if (n == 0) {
+    if (marci_debug) Serial.println(F("compact_bank: Failed to write bank"));
+    compact_failed = true;
+    return false;
+  }
+  bank_hashes[layer][p] = bank_hash(layer, p);
+  journal_dirty[layer] &= ~(1 << p);
+  compactions++;
+  compact_bytes += n;
+  return true;
+}
+
+// journal every edit since the last scan, as one undo group
+void journal_scan() {
+  for (uint8_t t = 0; t < numtracks; ++t) {
+    // a preset change: edits made just before it went to the old preset
+    journal_diff(t, journal_shadow_preset[t]);
+    if (journal_shadow_preset[t] != seqr.presets[t]) journal_shadow_track(t);
+  }
+  undo_close();
+}
+
+// main loop: journal new edits, sync them, compact a bank if it's time
+void journal_update() {
+  uint32_t now = millis();
+  if (now - journal_last_scan < journal_scan_millis) return;
+  journal_last_scan = now;
+  journal_scan();
+  if (journal_unsynced && (!seqr.playing || now - journal_last_sync >= journal_sync_millis)) journal_sync();
+  if (seqr.playing || compact_failed || journal_records < journal_compact_at) return;
+  for (uint8_t l = 0; l < journal_layers; ++l) {
+    if (journal_dirty[l] == 0) continue;
+    compact_bank(l, __builtin_ctz(journal_dirty[l]));
+    return;
+  }
+  journal_clear();  // every bank it touched is rewritten
+}
+
+void journal_report() {
+  Serial.print(F("Journal records: "));
+  Serial.print(journal_records);
+  Serial.print(F(", bytes appended: "));
+  Serial.print(journal_bytes);
+  Serial.print(F(", compactions: "));
+  Serial.print(compactions);
+  Serial.print(F(", compacted bytes: "));
+  Serial.println(compact_bytes);
+  Serial.print(F("Banks saved: "));
+  Serial.print(bank_writes);
+  Serial.print(F(", unchanged: "));
+  Serial.print(bank_skips);
+  Serial.print(F(", last save ms: "));
+  Serial.println(save_millis);
+}
+#endif
@@ -0,0 +1,185 @@
+/**
+ * json_stream.h -- Streaming JSON reader / writer for Multitrack Sequencer (for Feather M4 Express)
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Every file we save is an array of arrays of numbers (banks, song) or one array of them
+ * (settings). Rather than building a document on the heap and copying out of it, JsonStream reads
+ * the file a small buffer at a time and writes each value straight into the destination array as
+ * it's parsed, so loading takes the same few bytes of stack however big the file is. Anything that
+ * isn't that shape, has more rows / values than the destination holds, or a value out of range is
+ * rejected, and the caller falls back to its ROM default. Saving prints the arrays straight to
+ * the file the same way, so nothing is allocated on the heap either side.
+ */
+#ifndef MULTI_SEQUENCER_JSON_STREAM
+#define MULTI_SEQUENCER_JSON_STREAM
+
+const uint8_t json_buf_size = 64;
+// stats
+uint32_t json_files;    // parsed OK since boot
+uint32_t json_rejects;  // malformed / oversized
+uint32_t json_bytes;
+uint32_t json_micros;   // spent parsing (incl. flash reads)
+
+class JsonStream {
+  public:
+    File32& file;
+    uint8_t buf[json_buf_size];
+    uint8_t len;
+    uint8_t pos;
+    uint32_t bytes;
+
+  JsonStream(File32& f) : file(f) {
+    len = 0;
+    pos = 0;
+    bytes = 0;
+  }
+
+  int peek() {
+    if (pos == len) {
+      int n = file.read(buf, json_buf_size);
+      len = n > 0 ? n : 0;
+      pos = 0;
+      if (len == 0) return -1;
+    }
+    return buf[pos];
+  }
+
+  int next() {
+    int c = peek();
+    if (c >= 0) {
+      pos++;
+      bytes++;
+    }
+    return c;
+  }
+
+  int skip_space() {
+    int c = peek();
+    while (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+      next();
+      c = peek();
+    }
+    return c;
+  }
+
+  // consume c (after any whitespace) if it's next
+  bool accept(char c) {
+    if (skip_space() != c) return false;
+    next();
+    return true;
+  }
+
+  bool word(const char* w) {
+    for (; *w; ++w) {
+      if (next() != *w) return false;
+    }
+    return true;
+  }
+
+  // integer, true / false (1 / 0) or null (0). Fractions are dropped, exponents aren't ours
+  bool value(int32_t& v) {
+    int c = skip_space();
+    if (c == 't') { v = 1; return word("true"); }
+    if (c == 'f') { v = 0; return word("false"); }
+    if (c == 'n') { v = 0; return word("null"); }
+    bool neg = c == '-';
+    if (neg) c = (next(), peek());
+    if (c < '0' || c > '9') return false;
+    int32_t n = 0;
+    while (c >= '0' && c <= '9') {
+      n = n * 10 + (c - '0');
+      if (n > 0xFFFF) return false;
+      next();
+      c = peek();
+    }
+    if (c == '.') {
+      next();
+      while ((c = peek()) >= '0' && c <= '9') next();
+    }
+    v = neg ? -n : n;
+    return true;
+  }
+
+  // [[v, v, ...], [...], ...] into out[rows][cols]. Missing values / rows are 0 and row r held
+  // lens[r] values (if lens given). false = malformed, too many rows / values, or one outside lo - hi
+  template<typename T>
+  bool rows(T* out, uint8_t max_rows, uint8_t cols, int32_t lo, int32_t hi, uint8_t* lens = nullptr) {
+    uint8_t r = 0;
+    if (!accept('[')) return false;
+    if (!accept(']')) {
+      do {
+        if (r == max_rows || !accept('[')) return false;
+        uint8_t n = 0;
+        if (!accept(']')) {
+          do {
+            int32_t v;
+            if (n == cols || !value(v) || v < lo || v > hi) return false;
+            out[r * cols + n++] = v;
+          } while (accept(','));
+          if (!accept(']')) return false;
+        }
+        for (uint8_t k = n; k < cols; ++k) out[r * cols + k] = 0;
+        if (lens) lens[r] = n;
+        r++;
+      } while (accept(','));
+      if (!accept(']')) return false;
+    }
+    for (; r < max_rows; ++r) {
+      for (uint8_t k = 0; k < cols; ++k) out[r * cols + k] = 0;
+      if (lens) lens[r] = 0;
+    }
+    return true;
+  }
+};
+
+// parse a whole file with rows(), keeping the stats
+template<typename T>
+bool json_read_rows(File32& file, T* out, uint8_t max_rows, uint8_t cols, int32_t lo, int32_t hi, uint8_t* lens = nullptr) {
+  uint32_t start = micros();
+  JsonStream json(file);
+  bool ok = json.rows(out, max_rows, cols, lo, hi, lens);
+  json_micros += micros() - start;
+  json_bytes += json.bytes;
+  if (ok) json_files++; else json_rejects++;
+  return ok;
+}
+
+size_t json_print(Print& out, bool v) {
+  return out.print(v ? F("true") : F("false"));
+}
+
+template<typename T>
+size_t json_print(Print& out, T v) {
+  return out.print((int32_t)v);
+}
+
+// in[rows][cols] as [[v, v, ...], [...], ...] (no spaces, as ArduinoJson wrote it), returns bytes
+template<typename T>
+size_t json_write_rows(Print& out, const T* in, uint8_t rows, uint8_t cols) {
+  size_t n = out.write('[');
+  for (uint8_t r = 0; r < rows; ++r) {
+    if (r) n += out.write(',');
+    n += out.write('[');
+    for (uint8_t k = 0; k < cols; ++k) {
+      if (k) n += out.write(',');
+      n += json_print(out, in[r * cols + k]);
+    }
+    n += out.write(']');
+  }
+  return n + out.write(']');
+}
+
+void json_report() {
+  Serial.print(F("JSON files read: "));
+  Serial.print(json_files);
+  Serial.print(F(", rejected: "));
+  Serial.print(json_rejects);
+  Serial.print(F(", bytes: "));
+  Serial.print(json_bytes);
+  Serial.print(F(", micros: "));
+  Serial.print(json_micros);
+  Serial.print(F(", parser stack: "));
+  Serial.println(sizeof(JsonStream));
+}
+#endif
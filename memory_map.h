@@ -0,0 +1,105 @@
+/**
+ * memory_map.h -- RAM budgets & memory map for Multitrack Sequencer (for Feather M4 Express)
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Everything the sequencer uses at runtime is a static array or pool sized at compile time, and
+ * each subsystem is held to a RAM budget here, so a bigger build (more presets / steps / arps)
+ * fails to compile rather than running short on a gig. The heap is only touched by libraries while
+ * booting. At boot the free RAM between heap & stack is painted, so memory_report() can show how
+ * deep the stack has ever been, and whether the heap has grown since boot (it shouldn't).
+ */
+#ifndef MULTI_SEQUENCER_MEMORY_MAP
+#define MULTI_SEQUENCER_MEMORY_MAP
+
+const uint32_t ram_size = 192 * 1024;     // SAMD51J19
+const uint32_t ram_reserve = 48 * 1024;   // stack, libraries' statics (USB, flash cache, pixels) & boot heap
+
+// budgets
+const uint32_t ram_budget_sequencer = numtracks * num_steps * preset_layers  // working slots
+                                    + numpresets * numtracks * preset_layers * (num_steps / 2 + sizeof(StoreBlock) / 2 + 4)  // preset store & its snapshot table
+                                    + 2 * numtracks * num_steps * sizeof(StepEvent)  // event banks
+                                    + 4096;  // per-track state, note maps, arps
+const uint32_t ram_budget_arps = 128;
+const uint32_t ram_budget_journal = numtracks * journal_layers * num_steps + 256;
+const uint32_t ram_budget_song = 256;
+const uint32_t ram_budget_timers = 512;  // gate & clock timers, clock in
+const uint32_t ram_budget_editor = 512;  // command queue
+const uint32_t ram_budget_undo = undo_size * sizeof(UndoDelta) + settings_fields * sizeof(int16_t) + 256;  // + a held reset's settings & song
+
+static_assert(sizeof(seqr) <= ram_budget_sequencer, "sequencer is over its RAM budget");
+static_assert(sizeof(arp_pool) <= ram_budget_arps, "arp note pool is over its RAM budget");
+static_assert(sizeof(journal_shadow) + sizeof(journal_shadow_preset) + sizeof(journal_dirty) <= ram_budget_journal,
+              "journal is over its RAM budget");
+static_assert(sizeof(song) <= ram_budget_song, "song is over its RAM budget");
+static_assert(sizeof(gate_timer) + sizeof(clock_timer) + sizeof(clock_in) <= ram_budget_timers,
+              "timers are over their RAM budget");
+static_assert(sizeof(undo_ring) + sizeof(reset_settings) + sizeof(reset_song) <= ram_budget_undo, "undo history is over its RAM budget");
+static_assert(sizeof(editor_queue) + sizeof(editor_rx) <= ram_budget_editor, "editor command queue is over its RAM budget");
+static_assert(ram_budget_sequencer + ram_budget_arps + ram_budget_journal + ram_budget_song + ram_budget_timers + ram_budget_undo + ram_budget_editor + ram_reserve <= ram_size,
+              "RAM budgets add up to more than the M4 has");
+
+const uint8_t stack_paint = 0xA5;
+uint32_t heap_at_boot;
+
+#ifdef __arm__
+extern "C" char* sbrk(int incr);
+extern "C" char __StackTop;  // linker script: top of RAM
+#endif
+
+// first thing in setup(): fill the free RAM between heap & stack
+void memory_paint() {
+#ifdef __arm__
+  noInterrupts();  // an interrupt's stack frame would land in what's being painted
+  char here;
+  for (char* p = sbrk(0); p < &here - 256; ++p) *p = stack_paint;
+  interrupts();
+#endif
+}
+
+// deepest the stack has been since memory_paint()
+uint32_t stack_peak() {
+#ifdef __arm__
+  char* p = sbrk(0);
+  while (p < &__StackTop && *p == stack_paint) ++p;
+  return &__StackTop - p;
+#else
+  return 0;
+#endif
+}
+
+uint32_t heap_top() {
+#ifdef __arm__
+  return (uint32_t)sbrk(0);
+#else
+  return 0;
+#endif
+}
+
+void memory_report_line(const __FlashStringHelper* name, uint32_t used, uint32_t budget) {
+  Serial.print(F("RAM "));
+  Serial.print(name);
+  Serial.print(F(": "));
+  Serial.print(used);
+  Serial.print(F("/"));
+  Serial.println(budget);
+}
+
+void memory_report() {
+  memory_report_line(F("sequencer"), sizeof(seqr), ram_budget_sequencer);
+  memory_report_line(F("arp pool"), sizeof(arp_pool), ram_budget_arps);
+  memory_report_line(F("journal"), sizeof(journal_shadow) + sizeof(journal_shadow_preset) + sizeof(journal_dirty), ram_budget_journal);
+  memory_report_line(F("song"), sizeof(song), ram_budget_song);
+  memory_report_line(F("timers"), sizeof(gate_timer) + sizeof(clock_timer) + sizeof(clock_in), ram_budget_timers);
+  memory_report_line(F("editor"), sizeof(editor_queue) + sizeof(editor_rx), ram_budget_editor);
+  memory_report_line(F("undo"), sizeof(undo_ring) + sizeof(reset_settings) + sizeof(reset_song), ram_budget_undo);
+  Serial.print(F("Arp notes peak: "));
+  Serial.print(arp_pool.peak);
+  Serial.print(F(", stack peak: "));
+  Serial.print(stack_peak());
+  Serial.print(F(", heap grown since boot: "));
+  Serial.print(heap_top() - heap_at_boot);
+  Serial.print(F(", free: "));
+  Serial.println(freeMemory());
+}
+#endif
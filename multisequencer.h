@@ -25,18 +25,34 @@ typedef enum {
   CLOCK,
 } clock_type_t;
 
+// step sizes in MIDI clocks (as saved in settings), engine ticks per step are ticks_per_clock times this
 typedef enum {
   QUARTER_NOTE = 24,
   EIGHTH_NOTE = 12,
   SIXTEENTH_NOTE = 6,
 } valid_ticks_per_step;
 
-const int ticks_per_quarternote = 24;  
+const int midi_ppqn = 24;               // MIDI clock in & out
+const int ticks_per_quarternote = 96;   // internal resolution, microtiming & external clock interpolation
+const int ticks_per_clock = ticks_per_quarternote / midi_ppqn;
 const int midi_clock_divider = 1; 
 const int steps_per_beat_default = 6; 
 const int valid_step_sizes[] = { QUARTER_NOTE, EIGHTH_NOTE, SIXTEENTH_NOTE };
 const int valid_step_sizes_cnt = 3;
-const uint8_t numarps = numtracks / 2;
+const uint8_t numarps = numtracks;     // every track can arpeggiate
+
+// one step of a track, compiled from its layers by MultiStepSequencer::compile()
+typedef struct {
+  int32_t offset;     // microtiming (nudge + groove), in 1/(muls+1) ticks
+  uint16_t gate_len;  // gate length in 1/16 ticks
+  uint16_t cv;        // DAC code, 0 = none
+  uint8_t note;       // MIDI note (CC number in CC mode), transposed
+  uint8_t vel;        // velocity with groove accent (CC value in CC mode)
+  uint8_t gate;       // raw gate layer value, passed on to on_func
+  uint8_t prob;       // 10 = always
+  uint8_t shape;      // CHORD mode: index into chord_shapes
+  bool on;
+} StepEvent;
 
 typedef void (*TriggerFunc)(uint8_t note, uint8_t vel, uint8_t gate, bool on, uint8_t chan);
 typedef void (*CCFunc)(uint8_t cc, uint8_t val, bool on, uint8_t chan);
@@ -46,61 +62,108 @@ typedef void (*DispFunc)();
 typedef void (*ResetFunc)();
 typedef void (*GateFunc)(uint8_t pin, uint8_t direction);
 typedef void (*CVFunc)(uint8_t pin, uint16_t val);
+typedef void (*PulseFunc)(uint8_t track, uint32_t len_micros);
+typedef void (*PollFunc)(uint32_t now_micros);
 
 // stubs for when Sequencer object is only partially initialized
 void fake_updatedisplay_callback() {}
 void fake_resetdisplay_callback() {}
-void fake_clock_callback(clock_type_t type) {}
-void fake_note_callback(uint8_t note, uint8_t vel, uint8_t gate, bool on, uint8_t chan) {}
-void fake_cc_callback(uint8_t cc, uint8_t val, bool on, uint8_t chan) {}
-void fake_pos_callback(int pos) {}
-void fake_gate_callback(uint8_t pin, uint8_t direction) {}
-void fake_cv_callback(uint8_t pin, uint16_t val) {}
+void fake_clock_callback(clock_type_t) {}
+void fake_note_callback(uint8_t, uint8_t, uint8_t, bool, uint8_t) {}
+void fake_cc_callback(uint8_t, uint8_t, bool, uint8_t) {}
+void fake_pos_callback(int) {}
+void fake_gate_callback(uint8_t, uint8_t) {}
+void fake_cv_callback(uint8_t, uint16_t) {}
+void fake_pulse_callback(uint8_t, uint32_t) {}
+void fake_poll_callback(uint32_t) {}
 
 #include "arp.h"
+#include "grooves.h"
+#include "chords.h"
+#include "active_notes.h"
+#include "scales.h"
+#include "preset_store.h"
 byte arp_patterns[numarps];
 byte arp_octaves[numarps];
-Arp<10> arps[numarps]; 
+Arp<arp_capacity> arps[numarps];
 
 template<uint8_t tracks = 1, uint8_t _presets = 1, uint8_t _steps = 1, uint8_t _dacs = 1, uint8_t _arps = 1>
 class MultiStepSequencer {
 public:
-  uint32_t tick_micros;       // "micros_per_tick", microsecs per clock (6 clocks / step; 4 steps / quarternote)
+  uint32_t tick_micros;       // "micros_per_tick", microsecs per engine tick (24 ticks / 16th step; 4 steps / quarternote)
   uint32_t last_tick_micros;  // only change in update()
   uint32_t extclk_micros;     // 0 = internal clock, non-zero = external clock
+  volatile uint8_t ticks_pending;  // ticks handed over by the clock timer (or external clock), not yet processed
+  uint8_t ext_owed;           // interpolated ticks still to come from the last external clock
+  uint32_t ext_next;          // when the next of those is due
+  bool timer_clocked;         // true = ticks come from clock timer, false = polled in update()
   uint32_t held_gate_millis[tracks];
   uint32_t held_gate_notes[tracks];
   uint32_t held_gate_chans[tracks];
   short int multistepi[tracks];
   int outcomes[tracks];
+  uint32_t track_steps[tracks];  // steps each track has fired since reset, numbering its probability rolls
+  uint32_t prob_seed;            // ...& random arps, drawn from random() at each reset
   int lengths[tracks];
   int offsets[tracks];
-  int ticks_per_step;  // expected values: 6 = 1/16th, 12 = 1/8, 24 = 1/4,
-  short int ticki;           // which midi clock we're on
+  int ticks_per_step;  // expected values: 24 = 1/16th, 48 = 1/8, 96 = 1/4,
+  short int ticki;           // which tick of the step we're on
   short int stepi;           // which sequencer step we're on
   int seqno;
   int length;
   int transpose;
-  short int divcounts[tracks];
-  uint8_t divs[tracks];
-  uint8_t gates[_presets][tracks][_steps];
-  uint8_t notes[_presets][tracks][_steps];
+  int32_t to_grid[tracks];    // phase: distance to the grid position of each track's next step, in 1/(muls+1) ticks
+  uint8_t next_steps[tracks];
+  uint8_t divs[tracks];       // track rate = (muls + 1) / (divs + 1) master steps
+  uint8_t muls[tracks];
+  uint8_t grooves[tracks];    // groove template per track, see grooves.h
+  uint8_t scales[tracks];     // quantiser scale per track, see scales.h (0 = chromatic)
+  uint8_t roots[tracks];      // ...its root, 0 = C
+  int8_t degrees[tracks];     // ...& transpose in scale degrees
+  uint8_t note_maps[tracks][128];  // each track's notes through its scale, see set_scale()
+  StepEvent event_banks[2][tracks][_steps];  // front & back compiled presets of each track
+  StepEvent* events[tracks];  // each track's current preset, compiled (its front bank)
+  bool compiled[tracks];
+  int8_t queued[tracks];      // preset compiled into the back bank, swapped in at loop start, -1 = none
+  uint16_t queued_at[tracks]; // ...once loops has reached this
+  bool prepared[tracks];
+  uint16_t loops;             // master loops, counted from each loop's last step
+  typedef void (MultiStepSequencer::*StepHandler)(uint8_t i, const StepEvent& ev, uint32_t now_micros, uint32_t gate_micros);
+  typedef void (MultiStepSequencer::*OffHandler)(uint8_t i);
+  StepHandler step_handlers[tracks];  // per-track mode dispatch, see bind()
+  OffHandler off_handlers[tracks];
+  VoicePool<> voices;         // notes sounding from CHORD tracks
+  // step timing stats
+  uint32_t fires;
+  uint32_t fire_micros_total;
+  uint32_t fire_micros_max;
+  uint32_t rebuilds;
+  uint32_t step_rebuilds;
+  uint32_t swaps;
+  uint32_t seeks;
+  // each track's current preset (its working slot, edited in place), the rest are in store
+  uint8_t gates[tracks][_steps];
+  uint8_t notes[tracks][_steps];
   uint8_t presets[_presets];
-  uint8_t probs[_presets][tracks][_steps];
-  uint8_t vels[_presets][tracks][_steps];
+  uint8_t probs[tracks][_steps];
+  uint8_t vels[tracks][_steps];
+  int8_t nudges[tracks][_steps];  // per-step microtiming in ticks, - early / + late
+  uint8_t chords[tracks][_steps];  // per-step chord shape (CHORD mode), see chords.h
+  // every other track / preset, encoded & shared. Half the raw size: real patterns take a
+  // fraction of that
+  PresetStore<_presets, tracks, _steps, (uint16_t)(_presets * tracks * _steps * preset_layers / 2), _presets * tracks * preset_layers / 2> store;
   short int laststeps[tracks];
   uint8_t track_notes[tracks];  // C2 thru G2
   uint8_t ctrl_notes[3];
   uint8_t track_chan[tracks];
+  uint8_t trig_lens[tracks];    // 0 = gate (length from gates layer), else fixed trigger pulse in ms
   uint16_t lastdac[_dacs];
-  uint8_t tick_pc;
   uint8_t ctrl_chan = 16;
   uint8_t laststep;
-  uint8_t swing;
   short int pos;
   bool analog_io;
   bool mutes[tracks];
-  bool seqs[_presets][tracks][_steps];
+  bool seqs[tracks][_steps];
   bool pulse;
   bool playing;
   bool send_clock;
@@ -122,6 +185,8 @@ public:
   ResetFunc reset_func;
   GateFunc gate_func;
   CVFunc cv_func;
+  PulseFunc pulse_func;
+  PollFunc poll_func;
 
   MultiStepSequencer(float atempo = 120, uint8_t aseqno = 0) {
     transpose = 0;
@@ -129,13 +194,34 @@ public:
     resetflag = 0;
     stepi = 0;
     ticki = 0;
-    ticks_per_step = 12;  // 12 = 1/16th, 24 = 1/8, 48 = 1/4,
+    ticks_per_step = SIXTEENTH_NOTE * ticks_per_clock;
     seqno = aseqno;
     length = _steps;
     playing = false;
     extclk_micros = 0;
+    ticks_pending = 0;
+    ext_owed = 0;
+    ext_next = 0;
+    timer_clocked = false;
     send_clock = false;
     analog_io = false;
+    loops = 0;
+    prob_seed = 0;
+    for (uint8_t i = 0; i < tracks; ++i) {
+      compiled[i] = false;
+      track_steps[i] = 0;
+      events[i] = event_banks[0][i];
+      queued[i] = -1;
+      queued_at[i] = 0;
+      prepared[i] = false;
+      step_handlers[i] = &MultiStepSequencer::play_none;
+      off_handlers[i] = &MultiStepSequencer::off_none;
+      scales[i] = 0;
+      roots[i] = 0;
+      degrees[i] = 0;
+      for (uint8_t n = 0; n < 128; ++n) note_maps[i][n] = n;
+    }
+    clear_stats();
     set_tempo(atempo);
     on_func = fake_note_callback;
     off_func = fake_note_callback;
@@ -146,6 +232,8 @@ public:
     reset_func = fake_resetdisplay_callback;
     gate_func = fake_gate_callback;
     cv_func = fake_cv_callback;
+    pulse_func = fake_pulse_callback;
+    poll_func = fake_poll_callback;
   }
 
   // get tempo as floating point, computed dynamically from ticks_micros
@@ -156,81 +244,153 @@ public:
   // set tempo as floating point, computes ticks_micros
   void set_tempo(float bpm) {
     tick_micros = 60 * 1000 * 1000 / bpm / ticks_per_quarternote;
-    tick_pc = tick_micros / 100;
   }
 
-  void update() {
-    uint8_t sw = length > 1 ? swing : 0;
+  // true = a tick ran
+  bool update() {
     uint32_t now_micros = micros();
+    poll_func(now_micros);
+    refresh();
 
-    if ((stepi % 2 ? (now_micros - last_tick_micros) < (tick_micros - (tick_pc * sw)) : (now_micros - last_tick_micros) < (tick_micros + (tick_pc * sw)))) {
-      return;
-    }  // not yet, with Swing!
+    if (extclk_micros) {
+      // release the ticks interpolated between two external clocks as they come due
+      if (ext_owed > 0 && (int32_t)(now_micros - ext_next) >= 0) {
+        ext_owed--;
+        ext_next += tick_micros;
+        noInterrupts();
+        ticks_pending = ticks_pending + 1;
+        interrupts();
+      }
+      // fall back to internal clock if not externally clocked for a while
+      if ((now_micros - extclk_micros) > tick_micros * ticks_per_quarternote) {
+        extclk_micros = 0;
+        ext_owed = 0;
+        Serial.println("Turning EXT CLOCK off");
+      }
+    }
+
+    if (timer_clocked || extclk_micros) {
+      // clock timer (or external clock) already applied tempo, just take the next tick handed over
+      if (ticks_pending == 0) return false;
+      noInterrupts();
+      ticks_pending = ticks_pending - 1;
+      interrupts();
+    } else if ((now_micros - last_tick_micros) < tick_micros) {
+      return false;
+    }  // not yet
     last_tick_micros = now_micros;
+    tick(now_micros);
+    return true;
+  }
 
+  // Rebuild whatever edits left stale, current & queued event lists alike. Main loop, before
+  // each tick (update() does it), so a tick only ever reads them & flips pointers
+  void refresh() {
+    for (uint8_t i = 0; i < tracks; ++i) {
+      if (!compiled[i]) compile(i);
+      if (queued[i] >= 0 && !prepared[i]) prepare(i);
+    }
+  }
+
+  // One engine tick (ticks_per_quarternote per beat), event lists refresh()ed
+  void tick(uint32_t now_micros) {
     // if we have a held note and it's time to turn it off, turn it off
     for (uint8_t i = 0; i < tracks; ++i) {
       if (held_gate_millis[i] != 0 && millis() >= held_gate_millis[i]) {
         held_gate_millis[i] = 0;
-        switch (modes[i]) {
-          case ARP:
-            if (i >= _arps) {
-              off_func(held_gate_notes[i], 0, 1, true, held_gate_chans[i]);
-              if (analog_io) gate_func(gatepins[i], 0);
-            }
-            break;
-          case TRIGATE:
-            off_func(track_notes[i] + transpose, 0, 1, true, track_chan[i]);
-            if (analog_io) gate_func(gatepins[i], 0);
-            break;
-          case CC:
-            if (analog_io) gate_func(gatepins[i], 0);
-            break;
-          case NOTE:
-            off_func(held_gate_notes[i], 0, 1, true, held_gate_chans[i]);
-            if (analog_io) gate_func(gatepins[i], 0);
-            held_gate_notes[i] = 0;
-            held_gate_chans[i] = 0;
-            break;
-          default: break;
-        }
+        (this->*off_handlers[i])(i);
       }
     }
+    voices.release_due(now_micros, off_func);
 
-    if (send_clock && playing && !extclk_micros) {
+    if (send_clock && playing && !extclk_micros && ticki % ticks_per_clock == 0) {
       clk_func(CLOCK);
     }
 
+    bool redraw = false;
     if (ticki == 0) {
       // do a sequence step (i.e. every "ticks_per_step" ticks)
-      if (extclk_micros) {
-        // do nothing, let midi clock trigger notes, but fall back to
-        // internal clock if not externally clocked for a while
-        if ((now_micros - extclk_micros) > tick_micros * ticks_per_quarternote) {
-          extclk_micros = 0;
-          Serial.println("Turning EXT CLOCK off");
+      trigger(now_micros);
+      redraw = true;
+    } else {
+      if (ticki % ticks_per_clock == 0 && ticki / ticks_per_clock > 1) trellis.read();
+    }
+
+    // tracks fire on their own schedule: grid position of the next step plus its microtiming.
+    // Each phase counts in 1/(muls+1) ticks, so any mul/div ratio stays exact, with one add &
+    // compare per track per tick however fine the resolution or fast the track
+    if (playing) {
+      uint8_t trk_arr = sel_track - 1;
+      for (uint8_t i = 0; i < tracks; ++i) {
+        if (to_grid[i] + nudge(i) <= 0) {
+          if (marci_debug) {  // timing only in debug builds, it costs two micros() per step
+            uint32_t t0 = micros();
+            fire_step(i, now_micros);
+            uint32_t took = micros() - t0;
+            fire_micros_total += took;
+            if (took > fire_micros_max) fire_micros_max = took;
+          } else {
+            fire_step(i, now_micros);
+          }
+          fires++;
+          to_grid[i] += step_len(i);
+          if (i == trk_arr) redraw = true;
         }
-      } else {                // else internally clocked
-        trigger(now_micros);  // delta_t);
+        to_grid[i] -= muls[i] + 1;
       }
-    } else {
-      if (ticki % ticks_per_step/2) trellis.read();
     }
-    // increment our ticks-per-step counter: 0,1,2,3,4,5, 0,1,2,3,4,5, ...
+    if (redraw) disp_func();
+
+    // increment our ticks-per-step counter: 0,1,2 .. ticks_per_step-1, 0,1,2 ...
     ticki = (ticki + 1) % ticks_per_step;
   }
 
-  // Trigger step when externally clocked (turns on external clock flag)
+  // One external 24PPQN clock (turns on external clock flag): plays a tick now, the other
+  // ticks_per_clock - 1 are interpolated at the current tempo by update()
   void trigger_ext(uint32_t now_micros) {
+    noInterrupts();
+    ticks_pending = ticks_pending + 1 + ext_owed;  // anything still owed from the last clock is late, play it now
+    interrupts();
     extclk_micros = now_micros;
-    trigger(now_micros);
+    ext_owed = ticks_per_clock - 1;
+    ext_next = now_micros + tick_micros;
   }
 
-  // Trigger step in sequence, when internally clocked
-  void trigger(uint32_t now_micros) {
+  uint8_t loop_start(uint8_t i) {
+    return offsets[i] - 1 < 0 ? 0 : offsets[i] - 1;
+  }
+
+  // step shown as the one before step s of track i
+  uint8_t step_before(uint8_t i, uint8_t s) {
+    return s > offsets[i] ? (s - 1 < 0 + (offsets[i] - 1 < 0 ? 0 : offsets[i] - 1) ? lengths[i] - 1 : s - 1) : (s - 1 < 0 ? lengths[i] - 1 : s - 1);
+  }
+
+  // step that follows multistepi[i] (decouple per-track step counters from main sequencer)
+  uint8_t next_step(uint8_t i) {
+    return (multistepi[i] + 1) > lengths[i] - 1 ? 0 + (offsets[i] - 1 < 0 ? 0 : offsets[i] - 1) : (multistepi[i] + 1);
+  }
+
+  // length of one track step, in 1/(muls+1) ticks
+  int32_t step_len(uint8_t i) {
+    return ticks_per_step * (divs[i] + 1);
+  }
+
+  // microtiming of the track's next step (own nudge + groove) in 1/(muls+1) ticks,
+  // kept inside half a step so steps never swap order
+  int32_t nudge(uint8_t i) {
+    return events[i][next_steps[i]].offset;  // see compile()
+  }
+
+  // change a track's multiplier, keeping the distance to its next step the same in real time
+  void set_mul(uint8_t i, uint8_t mul) {
+    to_grid[i] = to_grid[i] * (mul + 1) / (muls[i] + 1);
+    muls[i] = mul;
+    touch(i);
+  }
 
+  // Master sequencer step, every ticks_per_step ticks
+  void trigger(uint32_t) {
     if (!playing) {
-      disp_func();
       return;
     }
     if (resetflag == 1) {
@@ -240,6 +400,9 @@ public:
     // Base sequencer
     pulse = pulse == 0 ? 1 : 0;
     stepi = (stepi + 1) % length;  // go to next step
+    // counted a step early, so tracks starting their loop slightly ahead of the master (nudged
+    // or grooved early) already see the new loop when deciding whether to swap preset
+    if (stepi == length - 1) loops++;
     if (stepi % steps_per_beat_default) {
       pos = pos + 1;
       pos_func(pos);
@@ -249,140 +412,458 @@ public:
       cv_func(cvpins[0], lastdac[0]);
       cv_func(cvpins[1], lastdac[1]);
     }
+  }
+
+  // Play track i's next step, straight from its compiled event list
+  void fire_step(uint8_t i, uint32_t now_micros) {
+    uint8_t nstep = next_step(i);
+    if (queued[i] >= 0 && prepared[i] && nstep == loop_start(i) && (int16_t)(loops - queued_at[i]) >= 0) swap(i);
+    laststeps[i] = step_before(i, nstep);
+    multistepi[i] = nstep;
+    next_steps[i] = next_step(i);
+
+    const StepEvent& ev = events[i][nstep];
+    outcomes[i] = ev.prob < 10 ? roll(i, track_steps[i]) <= ev.prob : 1;
+    track_steps[i]++;
+    if (!ev.on || mutes[i] != 0) return;
+    if (!outcomes[i] && modes[i] != ARP) return;  // an arp still moves on, silently (see play_arp)
+
+    (this->*step_handlers[i])(i, ev, now_micros, ev.gate_len * tick_micros / 16);
+  }
+
+  // chance for track i's j-th step since reset: its probability roll, & the note of a random
+  // arp. Hashed from the step's number rather than drawn from random(), so seek() lands on the
+  // same rolls as playing there would
+  uint32_t step_hash(uint8_t i, uint32_t j) {
+    uint32_t h = prob_seed ^ (j * 2654435761UL) ^ ((uint32_t)i << 24);
+    h ^= h >> 16;
+    h *= 0x85EBCA6BUL;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35UL;
+    h ^= h >> 16;
+    return h;
+  }
+
+  // probability roll 0 - 9
+  uint8_t roll(uint8_t i, uint32_t j) {
+    return step_hash(i, j) % 10;
+  }
+
+  // Per-mode step & note-off handlers, bound per track by compile(). cv = track drives a DAC,
+  // io = analog outs enabled: both only change from the UI, so they're template parameters
+  // rather than tests in the hot path.
+  template<bool io>
+  void play_trigate(uint8_t i, const StepEvent& ev, uint32_t now_micros, uint32_t gate_micros) {
+    held_gate_millis[i] = (now_micros + gate_micros) / 1000;
+    if (io) pulse_func(i, pulse_len(i, gate_micros));
+    on_func(ev.note, ev.vel, ev.gate, true, track_chan[i]);
+  }
+
+  template<bool cv, bool io>
+  void play_cc(uint8_t i, const StepEvent& ev, uint32_t now_micros, uint32_t gate_micros) {
+    held_gate_millis[i] = (now_micros + gate_micros) / 1000;
+    if (cv) set_cv(i, ev.cv);
+    if (io) pulse_func(i, pulse_len(i, gate_micros));
+    cc_func(ev.note, ev.vel, true, track_chan[i]);
+  }
+
+  template<bool cv, bool io>
+  void play_note(uint8_t i, const StepEvent& ev, uint32_t now_micros, uint32_t gate_micros) {
+    held_gate_millis[i] = (now_micros + gate_micros) / 1000;
+    held_gate_notes[i] = ev.note;
+    held_gate_chans[i] = track_chan[i];
+    if (cv) set_cv(i, ev.cv);
+    if (io) pulse_func(i, pulse_len(i, gate_micros));
+    on_func(ev.note, ev.vel, ev.gate, true, track_chan[i]);
+  }
+
+  template<bool cv, bool io>
+  void play_arp(uint8_t i, const StepEvent& ev, uint32_t now_micros, uint32_t gate_micros) {
+    uint8_t n = arps[i].process(arp_patterns[i], arp_octaves[i], step_hash(i, track_steps[i] - 1) >> 16);  // pattern (1-7), octaves(1-4)
+    if (n == 0 || !outcomes[i]) return;
+    n = note_maps[i][n];
+    if (marci_debug) {
+      Serial.print("ArpNote: ");
+      Serial.println(n);
+    }
+    held_gate_millis[i] = (now_micros + gate_micros) / 1000;
+    held_gate_notes[i] = n;
+    held_gate_chans[i] = track_chan[i];
+    if (cv) set_cv(i, dac_code(i, n));
+    if (io) pulse_func(i, pulse_len(i, gate_micros));
+    on_func(n, ev.vel, ev.gate, true, track_chan[i]);
+  }
+
+  // root + shape, each note held in the voice pool until its own off-time
+  template<bool cv, bool io>
+  void play_chord(uint8_t i, const StepEvent& ev, uint32_t now_micros, uint32_t gate_micros) {
+    const ChordShape& shape = chord_shapes[ev.shape];
+    if (cv) set_cv(i, ev.cv);
+    if (io) pulse_func(i, pulse_len(i, gate_micros));
+    for (uint8_t v = 0; v < shape.size; ++v) {
+      int16_t n = ev.note + shape.intervals[v];
+      if (n > 127) break;
+      voices.start(n, track_chan[i], now_micros + gate_micros, off_func);
+      on_func(n, ev.vel, ev.gate, true, track_chan[i]);
+    }
+  }
+
+  void play_none(uint8_t, const StepEvent&, uint32_t, uint32_t) {}
+
+  void off_trigate(uint8_t i) {
+    off_func(track_notes[i] + transpose, 0, 1, true, track_chan[i]);
+  }
+
+  void off_held(uint8_t i) {
+    off_func(held_gate_notes[i], 0, 1, true, held_gate_chans[i]);
+  }
+
+  void off_note(uint8_t i) {
+    off_func(held_gate_notes[i], 0, 1, true, held_gate_chans[i]);
+    held_gate_notes[i] = 0;
+    held_gate_chans[i] = 0;
+  }
+
+  void off_none(uint8_t) {}
+
+  template<bool cv, bool io>
+  void bind(uint8_t i) {
+    switch (modes[i]) {
+      case TRIGATE:
+        step_handlers[i] = &MultiStepSequencer::play_trigate<io>;
+        off_handlers[i] = &MultiStepSequencer::off_trigate;
+        break;
+      case CC:
+        step_handlers[i] = &MultiStepSequencer::play_cc<cv, io>;
+        off_handlers[i] = &MultiStepSequencer::off_none;
+        break;
+      case NOTE:
+        step_handlers[i] = &MultiStepSequencer::play_note<cv, io>;
+        off_handlers[i] = &MultiStepSequencer::off_note;
+        break;
+      case ARP:
+        step_handlers[i] = i < _arps ? &MultiStepSequencer::play_arp<cv, io> : &MultiStepSequencer::play_none;
+        off_handlers[i] = i < _arps ? &MultiStepSequencer::off_held : &MultiStepSequencer::off_none;
+        break;
+      case CHORD:
+        step_handlers[i] = &MultiStepSequencer::play_chord<cv, io>;
+        off_handlers[i] = &MultiStepSequencer::off_none;  // voice pool releases its own notes
+        break;
+      default:
+        step_handlers[i] = &MultiStepSequencer::play_none;
+        off_handlers[i] = &MultiStepSequencer::off_none;
+        break;
+    }
+  }
+
+  // analog gate length (falling edge is timer driven), fixed width when in trigger mode
+  uint32_t pulse_len(uint8_t i, uint32_t gate_micros) {
+    return trig_lens[i] ? trig_lens[i] * 1000 : gate_micros;
+  }
+
+  // CV Output for track 7 & 8 on A0 & A1 (0 = not a CV track / nothing to send)
+  uint16_t dac_code(uint8_t i, uint8_t n) {
+    if (!analog_io || i < (tracks - _dacs)) return 0;
+    float val;
+    if (hzv[i - (tracks - _dacs)] == 1) {
+      // MS20 / K2 hz/v output
+      val = constrain(map(125.0 * exp(0.0578 * ((n % 36) - 5)), 0, 5000, 0, dacrange), 0, dacrange);
+    } else {
+      // Plain old v/oct
+      val = constrain(map(n % 36, 0, 36, 0, 3708), 0, dacrange);
+    }
+    return val;
+  }
+
+  void set_cv(uint8_t i, uint16_t val) {
+    if (val > 0) {
+      lastdac[i - (tracks - _dacs)] = val;
+      cv_func(cvpins[i - (tracks - _dacs)], val);
+    }
+  }
+
+  // Event for step s of track i, from its layers (one pointer per layer)
+  void build_step(uint8_t i, uint8_t s, const uint8_t* const* layer, StepEvent& ev) {
+    int32_t len = step_len(i);
+    int32_t lim = len / 2 - (muls[i] + 1);
+    uint8_t vel = layer[VEL_LAYER][s];
+    uint8_t note = layer[NOTE_LAYER][s];
+    ev.on = layer[SEQ_LAYER][s] == 1;
+    ev.prob = layer[PROB_LAYER][s];
+    ev.gate = layer[GATE_LAYER][s];
+    ev.gate_len = ev.gate * len / (muls[i] + 1);
+    int16_t v = vel + groove_templates[grooves[i]].vel[s % groove_len];
+    ev.shape = 0;
+    switch (modes[i]) {
+      case CC:
+        ev.note = track_notes[i];
+        ev.vel = vel;  // CC value, no accent
+        ev.cv = dac_code(i, vel);
+        break;
+      case NOTE:
+        ev.note = note_maps[i][constrain(note + transpose, 0, 127)];
+        ev.vel = constrain(v, 1, 127);
+        ev.cv = dac_code(i, note_maps[i][note & 127]);
+        break;
+      case CHORD:
+        ev.note = note_maps[i][constrain(note + transpose, 0, 127)];  // root quantised, shape on top
+        ev.vel = constrain(v, 1, 127);
+        ev.cv = dac_code(i, note_maps[i][note & 127]);  // root
+        ev.shape = layer[CHORD_LAYER][s] % chord_shapes_cnt;
+        break;
+      default:
+        ev.note = track_notes[i] + transpose;
+        ev.vel = constrain(v, 1, 127);
+        ev.cv = 0;
+        break;
+    }
+    int32_t n = (int8_t)layer[NUDGE_LAYER][s] * (muls[i] + 1) + groove_templates[grooves[i]].timing[s % groove_len] * len / 100;
+    ev.offset = constrain(n, -lim, lim);
+  }
+
+  // Build track i's event list for preset p into out: everything fire_step() & the scheduler
+  // need, worked out once per edit instead of once per step
+  void build(uint8_t i, uint8_t p, StepEvent* out) {
+    TrackPreset<_steps> tp;  // its layers, by the working slot's names
+    get_preset(p, i, tp);
+    const uint8_t* layer[preset_layers];
+    for (uint8_t l = 0; l < preset_layers; ++l) layer[l] = tp.layer[l];
+    for (uint8_t s = 0; s < _steps; ++s) build_step(i, s, layer, out[s]);
+    rebuilds++;
+  }
+
+  // Rebuild track i's current event list (and handlers)
+  void compile(uint8_t i) {
+    build(i, presets[i], events[i]);
+    if (analog_io && i >= (tracks - _dacs)) {
+      bind<true, true>(i);
+    } else if (analog_io) {
+      bind<false, true>(i);
+    } else {
+      bind<false, false>(i);
+    }
+    compiled[i] = true;
+  }
 
-    uint8_t trk_arr = sel_track - 1;
-    uint32_t micros_per_step = ticks_per_step * tick_micros;
-    uint32_t gate_micros;
+  StepEvent* back_bank(uint8_t i) {
+    return event_banks[events[i] == event_banks[0][i] ? 1 : 0][i];
+  }
+
+  // compile the queued preset into the back bank
+  void prepare(uint8_t i) {
+    build(i, queued[i], back_bank(i));
+    prepared[i] = true;
+  }
 
+  // play preset p on track i from its next loop start (once loops reaches at_loop), compiled
+  // now so the switch itself is just a pointer flip. Call from the main loop, not from tick().
+  void queue_preset(uint8_t i, uint8_t p, uint16_t at_loop) {
+    queued[i] = p;
+    queued_at[i] = at_loop;
+    prepare(i);
+  }
+
+  void swap(uint8_t i) {
+    if (switch_slot(i, queued[i])) {
+      events[i] = back_bank(i);
+      swaps++;
+    }
+    queued[i] = -1;  // store full: carry on with the current preset
+  }
+
+  bool queued_any() {
     for (uint8_t i = 0; i < tracks; ++i) {
-      divcounts[i] = divcounts[i] == divs[i] ? 0 : divcounts[i] + 1;
+      if (queued[i] >= 0) return true;
+    }
+    return false;
+  }
 
-      if (divcounts[i] == 0) {
-        //decouple per-track step counters from main sequencer
-        uint8_t nstep = (multistepi[i] + 1) > lengths[i] - 1 ? 0 + (offsets[i] - 1 < 0 ? 0 : offsets[i] - 1) : (multistepi[i] + 1);  // go to next step
+  // switch preset now (while stopped)
+  void set_preset(uint8_t i, uint8_t p) {
+    if (presets[i] != p) {
+      release_track(i);
+      switch_slot(i, p);
+    }
+    queued[i] = -1;
+    touch(i);
+  }
 
-        uint8_t lstep = nstep > offsets[i] ? (nstep - 1 < 0 + (offsets[i] - 1 < 0 ? 0 : offsets[i] - 1) ? lengths[i] - 1 : nstep - 1) : (nstep - 1 < 0 ? lengths[i] - 1 : nstep - 1);
+  // track t's working slot as layer l
+  uint8_t* slot_layer(uint8_t t, uint8_t l) {
+    switch (l) {
+      case SEQ_LAYER: return (uint8_t*)seqs[t];
+      case NOTE_LAYER: return notes[t];
+      case VEL_LAYER: return vels[t];
+      case PROB_LAYER: return probs[t];
+      case GATE_LAYER: return gates[t];
+      case NUDGE_LAYER: return (uint8_t*)nudges[t];
+      default: return chords[t];
+    }
+  }
 
-        laststeps[i] = lstep;
-        multistepi[i] = nstep;
+  // preset p of track t, from its working slot if it's the current one, else from store
+  void get_preset(uint8_t p, uint8_t t, TrackPreset<_steps>& out) {
+    if (p != presets[t]) {
+      store.get(p, t, out);
+      return;
+    }
+    for (uint8_t l = 0; l < preset_layers; ++l) memcpy(out.layer[l], slot_layer(t, l), _steps);
+  }
 
-        if (probs[presets[i]][i][multistepi[i]] < 10) {
-          outcomes[i] = random(10) <= (probs[presets[i]][i][multistepi[i]]);
-        } else {
-          outcomes[i] = 1;
-        }
+  void set_slot(uint8_t t, const TrackPreset<_steps>& in) {
+    for (uint8_t s = 0; s < _steps; ++s) seqs[t][s] = in.layer[SEQ_LAYER][s] != 0;
+    for (uint8_t l = SEQ_LAYER + 1; l < preset_layers; ++l) memcpy(slot_layer(t, l), in.layer[l], _steps);
+  }
 
-        gate_micros = (gates[presets[i]][i][multistepi[i]] * micros_per_step / 16) * (divs[i] + 1);
-
-        switch (modes[i]) {
-          case ARP:
-            if (seqs[presets[i]][i][multistepi[i]] == 1 && mutes[i] == 0 ? outcomes[i] : false) {
-              uint8_t n;
-              if (i >= _arps) {
-                uint8_t arp_id = i - _arps;
-                n = arps[arp_id].process(arp_patterns[arp_id], arp_octaves[arp_id]);  // pattern (1-7), octaves(1-4)
-                if (n != 0) {
-                  if (marci_debug) {
-                    Serial.print("ArpNote: ");
-                    Serial.println(n);
-                  }
-                  held_gate_millis[i] = (now_micros + gate_micros) / 1000;
-                  held_gate_notes[i] = n;
-                  held_gate_chans[i] = track_chan[i];
-                  if (analog_io && i >= (tracks - _dacs) && mutes[i] == 0) {
-                    // CV Output for track 7 & 8 on A0 & A1
-                    if (hzv[i - (tracks - _dacs)] == 1) {
-                      // MS20 / K2 hz/v output
-                      float val = constrain(map(125.0 * exp(0.0578 * ((n % 36) - 5)), 0, 5000, 0, dacrange), 0, dacrange);
-                      if (val > 0) {
-                        lastdac[i - (tracks - _dacs)] = val;
-                        cv_func(cvpins[i - 6], val);
-                      }
-                    } else {
-                      // Plain old v/oct
-                      float val = constrain(map(n % 36, 0, 36, 0, 3708), 0, dacrange);
-                      if (val > 0) {
-                        lastdac[i - (tracks - _dacs)] = val;
-                        cv_func(cvpins[i - 6], val);
-                      }
-                    }
-                  }
-                  if (analog_io) gate_func(gatepins[i], 1);
-                  on_func(n, vels[presets[i]][i][multistepi[i]], gates[presets[i]][i][multistepi[i]], true, track_chan[i]);
-                }
-              }
-            }
-            break;
-          case TRIGATE:
-            if (seqs[presets[i]][i][multistepi[i]] == 1 && mutes[i] == 0 ? outcomes[i] : false) {
-              held_gate_millis[i] = (now_micros + gate_micros) / 1000;
-              if (analog_io) gate_func(gatepins[i], 1);
-              on_func(track_notes[i] + transpose, vels[presets[i]][i][multistepi[i]], gates[presets[i]][i][multistepi[i]], true, track_chan[i]);
-            }
-            break;
-          case CC:
-            if (seqs[presets[i]][i][multistepi[i]] == 1 && mutes[i] == 0 ? outcomes[i] : false) {
-              held_gate_millis[i] = (now_micros + gate_micros) / 1000;
-              if (analog_io && i >= (tracks - _dacs) && mutes[i] == 0) {
-                // CV Output for track 7 & 8 on A0 & A1
-                if (hzv[i - (tracks - _dacs)] == 1) {
-                  // MS20 / K2 hz/v output
-                  float val = constrain(map(125.0 * exp(0.0578 * ((vels[presets[i]][i][multistepi[i]] % 36) - 5)), 0, 5000, 0, dacrange), 0, dacrange);
-                  if (val > 0) {
-                    lastdac[i - (tracks - _dacs)] = val;
-                    cv_func(cvpins[i - 6], val);
-                  }
-                } else {
-                  // Plain old v/oct
-                  float val = constrain(map(vels[presets[i]][i][multistepi[i]] % 36, 0, 36, 0, 3708), 0, dacrange);
-                  if (val > 0) {
-                    lastdac[i - (tracks - _dacs)] = val;
-                    cv_func(cvpins[i - 6], val);
-                  }
-                }
-              }
-              if (analog_io) gate_func(gatepins[i], 1);
-              cc_func(track_notes[i], vels[presets[i]][i][multistepi[trk_arr]], true, track_chan[i]);
-            }
-            break;
-          case NOTE:
-            if (seqs[presets[i]][i][multistepi[i]] == 1 && mutes[i] == 0 ? outcomes[i] : false) {
-              held_gate_millis[i] = (now_micros + gate_micros) / 1000;
-              held_gate_notes[i] = notes[presets[i]][i][multistepi[i]] + transpose;
-              held_gate_chans[i] = track_chan[i];
-              if (analog_io && i >= (tracks - _dacs) && mutes[i] == 0) {
-                // CV Output for track 7 & 8 on A0 & A1
-                if (hzv[i - (tracks - _dacs)] == 1) {
-                  // MS20 / K2 hz/v output
-                  float val = constrain(map(125.0 * exp(0.0578 * ((notes[presets[i]][i][multistepi[i]] % 36) - 5)), 0, 5000, 0, dacrange), 0, dacrange);
-                  if (val > 0) {
-                    lastdac[i - (tracks - _dacs)] = val;
-                    cv_func(cvpins[i - 6], val);
-                  }
-                } else {
-                  // Plain old v/oct
-                  float val = constrain(map(notes[presets[i]][i][multistepi[i]] % 36, 0, 36, 0, 3708), 0, dacrange);
-                  if (val > 0) {
-                    lastdac[i - (tracks - _dacs)] = val;
-                    cv_func(cvpins[i - 6], val);
-                  }
-                }
-              }
-              if (analog_io) gate_func(gatepins[i], 1);
-              on_func(notes[presets[i]][i][multistepi[i]] + transpose, vels[presets[i]][i][multistepi[i]], gates[presets[i]][i][multistepi[i]], true, track_chan[i]);
-            }
-            break;
-          default: break;
+  // false = store full, preset left as it was
+  bool put_preset(uint8_t p, uint8_t t, const TrackPreset<_steps>& in) {
+    if (p == queued[t] || p == presets[t]) touch(t);
+    if (p != presets[t]) return store.put(p, t, in);
+    set_slot(t, in);
+    return true;
+  }
+
+  void get_layer(uint8_t p, uint8_t t, uint8_t l, uint8_t* out) {
+    TrackPreset<_steps> tp;
+    get_preset(p, t, tp);
+    memcpy(out, tp.layer[l], _steps);
+  }
+
+  bool set_layer(uint8_t p, uint8_t t, uint8_t l, const uint8_t* in) {
+    TrackPreset<_steps> tp;
+    get_preset(p, t, tp);
+    memcpy(tp.layer[l], in, _steps);
+    return put_preset(p, t, tp);
+  }
+
+  // move track t's working slot to preset p, the outgoing preset going back into store.
+  // false = store full, still on the old preset
+  bool switch_slot(uint8_t t, uint8_t p) {
+    TrackPreset<_steps> tp;
+    get_preset(presets[t], t, tp);
+    if (!store.put(presets[t], t, tp)) return false;
+    store.get(p, t, tp);
+    set_slot(t, tp);  // already compiled if it was queued
+    presets[t] = p;
+    return true;
+  }
+
+  // hold every preset, working slots included, till restore(). false = store full, nothing held
+  bool snapshot() {
+    TrackPreset<_steps> tp;
+    for (uint8_t t = 0; t < tracks; ++t) {
+      get_preset(presets[t], t, tp);
+      if (!store.put(presets[t], t, tp)) return false;
+    }
+    store.snapshot();
+    return true;
+  }
+
+  // every preset back as it was at snapshot(), whichever each track is on now
+  void restore() {
+    if (!store.held) return;
+    store.restore();
+    TrackPreset<_steps> tp;
+    for (uint8_t t = 0; t < tracks; ++t) {
+      store.get(presets[t], t, tp);
+      set_slot(t, tp);
+    }
+    touch_all();
+  }
+
+  // rebuild track i's note map after a scale / root / degree change (main loop only)
+  void set_scale(uint8_t i) {
+    scale_map(scales[i], roots[i], degrees[i], note_maps[i]);
+    touch(i);
+  }
+
+  // step live entry (SHIFT held) on track i lands on: the one playing, or with round the next once
+  // past half of it. multistepi is -1 after reset() & while stopped, so it's kept inside the row
+  uint8_t live_step(uint8_t i, bool round = false) {
+    int s = multistepi[i] + (round && ticki > ticks_per_step / 2 ? 1 : 0);
+    return constrain(s, 0, _steps - 1);
+  }
+
+  // incoming CC on track i, into step s: a CC track's value (& the CC it sends), a NOTE track's velocity
+  void cc_edit(uint8_t i, uint8_t s, uint8_t cc, uint8_t val) {
+    if (s >= _steps) return;
+    switch (modes[i]) {
+      case CC:
+        vels[i][s] = val;
+        if (track_notes[i] != cc) {
+          track_notes[i] = cc;  // every step sends it
+          touch(i);
+        } else {
+          touch_step(i, s);
         }
-      }
+        break;
+      case NOTE:
+        vels[i][s] = val;
+        touch_step(i, s);
+        break;
+      default: break;
     }
-    disp_func();
+  }
+
+  // step s of track i's working slot was edited: rebuild just its event, in whichever lists
+  // hold the current preset (main loop only). A stale list is left for refresh() to rebuild whole
+  void touch_step(uint8_t i, uint8_t s) {
+    if (!compiled[i] || s >= _steps) return;
+    const uint8_t* layer[preset_layers];
+    for (uint8_t l = 0; l < preset_layers; ++l) layer[l] = slot_layer(i, l);
+    build_step(i, s, layer, events[i][s]);
+    if (queued[i] == presets[i]) prepared[i] = false;  // queued itself: its back bank is a copy
+    step_rebuilds++;
+  }
+
+  // mark a track's event list stale after an edit that reaches all its steps (mode, note, groove,
+  // division, scale...), rebuilt whole by refresh()
+  void touch(uint8_t i) {
+    compiled[i] = false;
+    prepared[i] = false;
+  }
+
+  void touch_all() {
+    for (uint8_t i = 0; i < tracks; ++i) touch(i);
+  }
+
+  void clear_stats() {
+    fires = 0;
+    fire_micros_total = 0;
+    fire_micros_max = 0;
+    rebuilds = 0;
+    step_rebuilds = 0;
+    swaps = 0;
+    seeks = 0;
+    voices.clear_stats();
+    active_notes.clear_stats();
+  }
+
+  void report() {
+    Serial.print(F("Steps fired: "));
+    Serial.print(fires);
+    Serial.print(F(", avg us: "));
+    Serial.print(fires ? fire_micros_total / fires : 0);
+    Serial.print(F(", max us: "));
+    Serial.print(fire_micros_max);
+    Serial.print(F(", event list rebuilds: "));
+    Serial.print(rebuilds);
+    Serial.print(F(", step rebuilds: "));
+    Serial.print(step_rebuilds);
+    Serial.print(F(", preset swaps: "));
+    Serial.print(swaps);
+    Serial.print(F(", seeks: "));
+    Serial.println(seeks);
+    voices.report();
+    active_notes.report();
+    arp_pool.report();
+    store.report();
   }
 
   void ctrl_stop() {
-    off_func(ctrl_notes[0] + transpose, 127, 5, true, ctrl_chan);
-    off_func(ctrl_notes[1] + transpose, 127, 5, true, ctrl_chan);
-    off_func(ctrl_notes[2] + transpose, 127, 5, true, ctrl_chan);
+    off_func(ctrl_notes[0], 127, 5, true, ctrl_chan);
+    off_func(ctrl_notes[1], 127, 5, true, ctrl_chan);
+    off_func(ctrl_notes[2], 127, 5, true, ctrl_chan);
   }
 
   void toggle_play_stop() {
@@ -395,6 +876,7 @@ public:
 
   // signal to sequencer/MIDI core we want to start playing
   void play() {
+    ticki = 0;  // first step on the first tick
     playing = true;
     if (send_clock && !extclk_micros) {
       clk_func(START);
@@ -403,6 +885,14 @@ public:
     ctrl_stop();
   }
 
+  // carry on from wherever the sequencer is (MIDI Continue): no reset, no restart of the step
+  void resume() {
+    resetflag = 0;
+    playing = true;
+    on_func(ctrl_notes[0], 127, 5, true, ctrl_chan);
+    ctrl_stop();
+  }
+
   // signal to sequencer/MIDI core we want to stop playing
   void stop() {
     if (playing) {
@@ -410,52 +900,127 @@ public:
       if (send_clock && !extclk_micros) {
         clk_func(STOP);
       }
-      for (uint8_t i = 0; i < tracks; ++i) {
-        switch (modes[i]) {
-          case TRIGATE:
-            off_func(track_notes[i] + transpose, 0, 1, true, track_chan[i]);
-            break;
-          case CC:
-            break;
-          case NOTE:
-              for (uint8_t k = 0; k < _steps; ++k) {
-                off_func(notes[presets[i]][i][k] + transpose, 0, 0, true, track_chan[i]);
-              }
-            break;
-          default: break;
-        }
-        if (analog_io) gate_func(gatepins[i], 0);
-      }
+      panic();
       on_func(ctrl_notes[1], 127, 5, true, ctrl_chan);
       ctrl_stop();
       reset_func();
     } else {
       ticki = 0;
+      panic();
       reset();
       reset_func();
     }
   }
 
+  // note-off for every note still sounding (whatever mode or track it came from), drop all gates
+  void panic() {
+    for (uint8_t i = 0; i < tracks; ++i) {
+      held_gate_millis[i] = 0;
+      if (analog_io) gate_func(gatepins[i], 0);
+    }
+    voices.clear();
+    active_notes.release_all(off_func);
+  }
+
+  // track i is switching preset: release whatever it's still holding from the old one
+  void release_track(uint8_t i) {
+    if (held_gate_millis[i] != 0) {
+      held_gate_millis[i] = 0;
+      (this->*off_handlers[i])(i);
+    }
+    if (modes[i] == CHORD) voices.release_chan(track_chan[i], off_func);
+  }
+
   void reset() {
     stepi = -1;
     pos = -1;
+    laststep = length - 1;
     if (!playing) {
       resetflag = 1;
       //disp_func();
     } else {
       ticki = 0;
     }
+    prob_seed = random(0x7FFFFFFF);
     for (uint8_t s = 0; s < numtracks; ++s) {
       multistepi[s] = -1;
-      divcounts[s] = -1;
       laststeps[s] = -1;
-      if (s <= _arps) {
-        // FIXME: setting this to -1 causes hard crash when saving. I have NO idea why... even calling a seperate function to specifically set it to 0 before save doesn't work.  *shrug*
-        arps[s]._step = 0;
-      }
+      to_grid[s] = 0;
+      track_steps[s] = 0;
+      next_steps[s] = next_step(s);
+      if (s < _arps) arps[s].reset();
     }
     on_func(ctrl_notes[2], 127, 5, true, ctrl_chan);
     ctrl_stop();
   }
+
+  // how many of the master steps 0 .. n - 1 of a loop move pos on (see trigger())
+  int pos_steps(uint32_t n) {
+    return n - (n + steps_per_beat_default - 1) / steps_per_beat_default;
+  }
+
+  // j-th step track i plays after a reset: one pass from step 0, then round its loop
+  uint8_t step_at(uint8_t i, uint32_t j) {
+    uint8_t ls = loop_start(i);
+    if (j < (uint32_t)lengths[i]) return j;
+    if (lengths[i] <= ls) return ls;
+    return ls + (j - lengths[i]) % (lengths[i] - ls);
+  }
+
+  // how many of track i's first f steps are on (so would have stepped its arp, whatever the roll)
+  uint32_t on_steps(uint8_t i, uint32_t f) {
+    if (mutes[i]) return 0;
+    uint8_t ls = loop_start(i);
+    uint32_t len = lengths[i];
+    uint32_t n = 0, loop_n = 0, part_n = 0;
+    uint32_t rest = f > len ? f - len : 0;
+    uint32_t part = len > ls ? rest % (len - ls) : 0;
+    for (uint8_t s = 0; s < len; ++s) {
+      if (!events[i][s].on) continue;
+      if (s < f) n++;
+      if (s >= ls) loop_n++;
+      if (s >= ls && s < ls + part) part_n++;
+    }
+    if (len > ls) n += rest / (len - ls) * loop_n + part_n;
+    return n;
+  }
+
+  // Jump to an absolute position in 16ths (MIDI Song Position Pointer), as if every tick from
+  // the start had been played: master step, and each track's step, phase, probability roll &
+  // arp position are worked out from the tick count, so the cost doesn't grow with the distance
+  // jumped (tools/test_seek.cpp checks it against playing there tick by tick).
+  // Step j of a track falls on grid position j * step_len, plus its microtiming, in
+  // 1/(muls+1) ticks, which only ever moves the one step either side of the position.
+  void seek(uint16_t sixteenths) {
+    uint32_t t = (uint32_t)sixteenths * SIXTEENTH_NOTE * ticks_per_clock;  // ticks already played
+    uint32_t n = (t + ticks_per_step - 1) / ticks_per_step;               // master steps triggered
+    stepi = n ? (n - 1) % length : -1;
+    pos = -1 + n / length * pos_steps(length) + pos_steps(n % length);
+    laststep = stepi - 1 < 0 ? length - 1 : stepi - 1;
+    ticki = t % ticks_per_step;
+    resetflag = 0;
+    for (uint8_t i = 0; i < tracks; ++i) {
+      if (!compiled[i]) compile(i);
+      int32_t len = step_len(i);
+      int32_t m = muls[i] + 1;
+      uint32_t f = 0;  // steps fired
+      if (t > 0) {
+        int32_t x = (t - 1) * m;  // grid position of the last tick played
+        f = x / len + 1;
+        if ((int32_t)(f - 1) * len + events[i][step_at(i, f - 1)].offset > x) {
+          f--;  // nudged late, still to come
+        } else if ((int32_t)f * len + events[i][step_at(i, f)].offset <= x) {
+          f++;  // nudged early, already gone
+        }
+      }
+      multistepi[i] = f ? step_at(i, f - 1) : -1;
+      laststeps[i] = f ? step_before(i, multistepi[i]) : -1;
+      next_steps[i] = step_at(i, f);
+      to_grid[i] = (int32_t)f * len - (int32_t)t * m;
+      track_steps[i] = f;
+      if (i < _arps) arps[i].seek(on_steps(i, f));
+    }
+    seeks++;
+  }
 };
 #endif
\ No newline at end of file
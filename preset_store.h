@@ -0,0 +1,317 @@
+/**
+ * preset_store.h -- Compressed preset storage for Multitrack Sequencer (for Feather M4 Express)
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Only each track's current preset is held as plain arrays (the sequencer's working slot, which
+ * the UI edits in place). Every other track / preset pair lives encoded in one fixed arena: the
+ * trig layer bit-packed, every other layer as a repeating phrase (a whole layer of one value is a
+ * phrase of 1), as runs of equal values, or raw, whichever is shortest.
+ * Each encoded layer is a block, found again by its content hash: presets that repeat a layer
+ * (a copied preset, the factory banks, every default velocity layer) share one reference counted
+ * block, and a shared block is never written to, an edit moves that layer to a block of its own.
+ * Switching preset encodes the outgoing slot & decodes the incoming one, a few microseconds, so
+ * it happens right at the swap between two steps.
+ * snapshot() holds a ref on every block, so the whole store can be put back (undoing a factory
+ * reset, see undo.h) for the price of a second block table.
+ */
+#ifndef MULTI_SEQUENCER_PRESET_STORE
+#define MULTI_SEQUENCER_PRESET_STORE
+
+typedef enum {
+  SEQ_LAYER = 0,
+  NOTE_LAYER = 1,
+  VEL_LAYER = 2,
+  PROB_LAYER = 3,
+  GATE_LAYER = 4,
+  NUDGE_LAYER = 5,
+  CHORD_LAYER = 6,
+  MARK_LAYER = 7,  // journal compaction begin / done, not a pattern layer
+} bank_layer;
+
+const uint8_t preset_layers = 7;
+const uint8_t layer_max[preset_layers] = { 1, 127, 127, 255, 255, 255, 255 };  // highest value a layer takes (nudges: any int8_t)
+// layer tags: raw values follow / a phrase of (tag & 0x7F) values follow, repeated / else the number of runs
+const uint8_t layer_raw = 0xFF;
+const uint8_t layer_phrase = 0x80;
+
+// one track's preset, every layer (trigs as 0 / 1, nudges as int8_t)
+template<uint8_t steps>
+struct TrackPreset {
+  uint8_t layer[preset_layers][steps];
+};
+
+// 32 bit FNV-1a
+uint32_t content_hash(const uint8_t* d, uint16_t n, uint32_t h = 2166136261UL) {
+  for (uint16_t i = 0; i < n; ++i) h = (h ^ d[i]) * 16777619UL;
+  return h;
+}
+
+typedef struct {
+  uint16_t start;  // in the arena
+  uint16_t refs;   // track / preset / layers using it, 0 = free entry
+  uint16_t hash;
+  uint8_t size;
+} StoreBlock;
+
+template<uint8_t presets, uint8_t tracks, uint8_t steps, uint16_t bytes, uint16_t blocks_max>
+class PresetStore {
+  public:
+    static const uint8_t block_max = 1 + steps;  // largest encoded layer
+    static const uint16_t layer_refs = presets * tracks * preset_layers;
+    uint8_t arena[bytes];             // blocks packed back to back, in no particular order
+    StoreBlock blocks[blocks_max];
+    uint16_t block_of[presets][tracks][preset_layers];
+    uint16_t held_of[presets][tracks][preset_layers];  // snapshot(), while held
+    bool held;
+    uint16_t used;
+    uint16_t peak;
+    uint16_t blocks_used;
+    uint32_t refused;  // puts that didn't fit, the preset was left as it was
+
+  static_assert(bytes >= (steps + 7) / 8 + 2 && blocks_max >= 2, "preset store can't hold an empty preset");
+  static_assert(steps < 128, "phrase length is 7 bits");
+
+  PresetStore() {
+    refused = 0;
+    held = false;
+    clear();
+  }
+
+  // every preset empty: all sharing one empty trig block & one empty value block
+  void clear() {
+    for (uint16_t b = 0; b < blocks_max; ++b) blocks[b].refs = 0;
+    used = 0;
+    blocks_used = 0;
+    uint8_t zeros[steps];
+    memset(zeros, 0, steps);
+    uint8_t rec[block_max];
+    uint16_t seq_b = alloc(rec, encode_layer(SEQ_LAYER, zeros, rec));
+    uint16_t val_b = alloc(rec, encode_layer(NOTE_LAYER, zeros, rec));
+    for (uint8_t p = 0; p < presets; ++p) {
+      for (uint8_t t = 0; t < tracks; ++t) {
+        for (uint8_t l = 0; l < preset_layers; ++l) block_of[p][t][l] = l == SEQ_LAYER ? seq_b : val_b;
+      }
+    }
+    blocks[seq_b].refs = presets * tracks;
+    blocks[val_b].refs = presets * tracks * (preset_layers - 1);
+    peak = used;
+  }
+
+  // shortest k the layer repeats every k steps, steps = doesn't
+  static uint8_t phrase(const uint8_t* v) {
+    for (uint8_t k = 1; k < steps; ++k) {
+      uint8_t s = k;
+      while (s < steps && v[s] == v[s - k]) s++;
+      if (s == steps) return k;
+    }
+    return steps;
+  }
+
+  static uint8_t encode_layer(uint8_t l, const uint8_t* v, uint8_t* out) {
+    uint8_t n = 0;
+    if (l == SEQ_LAYER) {
+      for (uint8_t b = 0; b < (steps + 7) / 8; ++b) {
+        uint8_t bits = 0;
+        for (uint8_t k = 0; k < 8 && b * 8 + k < steps; ++k) bits |= (v[b * 8 + k] != 0) << k;
+        out[n++] = bits;
+      }
+      return n;
+    }
+    uint8_t runs = 1;
+    for (uint8_t s = 1; s < steps; ++s) runs += v[s] != v[s - 1];
+    uint8_t k = phrase(v);
+    if (k <= 2 * runs && k < steps) {
+      out[n++] = layer_phrase | k;
+      memcpy(out + n, v, k);
+      return n + k;
+    }
+    if (2 * runs >= steps) {
+      out[n++] = layer_raw;
+      memcpy(out + n, v, steps);
+      return n + steps;
+    }
+    out[n++] = runs;
+    for (uint8_t s = 0; s < steps;) {
+      uint8_t r = 1;
+      while (s + r < steps && v[s + r] == v[s]) r++;
+      out[n++] = r;
+      out[n++] = v[s];
+      s += r;
+    }
+    return n;
+  }
+
+  static void decode_layer(uint8_t l, const uint8_t* in, uint8_t* out) {
+    if (l == SEQ_LAYER) {
+      for (uint8_t s = 0; s < steps; ++s) out[s] = (in[s / 8] >> (s % 8)) & 1;
+      return;
+    }
+    uint8_t tag = *in++;
+    if (tag == layer_raw) {
+      memcpy(out, in, steps);
+    } else if (tag & layer_phrase) {
+      uint8_t k = tag & ~layer_phrase;
+      for (uint8_t s = 0; s < steps; ++s) out[s] = in[s % k];
+    } else {
+      for (uint8_t r = 0, s = 0; r < tag; ++r, in += 2) {
+        memset(out + s, in[1], in[0]);
+        s += in[0];
+      }
+    }
+  }
+
+  // block already holding these bytes, blocks_max = none
+  uint16_t find(const uint8_t* rec, uint8_t n, uint16_t h) {
+    for (uint16_t b = 0; b < blocks_max; ++b) {
+      if (blocks[b].refs && blocks[b].hash == h && blocks[b].size == n && memcmp(arena + blocks[b].start, rec, n) == 0) return b;
+    }
+    return blocks_max;
+  }
+
+  // new block at the end of the arena (room already checked), with its first ref
+  uint16_t alloc(const uint8_t* rec, uint8_t n) {
+    uint16_t b = 0;
+    while (blocks[b].refs) b++;
+    blocks[b].refs = 1;
+    blocks[b].start = used;
+    blocks[b].size = n;
+    blocks[b].hash = content_hash(rec, n);
+    memcpy(arena + used, rec, n);
+    used += n;
+    blocks_used++;
+    if (used > peak) peak = used;
+    return b;
+  }
+
+  // change block b's bytes to n long, closing up / opening out the blocks after it
+  void resize(uint16_t b, uint8_t n) {
+    uint16_t at = blocks[b].start;
+    uint8_t old = blocks[b].size;
+    if (n == old) return;
+    memmove(arena + at + n, arena + at + old, used - at - old);
+    for (uint16_t c = 0; c < blocks_max; ++c) {
+      if (blocks[c].refs && blocks[c].start > at) blocks[c].start = blocks[c].start + n - old;
+    }
+    used = used - old + n;
+    blocks[b].size = n;
+    if (used > peak) peak = used;
+  }
+
+  void unref(uint16_t b) {
+    if (--blocks[b].refs) return;
+    blocks[b].refs = 1;  // still counted while resize() closes it up
+    resize(b, 0);
+    blocks[b].refs = 0;
+    blocks_used--;
+  }
+
+  void get(uint8_t p, uint8_t t, TrackPreset<steps>& out) {
+    for (uint8_t l = 0; l < preset_layers; ++l) decode_layer(l, arena + blocks[block_of[p][t][l]].start, out.layer[l]);
+  }
+
+  // share an identical block if there is one, else rewrite this one in place if nothing else
+  // uses it, else copy on write. false = no room, preset left as it was
+  bool put(uint8_t p, uint8_t t, const TrackPreset<steps>& in) {
+    uint8_t rec[preset_layers][block_max];
+    uint8_t n[preset_layers];
+    uint16_t h[preset_layers];
+    uint16_t hit[preset_layers];
+    for (uint8_t l = 0; l < preset_layers; ++l) {
+      n[l] = encode_layer(l, in.layer[l], rec[l]);
+      h[l] = content_hash(rec[l], n[l]);
+      hit[l] = find(rec[l], n[l], h[l]);
+      if (hit[l] < blocks_max) blocks[hit[l]].refs++;  // pinned: not rewritten or freed below
+    }
+    uint16_t need = 0;  // worst case: nothing frees up till the end
+    uint16_t new_blocks = 0;
+    for (uint8_t l = 0; l < preset_layers; ++l) {
+      if (hit[l] < blocks_max) continue;
+      const StoreBlock& old = blocks[block_of[p][t][l]];
+      if (old.refs == 1) {
+        if (n[l] > old.size) need += n[l] - old.size;
+      } else {
+        need += n[l];
+        new_blocks++;
+      }
+    }
+    if (used + need > bytes || blocks_used + new_blocks > blocks_max) {
+      for (uint8_t l = 0; l < preset_layers; ++l) {
+        if (hit[l] < blocks_max) blocks[hit[l]].refs--;
+      }
+      refused++;
+      return false;
+    }
+    for (uint8_t l = 0; l < preset_layers; ++l) {
+      uint16_t b = block_of[p][t][l];
+      if (hit[l] == blocks_max) {
+        hit[l] = find(rec[l], n[l], h[l]);  // an earlier layer may have just made it
+        if (hit[l] < blocks_max) blocks[hit[l]].refs++;
+      }
+      if (hit[l] < blocks_max) {
+        block_of[p][t][l] = hit[l];
+        unref(b);
+      } else if (blocks[b].refs == 1) {
+        resize(b, n[l]);
+        memcpy(arena + blocks[b].start, rec[l], n[l]);
+        blocks[b].hash = h[l];
+      } else {
+        block_of[p][t][l] = alloc(rec[l], n[l]);
+        unref(b);
+      }
+    }
+    return true;
+  }
+
+  // hold every preset as it is now. Its blocks gain a ref, so they're copied on write rather
+  // than changed: free until presets change, then only the layers that did cost arena bytes
+  void snapshot() {
+    drop_snapshot();
+    memcpy(held_of, block_of, sizeof(block_of));
+    const uint16_t* b = &held_of[0][0][0];
+    for (uint16_t i = 0; i < layer_refs; ++i) blocks[b[i]].refs++;
+    held = true;
+  }
+
+  void drop_snapshot() {
+    if (!held) return;
+    const uint16_t* b = &held_of[0][0][0];
+    for (uint16_t i = 0; i < layer_refs; ++i) unref(b[i]);
+    held = false;
+  }
+
+  // every preset back as it was at snapshot(), which is used up
+  void restore() {
+    if (!held) return;
+    uint16_t* b = &block_of[0][0][0];
+    const uint16_t* h = &held_of[0][0][0];
+    for (uint16_t i = 0; i < layer_refs; ++i) {
+      uint16_t was = b[i];
+      b[i] = h[i];  // its ref moves over from the snapshot
+      unref(was);
+    }
+    held = false;
+  }
+
+  void report() {
+    uint32_t logical = 0;  // without sharing
+    for (uint16_t b = 0; b < blocks_max; ++b) logical += (uint32_t)blocks[b].refs * blocks[b].size;
+    Serial.print(F("Preset store: "));
+    Serial.print(used);
+    Serial.print(F("/"));
+    Serial.print(bytes);
+    Serial.print(F(" bytes in "));
+    Serial.print(blocks_used);
+    Serial.print(F("/"));
+    Serial.print(blocks_max);
+    Serial.print(F(" blocks (unshared "));
+    Serial.print(logical);
+    Serial.print(F(", raw "));
+    Serial.print((uint32_t)presets * tracks * steps * preset_layers);
+    Serial.print(F("), peak: "));
+    Serial.print(peak);
+    Serial.print(F(", refused: "));
+    Serial.println(refused);
+  }
+};
+#endif
@@ -95,13 +95,56 @@ const char nb14[] = "/M4SEQ32/saved_notes14.json";
 const char nb15[] = "/M4SEQ32/saved_notes15.json";
 const char nb16[] = "/M4SEQ32/saved_notes16.json";
 const char *const nfiles[] = {nb1,nb2,nb3,nb4,nb5,nb6,nb7,nb8,nb9,nb10,nb11,nb12,nb13,nb14,nb15,nb16};
+const char nub1[] = "/M4SEQ32/saved_nudges.json";
+const char nub2[] = "/M4SEQ32/saved_nudges2.json";
+const char nub3[] = "/M4SEQ32/saved_nudges3.json";
+const char nub4[] = "/M4SEQ32/saved_nudges4.json";
+const char nub5[] = "/M4SEQ32/saved_nudges5.json";
+const char nub6[] = "/M4SEQ32/saved_nudges6.json";
+const char nub7[] = "/M4SEQ32/saved_nudges7.json";
+const char nub8[] = "/M4SEQ32/saved_nudges8.json";
+const char nub9[] = "/M4SEQ32/saved_nudges9.json";
+const char nub10[] = "/M4SEQ32/saved_nudges10.json";
+const char nub11[] = "/M4SEQ32/saved_nudges11.json";
+const char nub12[] = "/M4SEQ32/saved_nudges12.json";
+const char nub13[] = "/M4SEQ32/saved_nudges13.json";
+const char nub14[] = "/M4SEQ32/saved_nudges14.json";
+const char nub15[] = "/M4SEQ32/saved_nudges15.json";
+const char nub16[] = "/M4SEQ32/saved_nudges16.json";
+const char *const nudgefiles[] = {nub1,nub2,nub3,nub4,nub5,nub6,nub7,nub8,nub9,nub10,nub11,nub12,nub13,nub14,nub15,nub16};
+const char chb1[] = "/M4SEQ32/saved_chords.json";
+const char chb2[] = "/M4SEQ32/saved_chords2.json";
+const char chb3[] = "/M4SEQ32/saved_chords3.json";
+const char chb4[] = "/M4SEQ32/saved_chords4.json";
+const char chb5[] = "/M4SEQ32/saved_chords5.json";
+const char chb6[] = "/M4SEQ32/saved_chords6.json";
+const char chb7[] = "/M4SEQ32/saved_chords7.json";
+const char chb8[] = "/M4SEQ32/saved_chords8.json";
+const char chb9[] = "/M4SEQ32/saved_chords9.json";
+const char chb10[] = "/M4SEQ32/saved_chords10.json";
+const char chb11[] = "/M4SEQ32/saved_chords11.json";
+const char chb12[] = "/M4SEQ32/saved_chords12.json";
+const char chb13[] = "/M4SEQ32/saved_chords13.json";
+const char chb14[] = "/M4SEQ32/saved_chords14.json";
+const char chb15[] = "/M4SEQ32/saved_chords15.json";
+const char chb16[] = "/M4SEQ32/saved_chords16.json";
+const char *const chordfiles[] = {chb1,chb2,chb3,chb4,chb5,chb6,chb7,chb8,chb9,chb10,chb11,chb12,chb13,chb14,chb15,chb16};
 const char settings_file[] = "/M4SEQ32/saved_settings.json";
+const char song_file[] = "/M4SEQ32/saved_song.json";
+const char journal_file[] = "/M4SEQ32/journal.bin";
 
-#include "saved_patterns_json.h"
-#include "saved_notes_json.h"
-#include "saved_velocities_json.h"
-#include "saved_probabilities_json.h"
-#include "saved_gates_json.h"
-#include "saved_settings_json.h"
+// compiled-in factory defaults: one layer of one preset each, copied straight into the sequencer
+typedef bool PatternBank[numtracks][num_steps];
+typedef uint8_t StepBank[numtracks][num_steps];
+typedef int8_t NudgeBank[numtracks][num_steps];
+
+#include "saved_patterns.h"
+#include "saved_notes.h"
+#include "saved_velocities.h"
+#include "saved_probabilities.h"
+#include "saved_gates.h"
+#include "saved_nudges.h"
+#include "saved_chords.h"
+#include "saved_settings.h"
 
 #endif
\ No newline at end of file
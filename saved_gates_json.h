@@ -1,12 +0,0 @@
-/**
- * saved_gates.h -- Factory-default Gate Lengths for Multitrack Sequencer (for Feather M4 Express)
- * (only used if non on Flash / if factory reset)
- * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
- * 04 Nov 2023 - @apatchworkboy / Marci
- * Based on https://github.com/todbot/picostepseq/
- * 28 Apr 2023 - @todbot / Tod Kurt
- * 15 Aug 2022 - @todbot / Tod Kurt
- */
- 
-const char gate_bank1[] = "[[9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9],[9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9],[9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9],[9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9],[9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9],[9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9],[9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9],[9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9]]";
-const char *const gatebanks[] = {gate_bank1,gate_bank1,gate_bank1,gate_bank1,gate_bank1,gate_bank1,gate_bank1,gate_bank1,gate_bank1,gate_bank1,gate_bank1,gate_bank1,gate_bank1,gate_bank1,gate_bank1,gate_bank1};
\ No newline at end of file
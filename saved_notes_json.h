@@ -1,12 +0,0 @@
-/**
- * saved_notes.h -- Factory-default NOTE mode notes for Multitrack Sequencer (for Feather M4 Express)
- * (only used if non on Flash / if factory reset)
- * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
- * 04 Nov 2023 - @apatchworkboy / Marci
- * Based on https://github.com/todbot/picostepseq/
- * 28 Apr 2023 - @todbot / Tod Kurt
- * 15 Aug 2022 - @todbot / Tod Kurt
- */
-
-const char note_bank1[] = "[[0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12],[24,12,24,12,0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12,0,12,24,12],[12,24,0,12,12,24,0,12,12,24,0,12,12,24,0,12,12,24,0,12,12,24,0,12,12,24,0,12,12,24,0,12],[0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12],[0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12],[0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12],[0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12],[0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12,0,12,24,12,24,12,24,12]]";
-const char *const notebanks[] = {note_bank1,note_bank1,note_bank1,note_bank1,note_bank1,note_bank1,note_bank1,note_bank1,note_bank1,note_bank1,note_bank1,note_bank1,note_bank1,note_bank1,note_bank1,note_bank1};
\ No newline at end of file
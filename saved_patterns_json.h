@@ -1,12 +0,0 @@
-/**
- * saved_patterns.h -- Factory-default sequencer patterns for Multitrack Sequencer (for Feather M4 Express)
- * (only used if non on Flash / if factory reset)
- * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
- * 04 Nov 2023 - @apatchworkboy / Marci
- * Based on https://github.com/todbot/picostepseq/
- * 28 Apr 2023 - @todbot / Tod Kurt
- * 15 Aug 2022 - @todbot / Tod Kurt
- */
-
-const char pat_bank1[] = "[[1,0,0,0,0,0,0,0,1,0,0,0,0,0,0,0,1,0,0,0,0,0,0,0,1,0,0,0,0,0,0,1],[0,0,0,0,1,0,0,0,0,0,0,0,1,0,0,0,0,0,0,0,1,0,0,0,0,0,0,0,1,0,0,1],[0,1,1,1,0,1,1,1,0,1,1,1,0,1,1,1,0,1,1,1,0,1,1,1,0,1,1,1,0,1,1,1],[0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0],[0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0],[0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0],[0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0],[1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1]]";
-const char *const patterns[] = {pat_bank1,pat_bank1,pat_bank1,pat_bank1,pat_bank1,pat_bank1,pat_bank1,pat_bank1,pat_bank1,pat_bank1,pat_bank1,pat_bank1,pat_bank1,pat_bank1,pat_bank1,pat_bank1};
@@ -0,0 +1,15 @@
+/**
+ * saved_settings.h -- Factory-default Settings for Multitrack Sequencer (for Feather M4 Express)
+ * (only used if non on Flash / if factory reset)
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ * Based on https://github.com/todbot/picostepseq/
+ * 28 Apr 2023 - @todbot / Tod Kurt
+ * 15 Aug 2022 - @todbot / Tod Kurt
+ */
+
+// Tempo(1) & StepSize(1) & Transpose(1), Track_Notes(8), CtrlNotes(3), Channels(9 (8 tracks + control)), Swing(1, unused - see Grooves), Brightness(1), Modes(8), HzV(2), Divisions(8), Offsets(8), Lengths(8), TriggerWidths(8), ClockOutPPQN(1), ClockInPPQN(1), Grooves(8), Multipliers(8), MidiInRoutes(16), Scales(8), Roots(8), Degrees(8)
+
+constexpr int16_t factory_settings[] = { 120, 6, 0, 36, 37, 38, 39, 40, 41, 42, 43, 12, 13, 14, 1, 1, 1, 1, 2, 3, 4, 5, 16, 0, 50, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 31, 31, 31, 31, 31, 31, 31, 31, 0, 0, 0, 0, 0, 0, 0, 0, 24, 24, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+constexpr uint8_t settings_fields = sizeof(factory_settings) / sizeof(factory_settings[0]);
+static_assert(settings_fields == 125, "one default per settings field");
@@ -1,12 +0,0 @@
-/**
- * saved_velocities.h -- Factory-default Velocities (& CC Mode values) for Multitrack Sequencer (for Feather M4 Express)
- * (only used if non on Flash / if factory reset)
- * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
- * 04 Nov 2023 - @apatchworkboy / Marci
- * Based on https://github.com/todbot/picostepseq/
- * 28 Apr 2023 - @todbot / Tod Kurt
- * 15 Aug 2022 - @todbot / Tod Kurt
- */
- 
-const char vel_bank1[] = "[[127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40],[80,40,80,40,127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40,127,40,80,40],[40,80,127,40,40,80,127,40,40,80,127,40,40,80,127,40,40,80,127,40,40,80,127,40,40,80,127,40,40,80,127,40],[127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40],[127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40],[127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40],[127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40],[127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40,127,40,80,40,80,40,80,40]]";
-const char *const velocities[] = {vel_bank1,vel_bank1,vel_bank1,vel_bank1,vel_bank1,vel_bank1,vel_bank1,vel_bank1,vel_bank1,vel_bank1,vel_bank1,vel_bank1,vel_bank1,vel_bank1,vel_bank1,vel_bank1};
\ No newline at end of file
@@ -14,6 +14,33 @@
 //
 
 uint32_t last_sequence_write_millis = 0;
+uint32_t save_started_millis;
+
+// layer l of preset p, ROM default if the file is missing or rejected
+template<typename T>
+bool bank_read(const char* path, uint8_t l, uint8_t p, const T (&rom)[numtracks][num_steps], int32_t lo, int32_t hi) {
+  T bank[numtracks][num_steps];
+  File32 file = fatfs.open(path, FILE_READ);
+  bool ok = false;
+  if (file) {
+    ok = json_read_rows(file, &bank[0][0], numtracks, num_steps, lo, hi);
+    file.close();
+    if (!ok && marci_debug) {
+      Serial.print(F("bank_read: rejected "));
+      Serial.println(path);
+    }
+  }
+  if (!ok) {
+    if (marci_debug) Serial.println(F("bank_read: Using ROM default..."));
+    memcpy(bank, rom, sizeof(bank));
+  }
+  for (uint8_t t = 0; t < numtracks; ++t) {
+    if (!seqr.set_layer(p, t, l, (const uint8_t*)bank[t]) && marci_debug) Serial.println(F("bank_read: preset store full"));
+  }
+  bank_hashes[l][p] = ok ? bank_hash(l, p) : 0;
+  return ok;
+}
+
 // write all notes to "disk"
 // write all velocities to "disk"
 void notes_write() {
@@ -22,31 +49,17 @@ void notes_write() {
 
   for (uint8_t p = 0; p < numpresets; ++p) {
     if (marci_debug) Serial.println(p);
-    DynamicJsonDocument doc(8192);  // assistant said 6144
-    for (int j = 0; j < numtracks; j++) {
-      JsonArray notes_array = doc.createNestedArray();
-      for (int i = 0; i < num_steps; i++) {
-        int s = seqr.notes[p][j][i];
-        notes_array.add(s);
-      }
-    }
     toggle_write();
-    fatfs.remove(nfiles[p]);
-    File32 nfile = fatfs.open(nfiles[p], FILE_WRITE);
-    if (!nfile) {
-      if (marci_debug) Serial.println(F("notes_write: Failed to create file"));
+    if (!bank_save(NOTE_LAYER, p)) {
+      if (marci_debug) Serial.println(F("notes_write: Failed to write file"));
       if (marci_debug) Serial.println(p);
       return;
     }
-    if (serializeJson(doc, nfile) == 0) {
-      if (marci_debug) Serial.println(F("notes_write: Failed to write to file"));
-      if (marci_debug) Serial.println(p);
-    }
-    nfile.close();
-    doc.clear();
     if (marci_debug) Serial.println(p);
   }
   if (marci_debug) Serial.println(F("notes saved"));
+  save_millis = millis() - save_started_millis;
+  journal_clear();  // every bank is on flash now
   sure = 0;
   presetmode = 0;
   divedit = 0 ;
@@ -59,34 +72,52 @@ void gates_write() {
   if (marci_debug) Serial.println(F("gates_write"));
   last_sequence_write_millis = millis();
   for (uint8_t p = 0; p < numpresets; ++p) {
-    DynamicJsonDocument doc(8192);  // assistant said 6144
-    for (int j = 0; j < numtracks; j++) {
-      JsonArray prob_array = doc.createNestedArray();
-      for (int i = 0; i < num_steps; i++) {
-        int s = seqr.gates[p][j][i];
-        prob_array.add(s);
-      }
+    toggle_write();
+    if (!bank_save(GATE_LAYER, p)) {
+      if (marci_debug) Serial.println(F("gates_write: Failed to write file"));
+      if (marci_debug) Serial.println(p);
+      return;
     }
+    if (marci_debug) Serial.print(F("Gate bank saved"));
+    if (marci_debug) Serial.println(p);
+  }
+  if (marci_debug) Serial.println(F("gates saved"));
+  nudges_write();
+}
 
+// write all step microtiming to "disk"
+void nudges_write() {
+  if (marci_debug) Serial.println(F("nudges_write"));
+  last_sequence_write_millis = millis();
+  for (uint8_t p = 0; p < numpresets; ++p) {
     toggle_write();
-    fatfs.remove(gfiles[p]);
-    File32 file = fatfs.open(gfiles[p], FILE_WRITE);
-    if (!file) {
-      if (marci_debug) Serial.println(F("gates_write: Failed to create file"));
+    if (!bank_save(NUDGE_LAYER, p)) {
+      if (marci_debug) Serial.println(F("nudges_write: Failed to write file"));
       if (marci_debug) Serial.println(p);
       return;
     }
-    if (serializeJson(doc, file) == 0) {
-      if (marci_debug) Serial.println(F("gates_write: Failed to write to file"));
+    if (marci_debug) Serial.print(F("Nudge bank saved"));
+    if (marci_debug) Serial.println(p);
+  }
+  if (marci_debug) Serial.println(F("nudges saved"));
+  chords_write();
+}
+
+// write all step chord shapes to "disk"
+void chords_write() {
+  if (marci_debug) Serial.println(F("chords_write"));
+  last_sequence_write_millis = millis();
+  for (uint8_t p = 0; p < numpresets; ++p) {
+    toggle_write();
+    if (!bank_save(CHORD_LAYER, p)) {
+      if (marci_debug) Serial.println(F("chords_write: Failed to write file"));
       if (marci_debug) Serial.println(p);
+      return;
     }
-    file.close();
-    doc.clear();
-    if (marci_debug) Serial.print(F("Gate bank saved"));
+    if (marci_debug) Serial.print(F("Chord bank saved"));
     if (marci_debug) Serial.println(p);
-    //serializeJson(doc, Serial);
   }
-  if (marci_debug) Serial.println(F("gates saved"));
+  if (marci_debug) Serial.println(F("chords saved"));
   notes_write();
 }
 
@@ -96,89 +127,125 @@ void probabilities_write() {
   last_sequence_write_millis = millis();
 
   for (uint8_t p = 0; p < numpresets; ++p) {
-    DynamicJsonDocument doc(8192);  // assistant said 6144
-    for (int j = 0; j < numtracks; j++) {
-      JsonArray prob_array = doc.createNestedArray();
-      for (int i = 0; i < num_steps; i++) {
-        int s = seqr.probs[p][j][i];
-        prob_array.add(s);
-      }
-    }
-
     toggle_write();
-    fatfs.remove(prbfiles[p]);
-    File32 file = fatfs.open(prbfiles[p], FILE_WRITE);
-    if (!file) {
-      if (marci_debug) Serial.println(F("probabilities_write: Failed to create file"));
+    if (!bank_save(PROB_LAYER, p)) {
+      if (marci_debug) Serial.println(F("probabilities_write: Failed to write file"));
       if (marci_debug) Serial.println(p);
       return;
     }
-    if (serializeJson(doc, file) == 0) {
-      if (marci_debug) Serial.println(F("probabilities_write: Failed to write to file"));
-      if (marci_debug) Serial.println(p);
-    }
-    file.close();
-    doc.clear();
     if (marci_debug) Serial.print(F("Probability Bank Saved"));
     if (marci_debug) Serial.println(p);
-    //serializeJson(doc, Serial);
   }
   if (marci_debug) Serial.println(F("probabilities saved"));
   gates_write();
 }
 
-// write all settings to "disk"
-void settings_write() {
-  if (marci_debug) Serial.println(F("settings_write"));
-  last_sequence_write_millis = millis();
-
-  DynamicJsonDocument doc(8192);  // assistant said 6144
-  JsonArray set_array = doc.createNestedArray();
-  set_array.add(tempo);
-  set_array.add(cfg.step_size);
-  set_array.add(transpose);
+// all settings into set_array, in settings file order
+void settings_pack(int16_t* set_array) {
+  uint8_t z = 0;
+  set_array[z++] = tempo + 0.5f;
+  set_array[z++] = cfg.step_size;
+  set_array[z++] = transpose;
   for (uint8_t i = 0; i < 8; ++i) {
-    set_array.add(seqr.track_notes[i]);
+    set_array[z++] = seqr.track_notes[i];
   }
   for (uint8_t i = 0; i < 3; ++i) {
-    set_array.add(seqr.ctrl_notes[i]);
+    set_array[z++] = seqr.ctrl_notes[i];
   }
   for (uint8_t i = 0; i < 8; ++i) {
-    set_array.add(seqr.track_chan[i]);
+    set_array[z++] = seqr.track_chan[i];
   }
-  set_array.add(seqr.ctrl_chan);
-  set_array.add(seqr.swing);
-  set_array.add(brightness);
+  set_array[z++] = seqr.ctrl_chan;
+  set_array[z++] = 0;  // was global swing, now per-track grooves (below)
+  set_array[z++] = brightness;
   for (uint8_t i = 0; i < 8; ++i) {
-    set_array.add(seqr.modes[i]);
+    set_array[z++] = seqr.modes[i];
   }
   for (uint8_t i = 0; i < 2; ++i) {
-    set_array.add(hzv[i]);
+    set_array[z++] = hzv[i];
+  }
+  for (uint8_t i = 0; i < 8; ++i) {
+    set_array[z++] = seqr.divs[i];
   }
   for (uint8_t i = 0; i < 8; ++i) {
-    set_array.add(seqr.divs[i]);
+    set_array[z++] = seqr.offsets[i];
   }
   for (uint8_t i = 0; i < 8; ++i) {
-    set_array.add(seqr.offsets[i]);
+    set_array[z++] = seqr.lengths[i];
   }
   for (uint8_t i = 0; i < 8; ++i) {
-    set_array.add(seqr.lengths[i]);
+    set_array[z++] = seqr.trig_lens[i];
   }
+  set_array[z++] = clock_timer.out_ppqn;
+  set_array[z++] = clock_in.ppqn;
+  for (uint8_t i = 0; i < 8; ++i) {
+    set_array[z++] = seqr.grooves[i];
+  }
+  for (uint8_t i = 0; i < 8; ++i) {
+    set_array[z++] = seqr.muls[i];
+  }
+  for (uint8_t i = 0; i < 16; ++i) {
+    set_array[z++] = midi_routes[i];
+  }
+  for (uint8_t i = 0; i < 8; ++i) {
+    set_array[z++] = seqr.scales[i];
+  }
+  for (uint8_t i = 0; i < 8; ++i) {
+    set_array[z++] = seqr.roots[i];
+  }
+  for (uint8_t i = 0; i < 8; ++i) {
+    set_array[z++] = seqr.degrees[i];
+  }
+}
+
+// settings file contents, for journal_replace()
+size_t settings_file_write(uint8_t, uint8_t, const char* path) {
+  int16_t set_array[settings_fields];
+  settings_pack(set_array);
+  File32 file = fatfs.open(path, FILE_WRITE);
+  if (!file) return 0;
+  size_t n = json_write_rows(file, set_array, 1, settings_fields);
+  file.close();
+  return n;
+}
+
+// write all settings to "disk"
+void settings_write() {
+  if (marci_debug) Serial.println(F("settings_write"));
+  last_sequence_write_millis = millis();
   toggle_write();
-  fatfs.remove(settings_file);
-  File32 file = fatfs.open(settings_file, FILE_WRITE);
-  if (!file) {
-    if (marci_debug) Serial.println(F("settings_write: Failed to create file"));
+  if (journal_replace(journal_settings, 0, settings_file_write) == 0) {
+    if (marci_debug) Serial.println(F("settings_write: Failed to write file"));
     return;
   }
-  if (serializeJson(doc, file) == 0) {
-    if (marci_debug) Serial.println(F("settings_write: Failed to write to file"));
+  if (marci_debug) Serial.println(F("settings saved"));
+  song_write();
+}
+
+// song file contents, for journal_replace(): one [presets(8), repeats] array per entry
+size_t song_file_write(uint8_t, uint8_t, const char* path) {
+  uint8_t entries[song_max][numtracks + 1];
+  for (uint8_t e = 0; e < song_len; ++e) {
+    for (uint8_t i = 0; i < numtracks; ++i) {
+      entries[e][i] = song[e].presets[i];
+    }
+    entries[e][numtracks] = song[e].repeats;
   }
+  File32 file = fatfs.open(path, FILE_WRITE);
+  if (!file) return 0;
+  size_t n = json_write_rows(file, &entries[0][0], song_len, numtracks + 1);
   file.close();
-  doc.clear();
-  //if (marci_debug) Serial.print(F("saved_settings_json = \""));
-  //serializeJson(doc, Serial);
-  if (marci_debug) Serial.println(F("settings saved"));
+  return n;
+}
+
+// write song (preset chain) to "disk"
+void song_write() {
+  if (marci_debug) Serial.println(F("song_write"));
+  toggle_write();
+  if (journal_replace(journal_song, 0, song_file_write) == 0) {
+    if (marci_debug) Serial.println(F("song_write: Failed to write file"));
+  }
+  if (marci_debug) Serial.println(F("song saved"));
   probabilities_write();
 }
 
@@ -189,28 +256,12 @@ void velocities_write() {
 
   for (uint8_t p = 0; p < numpresets; ++p) {
     if (marci_debug) Serial.println(p);
-    DynamicJsonDocument doc(8192);  // assistant said 6144
-    for (int j = 0; j < numtracks; j++) {
-      JsonArray vels_array = doc.createNestedArray();
-      for (int i = 0; i < num_steps; i++) {
-        int s = seqr.vels[p][j][i];
-        vels_array.add(s);
-      }
-    }
     toggle_write();
-    fatfs.remove(vfiles[p]);
-    File32 vfile = fatfs.open(vfiles[p], FILE_WRITE);
-    if (!vfile) {
-      if (marci_debug) Serial.println(F("velocities_write: Failed to create file"));
+    if (!bank_save(VEL_LAYER, p)) {
+      if (marci_debug) Serial.println(F("velocities_write: Failed to write file"));
       if (marci_debug) Serial.println(p);
       return;
     }
-    if (serializeJson(doc, vfile) == 0) {
-      if (marci_debug) Serial.println(F("velocities_write: Failed to write to file"));
-      if (marci_debug) Serial.println(p);
-    }
-    vfile.close();
-    doc.clear();
     if (marci_debug) Serial.println(p);
   }
   if (marci_debug) Serial.println(F("velocities saved"));
@@ -228,6 +279,7 @@ void sequences_write() {
   }
   if (marci_debug) Serial.println(F("millis ok"));
   last_sequence_write_millis = millis();
+  save_started_millis = millis();
   if (marci_debug) Serial.println(F("key color"));
   trellis.setPixelColor(59, R127);
   if (marci_debug) Serial.println(F("show done"));
@@ -235,42 +287,12 @@ void sequences_write() {
   if (marci_debug) Serial.println(F("sequences_write"));
   for (uint8_t p = 0; p < numpresets; ++p) {
     if (marci_debug) Serial.println(p);
-    DynamicJsonDocument doc(8192);  // assistant said 6144
-    for (uint8_t j = 0; j < numtracks; j++) {
-      if (marci_debug) Serial.println(j);
-      JsonArray seq_array = doc.createNestedArray();
-      for (uint8_t i = 0; i < num_steps; i++) {
-        if (marci_debug) {
-          Serial.print(i);
-          Serial.print(" = ");
-          Serial.println(seqr.seqs[p][j][i]);
-        }
-        auto s = seqr.seqs[p][j][i];
-        seq_array.add(s);
-      }
-    }
-    if (marci_debug) Serial.println(F("sequences buffered to doc"));
-    if (marci_debug) Serial.println(F("led flash"));
     toggle_write();
-    if (marci_debug) Serial.println(F("remove old file"));
-    fatfs.remove(pfiles[p]);
-    if (marci_debug) Serial.println(F("create new file"));
-    File32 pfile = fatfs.open(pfiles[p], FILE_WRITE);
-    if (!pfile) {
-      if (marci_debug) Serial.println(F("sequences_write: Failed to create file"));
+    if (!bank_save(SEQ_LAYER, p)) {
+      if (marci_debug) Serial.println(F("sequences_write: Failed to write file"));
       if (marci_debug) Serial.println(p);
       return;
     }
-    if (serializeJson(doc, pfile) == 0) {
-      if (marci_debug) Serial.println(F("sequences_write: Failed to write to file"));
-      if (marci_debug) Serial.println(p);
-    }
-    if (marci_debug) Serial.println(F("stored!"));
-    pfile.close();
-    if (marci_debug) Serial.println(F("clear buffer"));
-    doc.clear();
-    //if (marci_debug) Serial.print(F("saved_sequences_json = \""));
-    //serializeJson(doc, Serial);
     if (marci_debug) Serial.println(F("sequence saved"));
     if (marci_debug) Serial.println(p);
   }
@@ -278,72 +300,10 @@ void sequences_write() {
   velocities_write();
 }
 
-void pattern_reset() {
-  trellis.setPixelColor(59, R127);
-  if (marci_debug) Serial.println(F("pat_bank_resets"));
-  for (uint8_t p = 0; p < numpresets; ++p) {
-    if (marci_debug) Serial.println(p);
-    DynamicJsonDocument doc(8192);  // assistant said 6144
-    DeserializationError error = deserializeJson(doc, patterns[p]);
-    if (error) {
-      if (marci_debug) Serial.print(F("pat_bank_reset: deserialize failed: "));
-      if (marci_debug) Serial.println(p);
-      if (marci_debug) Serial.println(error.c_str());
-      return;
-    }
-    for (int j = 0; j < numtracks; j++) {
-      JsonArray seq_array = doc[j];
-      for (int i = 0; i < num_steps; i++) {
-        seqr.seqs[p][j][i] = seq_array[i];
-      }
-      doc.clear();
-    }
-  }
-  if (marci_debug) Serial.println(F("vel_bank_resets"));
-  for (uint8_t p = 0; p < numpresets; ++p) {
-    DynamicJsonDocument doc2(8192);  // assistant said 6144
-    DeserializationError error2 = deserializeJson(doc2, velocities[p]);
-    if (error2) {
-      if (marci_debug) Serial.print(F("vel_bank_reset: deserialize failed: "));
-      if (marci_debug) Serial.println(p);
-      if (marci_debug) Serial.println(error2.c_str());
-      return;
-    }
-    for (int j = 0; j < numtracks; j++) {
-      JsonArray vel_array = doc2[j];
-      for (int i = 0; i < num_steps; i++) {
-        seqr.vels[p][j][i] = vel_array[i];
-      }
-      doc2.clear();
-    }
-  }
-  if (marci_debug) Serial.println(F("note_bank_resets"));
-  for (uint8_t p = 0; p < numpresets; ++p) {
-    DynamicJsonDocument docn(8192);  // assistant said 6144
-    DeserializationError errorn = deserializeJson(docn, notebanks[p]);
-    if (errorn) {
-      if (marci_debug) Serial.print(F("note_bank_reset: deserialize failed: "));
-      if (marci_debug) Serial.println(p);
-      if (marci_debug) Serial.println(errorn.c_str());
-      return;
-    }
-    for (int j = 0; j < numtracks; j++) {
-      JsonArray note_array = docn[j];
-      for (int i = 0; i < num_steps; i++) {
-        seqr.notes[p][j][i] = note_array[i];
-      }
-      docn.clear();
-    }
-  }
+// factory settings, straight from the compiled-in defaults (see saved_settings.h), or a set
+// settings_pack() made
+void settings_reset(const int16_t* set_array = factory_settings) {
   if (marci_debug) Serial.println(F("settings_reset"));
-  DynamicJsonDocument doc3(8192);  // assistant said 6144
-  DeserializationError error3 = deserializeJson(doc3, settings);
-  if (error3) {
-    if (marci_debug) Serial.print(F("settings_reset: deserialize failed: "));
-    if (marci_debug) Serial.println(error3.c_str());
-    return;
-  }
-  JsonArray set_array = doc3[0];
   tempo = set_array[0];
   cfg.step_size = set_array[1];
   transpose = set_array[2];
@@ -361,11 +321,10 @@ void pattern_reset() {
     z++;
   }
   seqr.ctrl_chan = set_array[z];
-  seqr.swing = set_array[z + 1];
   brightness = set_array[z + 2];
   z = z + 3;
   for (uint8_t i = 0; i < 8; ++i) {
-    seqr.modes[i] = set_array[z] > 0 ? set_array[z] : TRIGATE;
+    seqr.modes[i] = set_array[z] > 0 ? (track_mode)set_array[z] : TRIGATE;
     z++;
   }
   for (uint8_t i = 0; i < 2; ++i) {
@@ -384,45 +343,69 @@ void pattern_reset() {
     seqr.lengths[i] = set_array[z];
     z++;
   }
-  doc3.clear();
-  if (marci_debug) Serial.println(F("prob_bank_resets"));
-  for (uint8_t p = 0; p < numpresets; ++p) {
-    DynamicJsonDocument doc4(8192);  // assistant said 6144
-    DeserializationError error4 = deserializeJson(doc4, probabilities[p]);
-    if (error4) {
-      if (marci_debug) Serial.print(F("prob_bank_reset: deserialize failed: "));
-      if (marci_debug) Serial.println(p);
-      if (marci_debug) Serial.println(error4.c_str());
-      return;
-    }
-    for (int j = 0; j < numtracks; j++) {
-      JsonArray prob_array = doc4[j];
-      for (int i = 0; i < num_steps; i++) {
-        seqr.probs[p][j][i] = prob_array[i];
-      }
-      doc4.clear();
-    }
+  for (uint8_t i = 0; i < 8; ++i) {
+    seqr.trig_lens[i] = set_array[z];
+    z++;
   }
-  if (marci_debug) Serial.println(F("gate_banks_reset"));
-  for (uint8_t p = 0; p < numpresets; ++p) {
-    DynamicJsonDocument doc5(8192);  // assistant said 6144
-    DeserializationError error5 = deserializeJson(doc5, gatebanks[p]);
-    if (error5) {
-      if (marci_debug) {
-        Serial.print(F("gate_bank_reset: deserialize failed: "));
-        Serial.println(p);
-        Serial.println(error5.c_str());
-      }
-      return;
-    }
-    for (int j = 0; j < numtracks; j++) {
-      JsonArray gate_array = doc5[j];
-      for (int i = 0; i < num_steps; i++) {
-        seqr.gates[p][j][i] = gate_array[i];
-      }
-      doc5.clear();
-    }
+  clock_timer.out_ppqn = set_array[z];
+  z++;
+  clock_in.ppqn = set_array[z];
+  z++;
+  for (uint8_t i = 0; i < 8; ++i) {
+    seqr.grooves[i] = set_array[z];
+    z++;
+  }
+  for (uint8_t i = 0; i < 8; ++i) {
+    seqr.muls[i] = set_array[z];
+    z++;
+  }
+  for (uint8_t i = 0; i < 16; ++i) {
+    midi_routes[i] = set_array[z];
+    z++;
+  }
+  for (uint8_t i = 0; i < 8; ++i) {
+    seqr.scales[i] = set_array[z];
+    z++;
+  }
+  for (uint8_t i = 0; i < 8; ++i) {
+    seqr.roots[i] = set_array[z];
+    z++;
+  }
+  for (uint8_t i = 0; i < 8; ++i) {
+    seqr.degrees[i] = set_array[z];
+    seqr.set_scale(i);
+    z++;
   }
+}
+
+// factory reset: every bank is a copy of its compiled-in default (see saved_*.h)
+void undo_hold_reset();  // undo.h
+
+void pattern_reset() {
+  static_assert(sizeof(seqr.seqs) == sizeof(PatternBank), "pattern default doesn't match the sequencer");
+  static_assert(sizeof(seqr.notes) == sizeof(StepBank), "step default doesn't match the sequencer");
+  static_assert(sizeof(seqr.nudges) == sizeof(NudgeBank), "nudge default doesn't match the sequencer");
+  undo_hold_reset();
+  trellis.setPixelColor(59, R127);
+  if (marci_debug) Serial.println(F("bank_resets"));
+  for (uint8_t p = 0; p < numpresets; ++p) {
+    for (uint8_t t = 0; t < numtracks; ++t) {
+      TrackPreset<num_steps> tp;
+      memcpy(tp.layer[SEQ_LAYER], (*patterns[p])[t], num_steps);
+      memcpy(tp.layer[VEL_LAYER], (*velocities[p])[t], num_steps);
+      memcpy(tp.layer[NOTE_LAYER], (*notebanks[p])[t], num_steps);
+      memcpy(tp.layer[PROB_LAYER], (*probabilities[p])[t], num_steps);
+      memcpy(tp.layer[GATE_LAYER], (*gatebanks[p])[t], num_steps);
+      memcpy(tp.layer[NUDGE_LAYER], (*nudgebanks[p])[t], num_steps);
+      memcpy(tp.layer[CHORD_LAYER], (*chordbanks[p])[t], num_steps);
+      seqr.put_preset(p, t, tp);
+    }
+  }
+  settings_reset();
+  song_len = 0;
+  song_on = false;
+  seqr.touch_all();
+  last_sequence_write_millis = 0;  // always a checkpoint, never left to the journal
   sequences_write();
   trellis.show();
 }
@@ -431,49 +414,7 @@ void pattern_reset() {
 void sequences_read() {
   if (marci_debug) Serial.println(F("sequences_read"));
   for (uint8_t p = 0; p < numpresets; ++p) {
-    DynamicJsonDocument doc(8192);  // assistant said 6144
-
-    File32 pfile = fatfs.open(pfiles[p], FILE_READ);
-    if (!pfile) {
-      if (marci_debug) Serial.println(F("sequences_read: no sequences file. Using ROM default..."));
-      DeserializationError error = deserializeJson(doc, patterns[p]);
-      if (error) {
-        if (marci_debug) {
-          Serial.print(F("sequences_read: deserialize default failed: "));
-          Serial.println(p);
-          Serial.println(error.c_str());
-        }
-        return;
-      }
-    } else {
-      DeserializationError error = deserializeJson(doc, pfile);  // inputLength);
-      if (error) {
-        if (marci_debug) {
-          Serial.print(F("sequences_read: deserialize failed: "));
-          Serial.println(p);
-          Serial.println(error.c_str());
-        }
-        return;
-      }
-    }
-
-    for (int j = 0; j < numtracks; j++) {
-      JsonArray seq_array = doc[j];
-      if (marci_debug) {
-          Serial.print("Preset "); 
-          Serial.print(p);
-          Serial.print(", Track ");
-          Serial.println(j);
-      }
-      for (int i = 0; i < num_steps; i++) {
-        seqr.seqs[p][j][i] = seq_array[i];
-      }
-    }
-    pfile.close();
-    doc.clear();
-    if (marci_debug) {
-      Serial.println(F("Pattern Bank OK"));
-    }
+    bank_read(pfiles[p], SEQ_LAYER, p, *patterns[p], 0, 1);
   }
   if (marci_debug) Serial.println(F("All patterns loaded"));
   trellis.show();
@@ -483,44 +424,7 @@ void sequences_read() {
 void velocities_read() {
   if (marci_debug) Serial.println(F("velocities_read"));
   for (uint8_t p = 0; p < numpresets; ++p) {
-    DynamicJsonDocument doc(8192);  // assistant said 6144
-
-    File32 file = fatfs.open(vfiles[p], FILE_READ);
-    if (!file) {
-      if (marci_debug) Serial.println(F("velocities_read: no sequences file. Using ROM default..."));
-      DeserializationError error = deserializeJson(doc, velocities[p]);
-      if (error) {
-        if (marci_debug) {
-          Serial.print(F("velocities_read: deserialize default failed: "));
-          Serial.println(error.c_str());
-        }
-        return;
-      }
-    } else {
-      DeserializationError error = deserializeJson(doc, file);  // inputLength);
-      if (error) {
-        if (marci_debug) {
-          Serial.print(F("velocities_read: deserialize failed: "));
-          Serial.println(error.c_str());
-        }
-        return;
-      }
-    }
-
-    for (int j = 0; j < numtracks; j++) {
-      if (marci_debug) {
-          Serial.print("Preset "); 
-          Serial.print(p);
-          Serial.print(", Track ");
-          Serial.println(j);
-      }
-      JsonArray vel_array = doc[j];
-      for (int i = 0; i < num_steps; i++) {
-        seqr.vels[p][j][i] = vel_array[i];
-      }
-    }
-    file.close();
-    doc.clear();
+    bank_read(vfiles[p], VEL_LAYER, p, *velocities[p], 0, 127);
   }
   if (marci_debug) Serial.println(F("All velocities loaded"));
   trellis.show();
@@ -530,45 +434,7 @@ void velocities_read() {
 void notes_read() {
   if (marci_debug) Serial.println(F("notes_read"));
   for (uint8_t p = 0; p < numpresets; ++p) {
-    DynamicJsonDocument doc(8192);  // assistant said 6144
-
-    File32 file = fatfs.open(nfiles[p], FILE_READ);
-    if (!file) {
-      if (marci_debug) Serial.println(F("notes_read: no sequences file. Using ROM default..."));
-      DeserializationError error = deserializeJson(doc, notebanks[p]);
-      if (error) {
-        if (marci_debug) {
-          Serial.print(F("notes_read: deserialize default failed: "));
-          Serial.println(error.c_str());
-        }
-        return;
-      }
-    } else {
-      DeserializationError error = deserializeJson(doc, file);  // inputLength);
-      if (error) {
-        if (marci_debug) {
-          Serial.print(F("notes_read: deserialize failed: "));
-          Serial.println(error.c_str());
-        }
-        return;
-      }
-    }
-
-    for (int j = 0; j < numtracks; j++) {
-      JsonArray note_array = doc[j];
-      if (marci_debug) {
-          Serial.print("Preset "); 
-          Serial.print(p);
-          Serial.print(", Track ");
-          Serial.println(j);
-      }
-      for (int i = 0; i < num_steps; i++) {
-        seqr.notes[p][j][i] = note_array[i];
-      }
-    }
-    file.close();
-    doc.clear();
-    if (marci_debug) Serial.println(p);
+    bank_read(nfiles[p], NOTE_LAYER, p, *notebanks[p], 0, 127);
   }
   if (marci_debug) Serial.println(F("All notes loaded"));
   trellis.show();
@@ -578,47 +444,7 @@ void notes_read() {
 void probabilities_read() {
   if (marci_debug) Serial.println(F("probabilities_read"));
   for (uint8_t p = 0; p < numpresets; ++p) {
-    DynamicJsonDocument doc(8192);  // assistant said 6144
-
-    File32 file = fatfs.open(prbfiles[p], FILE_READ);
-    if (!file) {
-      if (marci_debug) Serial.println(F("probabilities_read: no probabilities file. Using ROM default..."));
-      DeserializationError error = deserializeJson(doc, probabilities[p]);
-      if (error) {
-        if (marci_debug) {
-          Serial.print(F("probabilities_read: deserialize default failed: "));
-          Serial.println(p);
-          Serial.println(error.c_str());
-        }
-        return;
-      }
-    } else {
-      DeserializationError error = deserializeJson(doc, file);  // inputLength);
-      if (error) {
-        if (marci_debug) {
-          Serial.print(F("probabilities_read: deserialize failed: "));
-          Serial.println(p);
-          Serial.println(error.c_str());
-        }
-        return;
-      }
-    }
-
-    for (int j = 0; j < numtracks; j++) {
-      if (marci_debug) {
-          Serial.print("Preset "); 
-          Serial.print(p);
-          Serial.print(", Track ");
-          Serial.println(j);
-      }
-      JsonArray prob_array = doc[j];
-      for (int i = 0; i < num_steps; i++) {
-        seqr.probs[p][j][i] = prob_array[i];
-      }
-    }
-    file.close();
-    doc.clear();
-    if (marci_debug) Serial.println(p);
+    bank_read(prbfiles[p], PROB_LAYER, p, *probabilities[p], 0, 255);
   }
   if (marci_debug) Serial.println(F("All Probabilities loaded"));
   trellis.show();
@@ -628,78 +454,79 @@ void probabilities_read() {
 void gates_read() {
   if (marci_debug) Serial.println(F("gates_read"));
   for (uint8_t p = 0; p < numpresets; ++p) {
-    DynamicJsonDocument doc(8192);  // assistant said 6144
-
-    File32 file = fatfs.open(gfiles[p], FILE_READ);
-    if (!file) {
-      if (marci_debug) Serial.println(F("gates_read: no sequences file. Using ROM default..."));
-      DeserializationError error = deserializeJson(doc, gatebanks[p]);
-      if (error) {
-        if (marci_debug) {
-          Serial.print(F("gates_read: deserialize default failed: "));
-          Serial.println(p);
-          Serial.println(error.c_str());
-        }
-        return;
-      }
-    } else {
-      DeserializationError error = deserializeJson(doc, file);  // inputLength);
-      if (error) {
-        if (marci_debug) {
-          Serial.print(F("gates_read: deserialize failed: "));
-          Serial.println(p);
-          Serial.println(error.c_str());
-        }
-        return;
-      }
-    }
-
-    for (int j = 0; j < numtracks; j++) {
-      JsonArray gate_array = doc[j];
-      if (marci_debug) {
-          Serial.print("Preset "); 
-          Serial.print(p);
-          Serial.print(", Track ");
-          Serial.println(j);
-      }
-      for (int i = 0; i < num_steps; i++) {
-        seqr.gates[p][j][i] = gate_array[i];
-      }
-    }
-    file.close();
-    doc.clear();
+    bank_read(gfiles[p], GATE_LAYER, p, *gatebanks[p], 0, 255);
   }
   if (marci_debug) Serial.println(F("All gates loaded"));
   trellis.show();
 }
 
+// read all step microtiming from "disk"
+void nudges_read() {
+  if (marci_debug) Serial.println(F("nudges_read"));
+  for (uint8_t p = 0; p < numpresets; ++p) {
+    bank_read(nudgefiles[p], NUDGE_LAYER, p, *nudgebanks[p], -128, 127);
+  }
+  if (marci_debug) Serial.println(F("All nudges loaded"));
+}
+
+// read all step chord shapes from "disk"
+void chords_read() {
+  if (marci_debug) Serial.println(F("chords_read"));
+  for (uint8_t p = 0; p < numpresets; ++p) {
+    bank_read(chordfiles[p], CHORD_LAYER, p, *chordbanks[p], 0, 255);
+  }
+  if (marci_debug) Serial.println(F("All chords loaded"));
+}
+
+// read song from "disk" (no file = no song)
+void song_read() {
+  if (marci_debug) Serial.println(F("song_read"));
+  song_len = 0;
+  song_on = false;
+  File32 file = fatfs.open(song_file, FILE_READ);
+  if (!file) {
+    if (marci_debug) Serial.println(F("song_read: no song file"));
+    return;
+  }
+  uint8_t entries[song_max][numtracks + 1];
+  uint8_t lens[song_max];
+  bool ok = json_read_rows(file, &entries[0][0], song_max, numtracks + 1, 0, 255, lens);
+  file.close();
+  if (!ok) {
+    if (marci_debug) Serial.println(F("song_read: rejected song file"));
+    return;
+  }
+  for (uint8_t e = 0; e < song_max; ++e) {
+    if (lens[e] <= numtracks) break;
+    for (uint8_t i = 0; i < numtracks; ++i) {
+      uint8_t p = entries[e][i];
+      song[e].presets[i] = p < numpresets ? p : 0;
+    }
+    uint8_t r = entries[e][numtracks];
+    song[e].repeats = constrain(r, 1, song_max_repeats);
+    song_len++;
+  }
+  if (marci_debug) Serial.println(F("Song loaded"));
+}
+
 void settings_read() {
   if (marci_debug) Serial.println(F("settings_read"));
-  DynamicJsonDocument doc(8192);  // assistant said 6144
-
   File32 file = fatfs.open(settings_file, FILE_READ);
   if (!file) {
     if (marci_debug) Serial.println(F("settings_read: no settings file. Using ROM default..."));
-    DeserializationError error = deserializeJson(doc, settings);
-    if (error) {
-      if (marci_debug) {
-        Serial.print(F("settings_read: deserialize default failed: "));
-        Serial.println(error.c_str());
-      }
-      return;
-    }
-  } else {
-    DeserializationError error = deserializeJson(doc, file);  // inputLength);
-    if (error) {
-      if (marci_debug) {
-        Serial.print(F("settings_read: deserialize failed: "));
-        Serial.println(error.c_str());
-      }
-      return;
-    }
+    settings_reset();
+    return;
+  }
+  int16_t set_array[settings_fields];
+  uint8_t set_len;  // older settings files stop short, see Grooves
+  bool ok = json_read_rows(file, set_array, 1, settings_fields, -32768, 32767, &set_len);
+  file.close();
+  if (!ok) {
+    if (marci_debug) Serial.println(F("settings_read: rejected settings file. Using ROM default..."));
+    settings_reset();
+    return;
   }
 
-  JsonArray set_array = doc[0];
   tempo = set_array[0];
   if (marci_debug) Serial.println("Loading Stepsize");
   cfg.step_size = set_array[1];
@@ -724,7 +551,7 @@ void settings_read() {
   if (marci_debug) Serial.println("Loading Ctrl Channel");
   seqr.ctrl_chan = set_array[z] > 0 ? set_array[z] : seqr.ctrl_chan;
   if (marci_debug) Serial.println("Loading Swing");
-  seqr.swing = set_array[z + 1] > 0 ? set_array[z + 1] : seqr.swing;
+  uint8_t legacy_swing = set_array[z + 1];  // global swing from older settings files, see Grooves
   if (marci_debug) Serial.println("Loading Brightness");
   brightness = set_array[z + 2] > 0 ? set_array[z + 2] : brightness;
   z = z + 3;
@@ -734,7 +561,7 @@ void settings_read() {
       Serial.print(i);
       Serial.print( " = " );
     }
-    seqr.modes[i] = set_array[z] > 0 ? set_array[z] : TRIGATE;
+    seqr.modes[i] = set_array[z] > 0 ? (track_mode)set_array[z] : TRIGATE;
     z++;
     if (marci_debug) {
       Serial.println(seqr.modes[i]);
@@ -788,8 +615,59 @@ void settings_read() {
       Serial.println(seqr.lengths[i]);
     }
   }
-  file.close();
-  doc.clear();
+  if (marci_debug) Serial.println("Loading Trigger Widths");
+  for (uint8_t i = 0; i < 8; ++i) {
+    seqr.trig_lens[i] = set_array[z];  // absent in older settings files = 0 = gate
+    z++;
+  }
+  if (marci_debug) Serial.println("Loading Clock Out PPQN");
+  uint8_t ppqn = set_array[z];
+  for (uint8_t i = 0; i < clk_out_ppqns_cnt; ++i) {
+    if (clk_out_ppqns[i] == ppqn) clock_timer.out_ppqn = ppqn;  // absent / invalid = keep 24
+  }
+  z++;
+  if (marci_debug) Serial.println("Loading Clock In PPQN");
+  ppqn = set_array[z];
+  for (uint8_t i = 0; i < clk_in_ppqns_cnt; ++i) {
+    if (clk_in_ppqns[i] == ppqn) clock_in.ppqn = ppqn;  // absent / invalid = keep 24
+  }
+  z++;
+  if (marci_debug) Serial.println("Loading Grooves");
+  for (uint8_t i = 0; i < 8; ++i) {
+    uint8_t g = set_array[z];
+    // absent in older settings files: carry their global swing over to every track
+    seqr.grooves[i] = z >= set_len ? groove_from_swing(legacy_swing) : (g < grooves_cnt ? g : 0);
+    z++;
+  }
+  if (marci_debug) Serial.println("Loading Multipliers");
+  for (uint8_t i = 0; i < 8; ++i) {
+    uint8_t m = set_array[z];  // absent in older settings files = 0 = x1
+    seqr.muls[i] = m < X_DIM ? m : 0;
+    z++;
+  }
+  if (marci_debug) Serial.println("Loading MIDI In Routes");
+  for (uint8_t i = 0; i < 16; ++i) {
+    uint8_t r = set_array[z];  // absent in older settings files = 0 = selected track
+    midi_routes[i] = r <= numtracks ? r : 0;
+    z++;
+  }
+  if (marci_debug) Serial.println("Loading Scales");
+  for (uint8_t i = 0; i < 8; ++i) {
+    uint8_t sc = set_array[z];  // absent in older settings files = 0 = chromatic, unquantised
+    seqr.scales[i] = sc < scales_cnt ? sc : 0;
+    z++;
+  }
+  for (uint8_t i = 0; i < 8; ++i) {
+    uint8_t r = set_array[z];
+    seqr.roots[i] = r < 12 ? r : 0;
+    z++;
+  }
+  for (uint8_t i = 0; i < 8; ++i) {
+    int8_t d = set_array[z];
+    seqr.degrees[i] = constrain(d, -scale_max_degrees, scale_max_degrees);
+    seqr.set_scale(i);
+    z++;
+  }
   if (marci_debug) Serial.println("All settings loaded");
   trellis.show();
 }
@@ -0,0 +1,107 @@
+/**
+ * scales.h -- Scale quantiser tables for Multitrack Sequencer (for Feather M4 Express)
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Each scale is a 12 bit mask of the semitones above its root. For every scale the compiler builds
+ * a 128 entry table (in flash) snapping each MIDI note to the nearest note of the scale on C, ties
+ * going down. scale_map() turns that into a track's own map for its root & degree transpose when
+ * either changes, so the hot path is one lookup per note: events are quantised as they're compiled,
+ * arp notes as they're played.
+ */
+#ifndef MULTI_SEQUENCER_SCALES
+#define MULTI_SEQUENCER_SCALES
+
+typedef struct {
+  const char* name;
+  uint16_t mask;  // bit n = n semitones above the root is in the scale
+} Scale;
+
+constexpr Scale scale_defs[] = {
+  { "chromatic", 0b111111111111 },
+  { "major", 0b101010110101 },
+  { "minor", 0b010110101101 },
+  { "harm min", 0b100110101101 },
+  { "mel min", 0b101010101101 },
+  { "dorian", 0b011010101101 },
+  { "phrygian", 0b010110101011 },
+  { "lydian", 0b101011010101 },
+  { "mixolydian", 0b011010110101 },
+  { "locrian", 0b010101101011 },
+  { "maj pent", 0b001010010101 },
+  { "min pent", 0b010010101001 },
+  { "blues", 0b010011101001 },
+  { "whole tone", 0b010101010101 },
+  { "diminished", 0b101101101101 },
+  { "hirajoshi", 0b000110001101 },
+};
+constexpr uint8_t scales_cnt = sizeof(scale_defs) / sizeof(scale_defs[0]);
+static_assert(scales_cnt == 16, "scale is picked from rows 1 & 2 of the config pane");
+const int8_t scale_max_degrees = 7;  // degree transpose, either way
+
+constexpr bool scale_has(uint16_t mask, int n) {
+  return n >= 0 && n <= 127 && ((mask >> (n % 12)) & 1);
+}
+
+// nearest scale note to n, looking d semitones either side first
+constexpr uint8_t scale_snap(uint16_t mask, int n, int d = 0) {
+  return scale_has(mask, n - d) ? n - d : scale_has(mask, n + d) ? n + d : scale_snap(mask, n, d + 1);
+}
+
+// compile-time 0 .. N-1
+template<uint8_t... n> struct ScaleIndices {};
+template<uint8_t N, uint8_t... n> struct MakeScaleIndices : MakeScaleIndices<N - 1, N - 1, n...> {};
+template<uint8_t... n> struct MakeScaleIndices<0, n...> : ScaleIndices<n...> {};
+
+typedef struct {
+  uint8_t notes[128];
+} ScaleTable;
+
+typedef struct {
+  ScaleTable scale[scales_cnt];
+} ScaleTables;
+
+template<uint8_t... n>
+constexpr ScaleTable scale_table(uint16_t mask, ScaleIndices<n...>) {
+  return { { scale_snap(mask, n)... } };
+}
+
+template<uint8_t... s>
+constexpr ScaleTables scale_tables_for(ScaleIndices<s...>) {
+  return { { scale_table(scale_defs[s].mask, MakeScaleIndices<128>())... } };
+}
+
+constexpr ScaleTables scale_tables = scale_tables_for(MakeScaleIndices<scales_cnt>());
+static_assert(scale_tables.scale[1].notes[61] == 60, "C# snaps down to C in C major");
+static_assert(scale_tables.scale[11].notes[64] == 63, "E snaps down to Eb in C minor pentatonic");
+
+// n snapped to scale s on root (0 = C .. 11 = B), kept inside 0 - 127 by whole octaves
+uint8_t scale_quantise(uint8_t s, uint8_t root, uint8_t n) {
+  int16_t q = n >= root ? scale_tables.scale[s].notes[n - root] + root : scale_tables.scale[s].notes[n + 12 - root] + root - 12;
+  while (q > 127) q -= 12;
+  while (q < 0) q += 12;
+  return q;
+}
+
+// next scale note up (dir 1) or down (dir -1) from scale note q, q itself at either end
+uint8_t scale_step(uint8_t s, uint8_t root, uint8_t q, int8_t dir) {
+  for (int16_t x = q + dir; x >= 0 && x <= 127; x += dir) {
+    if (scale_quantise(s, root, x) == x) return x;
+  }
+  return q;
+}
+
+// a track's note map: every note snapped to scale s on root, then moved by degrees along it.
+// Runs when the scale settings change (main loop), never per step
+void scale_map(uint8_t s, uint8_t root, int8_t degrees, uint8_t* out) {
+  s = s < scales_cnt ? s : 0;
+  root %= 12;
+  degrees = constrain(degrees, -scale_max_degrees, scale_max_degrees);
+  for (uint8_t n = 0; n < 128; ++n) {
+    uint8_t q = scale_quantise(s, root, n);
+    for (int8_t d = 0; d < degrees; ++d) q = scale_step(s, root, q, 1);
+    for (int8_t d = 0; d > degrees; --d) q = scale_step(s, root, q, -1);
+    out[n] = q;
+  }
+}
+#endif
@@ -0,0 +1,94 @@
+/**
+ * song.h -- Song (preset chain) mode for Multitrack Sequencer (for Feather M4 Express)
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * A song is a list of entries, each a preset for every track plus how many master loops it plays.
+ * As soon as an entry starts, the next one is queued on every track: compiled into the track's back
+ * event bank (all presets are already in RAM) and swapped in by the track itself at its first loop
+ * start after the entry's last master loop, so the switch is a pointer flip inside fire_step().
+ */
+#ifndef MULTI_SEQUENCER_SONG
+#define MULTI_SEQUENCER_SONG
+
+const uint8_t song_max = 16;
+const uint8_t song_max_repeats = 16;
+
+typedef struct {
+  uint8_t presets[numtracks];
+  uint8_t repeats;  // master loops, 1 - 16
+} SongEntry;
+
+SongEntry song[song_max];
+uint8_t song_len;
+uint8_t song_pos;       // entry playing
+uint8_t song_sel;       // entry being edited
+uint16_t song_next_at;  // seqr.loops value at which the next entry takes over
+bool song_on;
+bool song_was_playing;
+bool song_pending;      // entry after song_pos is queued on the tracks
+
+void song_queue(uint8_t entry, uint16_t at_loop) {
+  for (uint8_t i = 0; i < numtracks; ++i) {
+    seqr.queue_preset(i, song[entry].presets[i], at_loop);
+  }
+}
+
+// put the chain back on its first entry: straight away when stopped (timing starts with play),
+// from the next loop start when running
+void song_start() {
+  if (song_len == 0) return;
+  if (seqr.playing) {
+    // lands at the coming master loop start, then runs as any other hand-over
+    song_pos = song_len - 1;
+    song_next_at = seqr.loops + 1;
+    for (uint8_t i = 0; i < numtracks; ++i) seqr.queue_preset(i, song[0].presets[i], seqr.loops);
+    song_pending = true;
+  } else {
+    song_pos = 0;
+    for (uint8_t i = 0; i < numtracks; ++i) seqr.set_preset(i, song[0].presets[i]);
+    song_pending = false;
+  }
+}
+
+// main loop: each track holds one queued preset, so the next entry is queued as soon as every
+// track has swapped to the current one, well ahead of its own hand-over
+void song_update() {
+  bool started = seqr.playing && !song_was_playing;
+  bool stopped = !seqr.playing && song_was_playing;
+  song_was_playing = seqr.playing;
+  if (!song_on || song_len == 0) return;
+  if (stopped) {
+    song_start();
+    return;
+  }
+  if (started) song_next_at = seqr.loops + song[song_pos].repeats;
+  if (!seqr.playing || seqr.queued_any()) return;
+  if (song_pending) {
+    // queued entry is in on every track
+    song_pos = (song_pos + 1) % song_len;
+    song_next_at += song[song_pos].repeats;
+  }
+  song_queue((song_pos + 1) % song_len, song_next_at);
+  song_pending = true;
+}
+
+// append an entry playing every track's current preset once
+void song_add() {
+  if (song_len >= song_max) return;
+  for (uint8_t i = 0; i < numtracks; ++i) {
+    song[song_len].presets[i] = seqr.presets[i];
+  }
+  song[song_len].repeats = 1;
+  song_sel = song_len;
+  song_len++;
+}
+
+void song_remove(uint8_t entry) {
+  if (entry >= song_len) return;
+  for (uint8_t e = entry; e + 1 < song_len; ++e) song[e] = song[e + 1];
+  song_len--;
+  if (song_sel >= song_len && song_sel > 0) song_sel--;
+  if (song_len == 0) song_on = false;
+}
+#endif
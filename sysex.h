@@ -0,0 +1,258 @@
+/**
+ * sysex.h -- SysEx bank dump / restore for Multitrack Sequencer (for Feather M4 Express)
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Banks go in & out over USB MIDI as a stream of small SysEx messages, one chunk per track of one
+ * layer of one preset (preset by preset, layer by layer), so neither side ever holds more than a
+ * row. Each chunk is one complete message filling one 64 byte USB MIDI packet (well inside the
+ * MIDI library's SysEx buffer): a 7 bit sequence number, where it goes, the row's 32 bytes packed
+ * 8 to 7 bits, and a checksum. Flow control is stop & wait: the next chunk goes once the last is acked (re-sent if
+ * it isn't within sysex_ack_millis, or is nakked), one per main loop pass, so the sender never
+ * outruns the host and the sequencer never waits on USB. A restored chunk goes straight into its
+ * preset & the journal, while playing or not.
+ *
+ * Messages: F0 7D 4D 34 <command> ... F7
+ *   01 p              dump preset p (7F = all), answered by DATA chunks then END
+ *   02 seq p l t <37 packed bytes> sum    DATA: layer l (see bank_layer) of track t, preset p.
+ *                     sum makes seq .. packed bytes add up to 0 (mod 128)
+ *   03 seq            ACK
+ *   04 seq why        NAK (why: 1 bad sum, 2 out of order, 3 bad chunk, 4 preset store full)
+ *   05 n n            END of a dump (chunks, low 7 bits first)
+ *   06                BEGIN a restore (acked with seq 7F); then DATA from seq 0, each acked
+ */
+#ifndef MULTI_SEQUENCER_SYSEX
+#define MULTI_SEQUENCER_SYSEX
+
+const uint8_t sysex_id[] = { 0x7D, 0x4D, 0x34 };  // non-commercial, "M4"
+const uint8_t sysex_dump = 0x01;
+const uint8_t sysex_data = 0x02;
+const uint8_t sysex_ack = 0x03;
+const uint8_t sysex_nak = 0x04;
+const uint8_t sysex_end = 0x05;
+const uint8_t sysex_begin = 0x06;
+const uint8_t sysex_bad_sum = 1;
+const uint8_t sysex_bad_seq = 2;
+const uint8_t sysex_bad_chunk = 3;
+const uint8_t sysex_store_full = 4;
+const uint8_t sysex_packed = num_steps + (num_steps + 6) / 7;
+const uint8_t sysex_head = sizeof(sysex_id) + 1;  // id, command
+const uint8_t sysex_data_len = sysex_head + 4 + sysex_packed + 1;  // seq p l t, row, sum
+const uint16_t sysex_chunks = preset_layers * numtracks;  // per preset
+const uint32_t sysex_ack_millis = 250;
+const uint8_t sysex_tries = 8;
+
+static_assert((sysex_data_len + 2 + 2) / 3 * 4 <= 64, "a SysEx chunk should fit one USB packet (3 bytes per 4 byte event)");
+
+uint16_t sysex_tx_chunk;  // dump: chunk being sent / acked
+uint16_t sysex_tx_end;    // ...chunks in it, 0 = not dumping
+uint8_t sysex_tx_first;   // ...preset it starts at
+bool sysex_tx_wait;       // ...chunk sent, not acked yet
+uint8_t sysex_tx_tries;
+uint32_t sysex_tx_at;
+uint8_t sysex_rx_next;    // restore: seq expected next
+// stats
+uint32_t sysex_chunks_out;
+uint32_t sysex_chunks_in;
+uint32_t sysex_resends;
+uint32_t sysex_rejects;   // chunks nakked
+uint32_t sysex_aborts;    // dumps the host stopped acking
+uint32_t sysex_bytes;
+uint32_t sysex_dump_millis;   // last dump took
+uint32_t sysex_dump_started;
+uint32_t sysex_micros_max;    // longest chunk encode + send / decode + apply
+
+// each 7 bytes as a byte of their top bits, then their low 7 bits. Returns bytes out
+uint8_t sysex_pack(const uint8_t* in, uint8_t n, uint8_t* out) {
+  uint8_t o = 0;
+  for (uint8_t i = 0; i < n; i += 7) {
+    uint8_t top = o++;
+    out[top] = 0;
+    for (uint8_t k = 0; k < 7 && i + k < n; ++k) {
+      out[top] |= (in[i + k] >> 7) << k;
+      out[o++] = in[i + k] & 0x7F;
+    }
+  }
+  return o;
+}
+
+// n bytes back out of sysex_pack()'s
+void sysex_unpack(const uint8_t* in, uint8_t n, uint8_t* out) {
+  for (uint8_t i = 0; i < n; i += 7) {
+    uint8_t top = *in++;
+    for (uint8_t k = 0; k < 7 && i + k < n; ++k) out[i + k] = *in++ | ((top >> k) & 1) << 7;
+  }
+}
+
+uint8_t sysex_sum(const uint8_t* d, uint8_t n) {
+  uint8_t sum = 0;
+  for (uint8_t i = 0; i < n; ++i) sum += d[i];
+  return -sum & 0x7F;
+}
+
+void sysex_send(uint8_t cmd, const uint8_t* d, uint8_t n) {
+  uint8_t m[sysex_data_len];
+  memcpy(m, sysex_id, sizeof(sysex_id));
+  m[sizeof(sysex_id)] = cmd;
+  memcpy(m + sysex_head, d, n);
+  MIDIusb.sendSysEx(sysex_head + n, m);
+  sysex_bytes += sysex_head + n + 2;
+}
+
+void sysex_reply(uint8_t cmd, uint8_t seq, uint8_t why = 0) {
+  uint8_t d[2] = { seq, why };
+  sysex_send(cmd, d, cmd == sysex_nak ? 2 : 1);
+}
+
+// chunk c of the dump, straight from the preset
+void sysex_send_chunk(uint16_t c) {
+  uint32_t start = micros();
+  uint8_t d[4 + sysex_packed + 1];
+  d[0] = c & 0x7F;
+  d[1] = sysex_tx_first + c / sysex_chunks;
+  d[2] = c / numtracks % preset_layers;
+  d[3] = c % numtracks;
+  uint8_t row[num_steps];
+  seqr.get_layer(d[1], d[3], d[2], row);
+  sysex_pack(row, num_steps, d + 4);
+  d[sizeof(d) - 1] = sysex_sum(d, sizeof(d) - 1);
+  sysex_send(sysex_data, d, sizeof(d));
+  sysex_tx_wait = true;
+  sysex_tx_at = millis();
+  sysex_chunks_out++;
+  uint32_t took = micros() - start;
+  if (took > sysex_micros_max) sysex_micros_max = took;
+}
+
+void sysex_dump_start(uint8_t p) {
+  sysex_tx_first = p < numpresets ? p : 0;
+  sysex_tx_end = p < numpresets ? sysex_chunks : sysex_chunks * numpresets;
+  sysex_tx_chunk = 0;
+  sysex_tx_wait = false;
+  sysex_tx_tries = 0;
+  sysex_dump_started = millis();
+}
+
+// DATA from the host: check it, then into the preset & journal
+void sysex_restore_chunk(const uint8_t* d, uint8_t n) {
+  uint32_t start = micros();
+  uint8_t seq = d[0];
+  uint8_t why = 0;
+  if (n != 4 + sysex_packed + 1 || sysex_sum(d, n - 1) != d[n - 1]) {
+    why = sysex_bad_sum;
+  } else if (seq == ((sysex_rx_next - 1) & 0x7F)) {
+    sysex_reply(sysex_ack, seq);  // our ack went missing, it's in already
+    return;
+  } else if (seq != sysex_rx_next) {
+    why = sysex_bad_seq;
+  }
+  uint8_t p = d[1];
+  uint8_t l = d[2];
+  uint8_t t = d[3];
+  uint8_t row[num_steps];
+  if (!why) {
+    if (p >= numpresets || l >= preset_layers || t >= numtracks) why = sysex_bad_chunk;
+  }
+  if (!why) {
+    sysex_unpack(d + 4, num_steps, row);
+    for (uint8_t s = 0; s < num_steps; ++s) {
+      if (row[s] > layer_max[l]) why = sysex_bad_chunk;
+    }
+  }
+  uint8_t old[num_steps];
+  if (!why) {
+    seqr.get_layer(p, t, l, old);
+    if (!seqr.set_layer(p, t, l, row)) why = sysex_store_full;
+  }
+  if (why) {
+    sysex_rejects++;
+    sysex_reply(sysex_nak, seq, why);
+    return;
+  }
+  for (uint8_t s = 0; s < num_steps; ++s) {
+    if (row[s] != old[s]) journal_edit(l, p, t, s, row[s]);
+  }
+  sysex_reply(sysex_ack, seq);
+  sysex_rx_next = (seq + 1) & 0x7F;
+  sysex_chunks_in++;
+  uint32_t took = micros() - start;
+  if (took > sysex_micros_max) sysex_micros_max = took;
+}
+
+// MIDI library SysEx callback: the whole message, F0 & F7 included
+void handle_sysex(byte* array, unsigned size) {
+  if (size < sysex_head + 2 || memcmp(array + 1, sysex_id, sizeof(sysex_id)) != 0) return;
+  const uint8_t* d = array + 1 + sysex_head;
+  uint8_t n = size - sysex_head - 2;
+  switch (array[sysex_head]) {
+    case sysex_dump:
+      if (n >= 1) sysex_dump_start(d[0]);
+      break;
+    case sysex_data:
+      if (n >= 1) sysex_restore_chunk(d, n);
+      break;
+    case sysex_ack:
+      if (n >= 1 && sysex_tx_wait && d[0] == (sysex_tx_chunk & 0x7F)) {
+        sysex_tx_chunk++;
+        sysex_tx_wait = false;
+        sysex_tx_tries = 0;
+      }
+      break;
+    case sysex_nak:
+      if (n >= 1 && sysex_tx_wait && d[0] == (sysex_tx_chunk & 0x7F)) {
+        sysex_tx_wait = false;  // again, next pass
+        sysex_resends++;
+      }
+      break;
+    case sysex_begin:
+      journal_scan();  // edits so far are their own, before the restore's
+      sysex_rx_next = 0;
+      sysex_reply(sysex_ack, 0x7F);
+      break;
+    default:
+      break;
+  }
+}
+
+// main loop: next chunk of a dump, once the last is acked
+void sysex_update() {
+  if (sysex_tx_end == 0) return;
+  if (sysex_tx_wait) {
+    if (millis() - sysex_tx_at < sysex_ack_millis) return;
+    if (++sysex_tx_tries >= sysex_tries) {
+      if (marci_debug) Serial.println(F("sysex: dump not acked, stopped"));
+      sysex_tx_end = 0;
+      sysex_aborts++;
+      return;
+    }
+    sysex_resends++;
+  }
+  if (sysex_tx_chunk < sysex_tx_end) {
+    sysex_send_chunk(sysex_tx_chunk);
+    return;
+  }
+  uint8_t d[2] = { (uint8_t)(sysex_tx_end & 0x7F), (uint8_t)(sysex_tx_end >> 7) };
+  sysex_send(sysex_end, d, 2);
+  sysex_tx_end = 0;
+  sysex_dump_millis = millis() - sysex_dump_started;
+}
+
+void sysex_report() {
+  Serial.print(F("SysEx chunks out: "));
+  Serial.print(sysex_chunks_out);
+  Serial.print(F(", in: "));
+  Serial.print(sysex_chunks_in);
+  Serial.print(F(", resent: "));
+  Serial.print(sysex_resends);
+  Serial.print(F(", rejected: "));
+  Serial.print(sysex_rejects);
+  Serial.print(F(", aborted: "));
+  Serial.print(sysex_aborts);
+  Serial.print(F(", bytes out: "));
+  Serial.print(sysex_bytes);
+  Serial.print(F(", last dump ms: "));
+  Serial.print(sysex_dump_millis);
+  Serial.print(F(", max chunk us: "));
+  Serial.println(sysex_micros_max);
+}
+#endif
@@ -0,0 +1,206 @@
+/**
+ * arduino_host.h -- Just enough Arduino for the sequencer engine on a desktop, for Multitrack Sequencer tools
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * The engine headers only need timing, random(), pins, Serial and file reads from the board. Here time is
+ * a virtual clock the tool moves on itself (host_micros), random() is a small seeded generator so a
+ * render is the same on every machine, Serial goes to stderr (or the tool) and files are plain files
+ * under a folder standing in for the flash drive's root.
+ */
+#ifndef MULTI_SEQUENCER_ARDUINO_HOST
+#define MULTI_SEQUENCER_ARDUINO_HOST
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+typedef uint8_t byte;
+
+#define F(s) (s)
+#define HEX 16
+#define FILE_READ "rb"
+#define FILE_WRITE "wb"
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// virtual clock
+uint32_t host_micros;
+
+uint32_t micros() {
+  return host_micros;
+}
+
+uint32_t millis() {
+  return host_micros / 1000;
+}
+
+void noInterrupts() {}
+void interrupts() {}
+void yield() {}
+
+// pins: nothing is wired, interrupts are called by hand
+#define INPUT 0
+#define OUTPUT 1
+#define RISING 3
+#define digitalPinToInterrupt(p) (p)
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+void attachInterrupt(uint8_t, void (*)(), int) {}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+// xorshift32, seeded by randomSeed()
+uint32_t host_random_state = 1;
+
+void randomSeed(uint32_t seed) {
+  host_random_state = seed ? seed : 1;
+}
+
+long random(long howbig) {
+  if (howbig <= 0) return 0;
+  host_random_state ^= host_random_state << 13;
+  host_random_state ^= host_random_state >> 17;
+  host_random_state ^= host_random_state << 5;
+  return host_random_state % howbig;
+}
+
+long random(long howsmall, long howbig) {
+  return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall);
+}
+
+class Print {
+public:
+  virtual size_t write(uint8_t c) = 0;
+  virtual ~Print() {}
+
+  size_t write(const uint8_t* d, size_t n) {
+    size_t w = 0;
+    while (n--) w += write(*d++);
+    return w;
+  }
+  size_t write(char c) { return write((uint8_t)c); }
+  size_t print(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(long v, int base = 10) {
+    char b[24];
+    snprintf(b, sizeof(b), base == HEX ? "%lX" : "%ld", v);
+    return print(b);
+  }
+  size_t print(unsigned long v, int base = 10) {
+    char b[24];
+    snprintf(b, sizeof(b), base == HEX ? "%lX" : "%lu", v);
+    return print(b);
+  }
+  size_t print(int v, int base = 10) { return print((long)v, base); }
+  size_t print(unsigned int v, int base = 10) { return print((unsigned long)v, base); }
+  size_t print(double v) {
+    char b[32];
+    snprintf(b, sizeof(b), "%.2f", v);
+    return print(b);
+  }
+  template<typename T>
+  size_t println(T v) { return print(v) + print("\n"); }
+  size_t println() { return print("\n"); }
+};
+
+// the USB serial port: what a tool feed()s comes back from read(), what the sketch writes goes to
+// the tool's tx callback if it sets one, else stderr
+class HostSerial : public Print {
+public:
+  uint8_t rx[4096];
+  uint16_t rx_head;
+  uint16_t rx_count;
+  void (*tx)(uint8_t) = nullptr;
+  int tx_room = 64;  // availableForWrite()
+
+  size_t write(uint8_t c) override {
+    if (tx) tx(c);
+    else fputc(c, stderr);
+    return 1;
+  }
+  using Print::write;
+  bool feed(uint8_t c) {
+    if (rx_count == sizeof(rx)) return false;
+    rx[(rx_head + rx_count++) % sizeof(rx)] = c;
+    return true;
+  }
+  int available() { return rx_count; }
+  int read() {
+    if (!rx_count) return -1;
+    uint8_t c = rx[rx_head];
+    rx_head = (rx_head + 1) % sizeof(rx);
+    rx_count--;
+    return c;
+  }
+  int availableForWrite() { return tx_room; }
+  void printf(const char*, ...) {}
+};
+
+HostSerial Serial;
+
+// a plain file, opened by FatVolume
+class File32 : public Print {
+public:
+  FILE* f;
+
+  File32(FILE* af = nullptr) : f(af) {}
+  explicit operator bool() const { return f != nullptr; }
+  int read(void* buf, size_t n) { return f ? fread(buf, 1, n, f) : -1; }
+  size_t write(uint8_t c) override { return f && fputc(c, f) != EOF; }
+  using Print::write;
+  bool seek(uint32_t pos) { return f && fseek(f, pos, SEEK_SET) == 0; }
+  bool sync() { return f && fflush(f) == 0; }
+  bool truncate(uint32_t len) { return f && fflush(f) == 0 && ftruncate(fileno(f), len) == 0; }
+  void close() {
+    if (f) fclose(f);
+    f = nullptr;
+  }
+};
+
+// flash drive paths ("/M4SEQ32/...") under a folder on the host
+class FatVolume {
+public:
+  char root[512] = ".";
+
+  File32 open(const char* path, const char* mode) {
+    char full[1024];
+    snprintf(full, sizeof(full), "%s%s", root, path);
+    return File32(fopen(full, mode));
+  }
+
+  bool exists(const char* path) {
+    char full[1024];
+    snprintf(full, sizeof(full), "%s%s", root, path);
+    return access(full, F_OK) == 0;
+  }
+
+  bool remove(const char* path) {
+    char full[1024];
+    snprintf(full, sizeof(full), "%s%s", root, path);
+    return ::remove(full) == 0;
+  }
+
+  bool rename(const char* from, const char* to) {
+    char a[1024], b[1024];
+    snprintf(a, sizeof(a), "%s%s", root, from);
+    snprintf(b, sizeof(b), "%s%s", root, to);
+    return ::rename(a, b) == 0;
+  }
+};
+
+FatVolume fatfs;
+
+// the grid isn't there
+struct HostTrellis {
+  void read() {}
+  void show() {}
+  void setPixelColor(uint8_t, uint32_t) {}
+};
+
+HostTrellis trellis;
+#endif
@@ -0,0 +1,255 @@
+/**
+ * bench_dispatch.cpp -- Cost of the per-track mode handler table, for Multitrack Sequencer
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Plays the same compiled steps, and the same held-gate note offs, through the engine's handler
+ * table (step_handlers / off_handlers, bound per track with the DAC & analog out choices fixed
+ * as template parameters) and through the switch it replaced, which tested the mode, analog_io
+ * and "is this a DAC track" inline on every step. Checks both send the same messages, then gives
+ * time per dispatch and, where Linux lets a process read its own instruction counter, instructions
+ * per dispatch. Host figures: the M4 has a shorter pipeline and no branch predictor to speak of,
+ * so it's the instruction counts that carry over best.
+ *
+ * Build & run (from the sketch folder): g++ -std=c++17 -O2 -o bench_dispatch tools/bench_dispatch.cpp && ./bench_dispatch
+ */
+#include "arduino_host.h"
+#include <chrono>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const bool marci_debug = false;
+
+#define Y_DIM 8
+#define X_DIM 8
+#define t_size Y_DIM * X_DIM
+
+const uint8_t numtracks = X_DIM;
+const uint8_t num_steps = t_size / 2;
+const uint8_t numpresets = X_DIM * 2;
+const uint16_t dacrange = 4095;
+const byte numdacs = 2;
+const byte cvpins[2] = { 14, 15 };
+const byte gatepins[numtracks] = { 4, 5, 6, 9, 10, 11, 12, 13 };
+uint8_t sel_track = 1;
+bool hzv[2] = { 0, 1 };
+
+#include "../multisequencer.h"
+#include "../save_locations.h"
+
+typedef MultiStepSequencer<numtracks, numpresets, num_steps, numdacs, numarps> Seq;
+Seq seqr;
+
+const uint32_t bench_rounds = 20000;
+
+uint32_t sent;
+uint32_t sent_sum;
+
+void bench_note(uint8_t note, uint8_t vel, uint8_t gate, bool, uint8_t chan) {
+  sent++;
+  sent_sum = sent_sum * 31 + (note << 16 | vel << 8 | chan) + gate;
+}
+
+void bench_cc(uint8_t cc, uint8_t val, bool, uint8_t chan) {
+  sent++;
+  sent_sum = sent_sum * 31 + (cc << 16 | val << 8 | chan);
+}
+
+void bench_cv(uint8_t pin, uint16_t val) {
+  sent_sum = sent_sum * 31 + pin + val;
+}
+
+void bench_pulse(uint8_t track, uint32_t len_micros) {
+  sent_sum = sent_sum * 31 + track + len_micros;
+}
+
+void bench_gate(uint8_t, uint8_t) {}
+
+// the dispatch before the handler table: mode switch, analog & DAC tests inline
+void switch_play(Seq& q, uint8_t i, const StepEvent& ev, uint32_t now_micros, uint32_t gate_micros) {
+  uint32_t pulse_micros = q.trig_lens[i] ? q.trig_lens[i] * 1000 : gate_micros;
+  bool cv = q.analog_io && i >= (numtracks - numdacs);
+  switch (q.modes[i]) {
+    case TRIGATE:
+      q.held_gate_millis[i] = (now_micros + gate_micros) / 1000;
+      if (q.analog_io) q.pulse_func(i, pulse_micros);
+      q.on_func(ev.note, ev.vel, ev.gate, true, q.track_chan[i]);
+      break;
+    case CC:
+      q.held_gate_millis[i] = (now_micros + gate_micros) / 1000;
+      if (cv) q.set_cv(i, ev.cv);
+      if (q.analog_io) q.pulse_func(i, pulse_micros);
+      q.cc_func(ev.note, ev.vel, true, q.track_chan[i]);
+      break;
+    case NOTE:
+      q.held_gate_millis[i] = (now_micros + gate_micros) / 1000;
+      q.held_gate_notes[i] = ev.note;
+      q.held_gate_chans[i] = q.track_chan[i];
+      if (cv) q.set_cv(i, ev.cv);
+      if (q.analog_io) q.pulse_func(i, pulse_micros);
+      q.on_func(ev.note, ev.vel, ev.gate, true, q.track_chan[i]);
+      break;
+    case CHORD: {
+      const ChordShape& shape = chord_shapes[ev.shape];
+      if (cv) q.set_cv(i, ev.cv);
+      if (q.analog_io) q.pulse_func(i, pulse_micros);
+      for (uint8_t v = 0; v < shape.size; ++v) {
+        int16_t n = ev.note + shape.intervals[v];
+        if (n > 127) break;
+        q.voices.start(n, q.track_chan[i], now_micros + gate_micros, q.off_func);
+        q.on_func(n, ev.vel, ev.gate, true, q.track_chan[i]);
+      }
+      break;
+    }
+    default: break;
+  }
+}
+
+void switch_off(Seq& q, uint8_t i) {
+  switch (q.modes[i]) {
+    case TRIGATE:
+      q.off_func(q.track_notes[i] + q.transpose, 0, 1, true, q.track_chan[i]);
+      break;
+    case NOTE:
+      q.off_func(q.held_gate_notes[i], 0, 1, true, q.held_gate_chans[i]);
+      q.held_gate_notes[i] = 0;
+      q.held_gate_chans[i] = 0;
+      break;
+    default: break;
+  }
+}
+
+void table_play(Seq& q, uint8_t i, const StepEvent& ev, uint32_t now_micros, uint32_t gate_micros) {
+  (q.*q.step_handlers[i])(i, ev, now_micros, gate_micros);
+}
+
+void table_off(Seq& q, uint8_t i) {
+  (q.*q.off_handlers[i])(i);
+}
+
+// this process's own retired instruction count, if the kernel lets it read it
+struct Instructions {
+  int fd = -1;
+
+  Instructions() {
+#if defined(__linux__)
+    perf_event_attr a;
+    memset(&a, 0, sizeof(a));
+    a.type = PERF_TYPE_HARDWARE;
+    a.size = sizeof(a);
+    a.config = PERF_COUNT_HW_INSTRUCTIONS;
+    a.disabled = 1;
+    a.exclude_kernel = 1;
+    a.exclude_hv = 1;
+    fd = syscall(SYS_perf_event_open, &a, 0, -1, -1, 0);
+#endif
+  }
+
+  void start() {
+#if defined(__linux__)
+    if (fd < 0) return;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+  }
+
+  // -1 = no counter
+  long long stop() {
+#if defined(__linux__)
+    if (fd < 0) return -1;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    long long n = 0;
+    if (read(fd, &n, sizeof(n)) != sizeof(n)) return -1;
+    return n;
+#else
+    return -1;
+#endif
+  }
+};
+
+Instructions instructions;
+
+double now_ns() {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Result {
+  double ns;
+  double insns;  // < 0 = not counted
+  uint32_t sent;
+  uint32_t sum;
+  uint32_t dispatches;
+};
+
+// every step of every track through play, each followed by its track's held-gate off through off
+Result run(void (*play)(Seq&, uint8_t, const StepEvent&, uint32_t, uint32_t), void (*off)(Seq&, uint8_t)) {
+  seqr.voices.release_all(bench_note);
+  sent = 0;
+  sent_sum = 0;
+  uint32_t now = 1000000;
+  uint32_t dispatches = 0;
+  instructions.start();
+  double t0 = now_ns();
+  for (uint32_t r = 0; r < bench_rounds; ++r) {
+    for (uint8_t s = 0; s < num_steps; ++s) {
+      now += seqr.tick_micros;
+      for (uint8_t i = 0; i < numtracks; ++i) {
+        const StepEvent& ev = seqr.events[i][s];
+        if (!ev.on) continue;
+        play(seqr, i, ev, now, ev.gate_len * seqr.tick_micros / 16);
+        off(seqr, i);
+        dispatches += 2;
+      }
+      seqr.voices.release_due(now, bench_note);
+    }
+  }
+  double ns = now_ns() - t0;
+  long long n = instructions.stop();
+  return { ns / dispatches, n < 0 ? -1.0 : (double)n / dispatches, sent, sent_sum, dispatches };
+}
+
+int main() {
+  for (uint8_t p = 0; p < numpresets; ++p) {
+    for (uint8_t t = 0; t < numtracks; ++t) {
+      seqr.set_layer(p, t, SEQ_LAYER, (const uint8_t*)(*patterns[p])[t]);
+      seqr.set_layer(p, t, VEL_LAYER, (*velocities[p])[t]);
+      seqr.set_layer(p, t, NOTE_LAYER, (*notebanks[p])[t]);
+      seqr.set_layer(p, t, GATE_LAYER, (*gatebanks[p])[t]);
+      seqr.set_layer(p, t, CHORD_LAYER, (*chordbanks[p])[t]);
+    }
+  }
+  // a mix of modes, the two DAC tracks on NOTE & CC
+  const track_mode modes[numtracks] = { TRIGATE, TRIGATE, TRIGATE, CC, NOTE, CHORD, NOTE, CC };
+  for (uint8_t i = 0; i < numtracks; ++i) {
+    seqr.modes[i] = modes[i];
+    seqr.track_notes[i] = 36 + i;
+    seqr.track_chan[i] = i + 1;
+    seqr.trig_lens[i] = i == 2 ? 5 : 0;
+  }
+  seqr.analog_io = true;
+  seqr.on_func = bench_note;
+  seqr.off_func = bench_note;
+  seqr.cc_func = bench_cc;
+  seqr.cv_func = bench_cv;
+  seqr.pulse_func = bench_pulse;
+  seqr.gate_func = bench_gate;
+  seqr.set_tempo(120);
+  seqr.touch_all();
+  seqr.refresh();
+
+  Result sw = run(switch_play, switch_off);
+  Result tb = run(table_play, table_off);
+  bool same = sw.sent == tb.sent && sw.sum == tb.sum;
+  printf("%u step & note off dispatches, %u messages, %s\n", tb.dispatches, tb.sent, same ? "same output" : "OUTPUT DIFFERS");
+  printf("switch & inline tests: %6.2f ns/dispatch", sw.ns);
+  if (sw.insns >= 0) printf(", %6.1f instructions/dispatch", sw.insns);
+  printf("\nhandler table:         %6.2f ns/dispatch", tb.ns);
+  if (tb.insns >= 0) printf(", %6.1f instructions/dispatch", tb.insns);
+  printf("\n");
+  if (tb.insns < 0) printf("(no instruction counter here: perf_event_open refused)\n");
+  return same ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+/**
+ * bench_fire.cpp -- Step firing & edit cost of the event lists, for Multitrack Sequencer
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Fires every step of the factory presets through the engine's fire_step() (compiled event lists)
+ * and through the trigger path it replaced, which worked each step out from the layers as it
+ * fired: mode switch, probability & gate lookups, groove accent, float hz/V or V/oct per DAC
+ * step. Both send the same notes (checked), only the time per step differs. Then the same single
+ * step edits applied with touch_step() (the one event rebuilt) against touch() + refresh() (the
+ * whole list, as every key press & MIDI in message used to). Host times, so the ratios are what
+ * carry over to the board, not the nanoseconds, and the DAC rows understate it: the host does the
+ * old path's double exp() in hardware, the M4's FPU is single precision only.
+ *
+ * Build & run (from the sketch folder): g++ -std=c++17 -O2 -o bench_fire tools/bench_fire.cpp && ./bench_fire
+ */
+#include "arduino_host.h"
+#include <chrono>
+
+const bool marci_debug = false;
+
+#define Y_DIM 8
+#define X_DIM 8
+#define t_size Y_DIM * X_DIM
+
+const uint8_t numtracks = X_DIM;
+const uint8_t num_steps = t_size / 2;
+const uint8_t numpresets = X_DIM * 2;
+const uint16_t dacrange = 4095;
+const byte numdacs = 2;
+const byte cvpins[2] = { 14, 15 };
+const byte gatepins[numtracks] = { 4, 5, 6, 9, 10, 11, 12, 13 };
+uint8_t sel_track = 1;
+bool hzv[2] = { 1, 0 };
+
+#include "../multisequencer.h"
+#include "../save_locations.h"
+
+MultiStepSequencer<numtracks, numpresets, num_steps, numdacs, numarps> seqr;
+
+const uint32_t bench_rounds = 20000;  // passes over every step of every track
+const uint32_t bench_edits = 100000;
+
+uint32_t sent;
+uint32_t sent_sum;  // order sensitive, so both paths must send the same messages
+
+void bench_note(uint8_t note, uint8_t vel, uint8_t gate, bool, uint8_t chan) {
+  sent++;
+  sent_sum = sent_sum * 31 + (note << 16 | vel << 8 | chan) + gate;
+}
+
+void bench_cc(uint8_t cc, uint8_t val, bool, uint8_t chan) {
+  sent++;
+  sent_sum = sent_sum * 31 + (cc << 16 | val << 8 | chan);
+}
+
+void bench_cv(uint8_t, uint16_t val) {
+  sent_sum += val;
+}
+
+void bench_pulse(uint8_t, uint32_t) {}
+void bench_gate(uint8_t, uint8_t) {}
+
+typedef MultiStepSequencer<numtracks, numpresets, num_steps, numdacs, numarps> Seq;
+
+// the trigger path before the event lists, on today's working slots
+uint16_t old_cv(uint8_t i, uint8_t n) {
+  if (hzv[i - (numtracks - numdacs)] == 1) {
+    float val = constrain(map(125.0 * exp(0.0578 * ((n % 36) - 5)), 0, 5000, 0, dacrange), 0, dacrange);
+    return val;
+  }
+  float val = constrain(map(n % 36, 0, 36, 0, 3708), 0, dacrange);
+  return val;
+}
+
+void old_fire(Seq& q, uint8_t i, uint32_t now_micros) {
+  uint32_t micros_per_step = q.ticks_per_step * q.tick_micros;
+  uint8_t nstep = q.next_step(i);
+  q.multistepi[i] = nstep;
+  q.next_steps[i] = q.next_step(i);
+  uint8_t s = nstep;
+  q.outcomes[i] = q.probs[i][s] < 10 ? q.roll(i, q.track_steps[i]) <= q.probs[i][s] : 1;  // today's rolls
+  q.track_steps[i]++;
+  uint32_t gate_micros = (q.gates[i][s] * micros_per_step / 16) * (q.divs[i] + 1) / (q.muls[i] + 1);
+  uint32_t pulse_micros = q.trig_lens[i] ? q.trig_lens[i] * 1000 : gate_micros;
+  int16_t v = q.vels[i][s] + groove_templates[q.grooves[i]].vel[s % groove_len];
+  uint8_t vel = constrain(v, 1, 127);
+  bool cv = q.analog_io && i >= (numtracks - numdacs);
+  if (!(q.seqs[i][s] == 1 && q.mutes[i] == 0 ? q.outcomes[i] : false)) return;
+  switch (q.modes[i]) {
+    case TRIGATE:
+      q.held_gate_millis[i] = (now_micros + gate_micros) / 1000;
+      if (q.analog_io) q.pulse_func(i, pulse_micros);
+      q.on_func(q.track_notes[i] + q.transpose, vel, q.gates[i][s], true, q.track_chan[i]);
+      break;
+    case CC:
+      q.held_gate_millis[i] = (now_micros + gate_micros) / 1000;
+      if (cv) q.cv_func(cvpins[i - 6], old_cv(i, q.vels[i][s]));
+      if (q.analog_io) q.pulse_func(i, pulse_micros);
+      q.cc_func(q.track_notes[i], q.vels[i][s], true, q.track_chan[i]);
+      break;
+    case NOTE:
+      q.held_gate_millis[i] = (now_micros + gate_micros) / 1000;
+      q.held_gate_notes[i] = q.notes[i][s] + q.transpose;
+      q.held_gate_chans[i] = q.track_chan[i];
+      if (cv) q.cv_func(cvpins[i - 6], old_cv(i, q.notes[i][s]));
+      if (q.analog_io) q.pulse_func(i, pulse_micros);
+      q.on_func(q.notes[i][s] + q.transpose, vel, q.gates[i][s], true, q.track_chan[i]);
+      break;
+    default: break;
+  }
+}
+
+double now_ns() {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ns per fired step, sent & sent_sum left for the caller to compare
+template<typename Fire>
+double run_fires(Fire fire, uint8_t first = 0) {
+  sent = 0;
+  sent_sum = 0;
+  for (uint8_t i = 0; i < numtracks; ++i) {
+    seqr.multistepi[i] = seqr.next_steps[i] = 0;
+    seqr.track_steps[i] = 0;
+  }
+  double t0 = now_ns();
+  for (uint32_t r = 0; r < bench_rounds; ++r) {
+    host_micros += seqr.tick_micros;
+    for (uint8_t s = 0; s < num_steps; ++s) {
+      for (uint8_t i = first; i < numtracks; ++i) fire(i);
+    }
+  }
+  return (now_ns() - t0) / ((double)bench_rounds * num_steps * (numtracks - first));
+}
+
+int main() {
+  for (uint8_t p = 0; p < numpresets; ++p) {
+    for (uint8_t t = 0; t < numtracks; ++t) {
+      seqr.set_layer(p, t, SEQ_LAYER, (const uint8_t*)(*patterns[p])[t]);
+      seqr.set_layer(p, t, VEL_LAYER, (*velocities[p])[t]);
+      seqr.set_layer(p, t, NOTE_LAYER, (*notebanks[p])[t]);
+      seqr.set_layer(p, t, PROB_LAYER, (*probabilities[p])[t]);
+      seqr.set_layer(p, t, GATE_LAYER, (*gatebanks[p])[t]);
+      seqr.set_layer(p, t, NUDGE_LAYER, (const uint8_t*)(*nudgebanks[p])[t]);
+    }
+  }
+  // a mix of modes, DAC tracks on hz/V & V/oct, some steps left to chance
+  const track_mode modes[numtracks] = { TRIGATE, TRIGATE, TRIGATE, CC, NOTE, NOTE, NOTE, CC };
+  for (uint8_t i = 0; i < numtracks; ++i) {
+    seqr.modes[i] = modes[i];
+    seqr.track_notes[i] = 36 + i;
+    seqr.track_chan[i] = i + 1;
+    seqr.lengths[i] = num_steps;
+    seqr.offsets[i] = 0;
+    seqr.probs[i][3] = 6;
+    seqr.probs[i][11] = 3;
+  }
+  seqr.analog_io = true;
+  seqr.on_func = bench_note;
+  seqr.off_func = bench_note;
+  seqr.cc_func = bench_cc;
+  seqr.cv_func = bench_cv;
+  seqr.pulse_func = bench_pulse;
+  seqr.gate_func = bench_gate;
+  seqr.set_tempo(120);
+  seqr.touch_all();
+  seqr.refresh();
+
+  double old_ns = run_fires([](uint8_t i) { old_fire(seqr, i, host_micros); });
+  uint32_t old_sent = sent, old_sum = sent_sum;
+  double new_ns = run_fires([](uint8_t i) { seqr.fire_step(i, host_micros); });
+  bool same = sent == old_sent && sent_sum == old_sum;
+  printf("fire, %u steps: old trigger path %6.1f ns/step, event lists %6.1f ns/step (%.1fx), %u messages, %s\n",
+         bench_rounds * num_steps * numtracks, old_ns, new_ns, old_ns / new_ns, sent, same ? "same output" : "OUTPUT DIFFERS");
+
+  // the DAC tracks alone, where the old path did its float conversions
+  old_ns = run_fires([](uint8_t i) { old_fire(seqr, i, host_micros); }, numtracks - numdacs);
+  old_sent = sent, old_sum = sent_sum;
+  new_ns = run_fires([](uint8_t i) { seqr.fire_step(i, host_micros); }, numtracks - numdacs);
+  same = same && sent == old_sent && sent_sum == old_sum;
+  printf("fire, DAC tracks only:   old trigger path %6.1f ns/step, event lists %6.1f ns/step (%.1fx)\n", old_ns, new_ns, old_ns / new_ns);
+
+  // single step edits, as the grid & MIDI in make them
+  randomSeed(11);
+  uint32_t rebuilds = seqr.rebuilds;
+  double t0 = now_ns();
+  for (uint32_t e = 0; e < bench_edits; ++e) {
+    uint8_t i = random(numtracks), s = random(num_steps);
+    seqr.vels[i][s] = random(128);
+    seqr.touch(i);
+    seqr.refresh();
+  }
+  double whole_ns = (now_ns() - t0) / bench_edits;
+  uint32_t whole = seqr.rebuilds - rebuilds;
+  StepEvent after_whole[numtracks][num_steps];
+  for (uint8_t i = 0; i < numtracks; ++i) memcpy(after_whole[i], seqr.events[i], sizeof(after_whole[i]));
+
+  randomSeed(11);
+  rebuilds = seqr.rebuilds;
+  t0 = now_ns();
+  for (uint32_t e = 0; e < bench_edits; ++e) {
+    uint8_t i = random(numtracks), s = random(num_steps);
+    seqr.vels[i][s] = random(128);
+    seqr.touch_step(i, s);
+    seqr.refresh();
+  }
+  double step_ns = (now_ns() - t0) / bench_edits;
+  bool lists_same = seqr.rebuilds == rebuilds;
+  for (uint8_t i = 0; i < numtracks; ++i) lists_same = lists_same && !memcmp(after_whole[i], seqr.events[i], sizeof(after_whole[i]));
+  printf("edit, %u single steps: whole list %7.1f ns/edit (%u rebuilds), one event %6.1f ns/edit (%.1fx), %s\n",
+         bench_edits, whole_ns, whole, step_ns, whole_ns / step_ns, lists_same ? "same lists" : "LISTS DIFFER");
+  return same && lists_same ? 0 : 1;
+}
@@ -0,0 +1,274 @@
+/**
+ * bench_load.cpp -- Bank loading throughput & peak RAM, streaming reader against ArduinoJson, for Multitrack Sequencer
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Saves the factory banks (all seven layers of all presets) as the device does, into a scratch
+ * folder, then loads them all back again and again: through json_read_rows() (json_stream.h) and,
+ * when the ArduinoJson 6 library is on the include path, through the loader it replaced (one
+ * DynamicJsonDocument(8192) per file, values copied out of it). Both must load the same banks.
+ * Gives host throughput, heap high water (ArduinoJson's through a counting allocator; the stream
+ * reader allocates nothing) and stack high water of one load, found by painting the stack first.
+ * The stack figures include the host's own fopen() / fread() under File32, so a bare 64 byte read
+ * from the same place is given too: what's above that is the loader's.
+ *
+ * Build & run (from the sketch folder): g++ -std=c++17 -O2 -o bench_load tools/bench_load.cpp && ./bench_load
+ * with the old loader: add -I path/to/ArduinoJson/src (6.x, as the sketch used before json_stream.h)
+ */
+#include "arduino_host.h"
+#include <chrono>
+#include <string>
+#include <unistd.h>
+#include <sys/stat.h>
+#if __has_include(<ArduinoJson.h>)
+#include <ArduinoJson.h>
+#endif
+#if defined(ARDUINOJSON_VERSION_MAJOR) && ARDUINOJSON_VERSION_MAJOR == 6
+#define BENCH_ARDUINOJSON 1
+#else
+#define BENCH_ARDUINOJSON 0
+#endif
+
+const bool marci_debug = false;
+
+#define Y_DIM 8
+#define X_DIM 8
+#define t_size Y_DIM * X_DIM
+
+const uint8_t numtracks = X_DIM;
+const uint8_t num_steps = t_size / 2;
+const uint8_t numpresets = X_DIM * 2;
+
+#include "../save_locations.h"
+#include "../json_stream.h"
+
+const uint32_t bench_rounds = 200;
+const size_t bench_paint = 64 * 1024;
+
+// one layer's files & where they load, as bank_read() does on the device
+struct Layer {
+  const char* const* files;
+  const void* rom;  // [numpresets] banks
+  int32_t lo, hi;
+  uint8_t kind;     // 0 = bool, 1 = uint8_t, 2 = int8_t
+};
+
+const Layer layers[] = {
+  { pfiles, patterns, 0, 1, 0 },
+  { vfiles, velocities, 0, 127, 1 },
+  { nfiles, notebanks, 0, 127, 1 },
+  { prbfiles, probabilities, 0, 255, 1 },
+  { gfiles, gatebanks, 0, 255, 1 },
+  { nudgefiles, nudgebanks, -128, 127, 2 },
+  { chordfiles, chordbanks, 0, 255, 1 },
+};
+const uint8_t layers_cnt = sizeof(layers) / sizeof(layers[0]);
+
+uint8_t loaded[layers_cnt][numpresets][numtracks][num_steps];  // every value, as a byte
+
+const uint8_t* rom_bank(const Layer& l, uint8_t p) {
+  if (l.kind == 0) return (const uint8_t*)*((const PatternBank* const*)l.rom)[p];
+  if (l.kind == 2) return (const uint8_t*)*((const NudgeBank* const*)l.rom)[p];
+  return (const uint8_t*)*((const StepBank* const*)l.rom)[p];
+}
+
+bool save_banks() {
+  for (uint8_t k = 0; k < layers_cnt; ++k) {
+    for (uint8_t p = 0; p < numpresets; ++p) {
+      File32 file = fatfs.open(layers[k].files[p], FILE_WRITE);
+      if (!file) return false;
+      const uint8_t* b = rom_bank(layers[k], p);
+      if (layers[k].kind == 0) json_write_rows(file, (const bool*)b, numtracks, num_steps);
+      else if (layers[k].kind == 2) json_write_rows(file, (const int8_t*)b, numtracks, num_steps);
+      else json_write_rows(file, b, numtracks, num_steps);
+      file.close();
+    }
+  }
+  return true;
+}
+
+bool stream_load(uint8_t k, uint8_t p) {
+  const Layer& l = layers[k];
+  File32 file = fatfs.open(l.files[p], FILE_READ);
+  if (!file) return false;
+  uint8_t* out = &loaded[k][p][0][0];
+  bool ok;
+  if (l.kind == 0) ok = json_read_rows(file, (bool*)out, numtracks, num_steps, l.lo, l.hi);
+  else if (l.kind == 2) ok = json_read_rows(file, (int8_t*)out, numtracks, num_steps, l.lo, l.hi);
+  else ok = json_read_rows(file, out, numtracks, num_steps, l.lo, l.hi);
+  file.close();
+  return ok;
+}
+
+#if BENCH_ARDUINOJSON
+size_t heap_now, heap_peak;
+
+struct CountingAllocator {
+  void* allocate(size_t n) {
+    size_t* p = (size_t*)malloc(n + sizeof(size_t));
+    if (!p) return nullptr;
+    *p = n;
+    heap_now += n;
+    if (heap_now > heap_peak) heap_peak = heap_now;
+    return p + 1;
+  }
+  void deallocate(void* ptr) {
+    if (!ptr) return;
+    size_t* p = (size_t*)ptr - 1;
+    heap_now -= *p;
+    free(p);
+  }
+  void* reallocate(void* ptr, size_t n) {
+    if (!ptr) return allocate(n);
+    size_t* p = (size_t*)ptr - 1;
+    size_t was = *p;
+    p = (size_t*)realloc(p, n + sizeof(size_t));
+    if (!p) return nullptr;
+    *p = n;
+    heap_now = heap_now - was + n;
+    if (heap_now > heap_peak) heap_peak = heap_now;
+    return p + 1;
+  }
+};
+
+// File32 as an ArduinoJson reader (a Stream on the device)
+struct FileReader {
+  File32& file;
+  int read() {
+    uint8_t c;
+    return file.read(&c, 1) == 1 ? c : -1;
+  }
+  size_t readBytes(char* b, size_t n) {
+    int r = file.read(b, n);
+    return r > 0 ? r : 0;
+  }
+};
+
+template<typename T>
+void copy_out(BasicJsonDocument<CountingAllocator>& doc, T* out) {
+  for (int j = 0; j < numtracks; j++) {
+    JsonArray a = doc[j];
+    for (int i = 0; i < num_steps; i++) out[j * num_steps + i] = a[i].as<T>();
+  }
+}
+
+// the loader before json_stream.h
+bool arduinojson_load(uint8_t k, uint8_t p) {
+  const Layer& l = layers[k];
+  BasicJsonDocument<CountingAllocator> doc(8192);
+  File32 file = fatfs.open(l.files[p], FILE_READ);
+  if (!file) return false;
+  FileReader reader = { file };
+  DeserializationError error = deserializeJson(doc, reader);
+  file.close();
+  if (error) return false;
+  uint8_t* out = &loaded[k][p][0][0];
+  if (l.kind == 0) copy_out(doc, (bool*)out);
+  else if (l.kind == 2) copy_out(doc, (int8_t*)out);
+  else copy_out(doc, out);
+  return true;
+}
+#endif
+
+// a 64 byte read from where a loader would start, for the stack figures
+bool bare_read(uint8_t k, uint8_t p) {
+  File32 file = fatfs.open(layers[k].files[p], FILE_READ);
+  if (!file) return false;
+  uint8_t buf[json_buf_size];
+  bool ok = file.read(buf, sizeof(buf)) > 0;
+  file.close();
+  return ok;
+}
+
+__attribute__((noinline)) void paint_stack() {
+  uint8_t pad[bench_paint];
+  volatile uint8_t* p = pad;
+  for (size_t i = 0; i < bench_paint; ++i) p[i] = 0xA5;
+}
+
+// bytes below this frame touched since paint_stack()
+__attribute__((noinline)) size_t stack_touched() {
+  uint8_t pad[bench_paint];
+  volatile uint8_t* p = pad;  // left as the loader left it, not initialised
+  size_t i = 0;
+  while (i < bench_paint && p[i] == 0xA5) i++;
+  return bench_paint - i;
+}
+
+double now_ns() {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Result {
+  double ns;      // per file
+  size_t stack;   // high water of one load
+  bool same;      // loaded the ROM banks back
+  uint32_t fails;
+};
+
+Result run(bool (*load)(uint8_t, uint8_t)) {
+  Result r = { 0, 0, true, 0 };
+  for (uint8_t k = 0; k < layers_cnt; ++k) {
+    for (uint8_t p = 0; p < numpresets; ++p) {
+      paint_stack();
+      load(k, p);
+      size_t s = stack_touched();
+      if (s > r.stack) r.stack = s;
+    }
+  }
+  memset(loaded, 0, sizeof(loaded));
+  double t0 = now_ns();
+  for (uint32_t n = 0; n < bench_rounds; ++n) {
+    for (uint8_t k = 0; k < layers_cnt; ++k) {
+      for (uint8_t p = 0; p < numpresets; ++p) r.fails += !load(k, p);
+    }
+  }
+  r.ns = (now_ns() - t0) / ((double)bench_rounds * layers_cnt * numpresets);
+  for (uint8_t k = 0; k < layers_cnt; ++k) {
+    for (uint8_t p = 0; p < numpresets; ++p) r.same = r.same && !memcmp(loaded[k][p], rom_bank(layers[k], p), sizeof(loaded[k][p]));
+  }
+  return r;
+}
+
+int main() {
+  char dir[] = "/tmp/bench_load_XXXXXX";
+  if (!mkdtemp(dir)) return 1;
+  snprintf(fatfs.root, sizeof(fatfs.root), "%s", dir);
+  std::string sub = std::string(dir) + "/M4SEQ32";
+  mkdir(sub.c_str(), 0755);
+  if (!save_banks()) {
+    printf("can't write the banks under %s\n", dir);
+    return 1;
+  }
+
+  Result bare = run(bare_read);
+  json_bytes = 0;
+  Result js = run(stream_load);
+  double file_bytes = (double)json_bytes / (bench_rounds + 1) / (layers_cnt * numpresets);
+  printf("%d bank files, %.0f bytes each, loaded %u times\n", layers_cnt * numpresets, file_bytes, bench_rounds);
+  printf("bare 64 byte read:    stack %5zu bytes\n", bare.stack);
+  printf("json_stream.h:        %7.1f us/file, %6.1f MB/s, heap     0 bytes, stack %5zu bytes (JsonStream %zu), %s\n",
+         js.ns / 1000, file_bytes * 1000 / js.ns, js.stack, sizeof(JsonStream), js.same && !js.fails ? "banks ok" : "BANKS DIFFER");
+  bool ok = js.same && !js.fails;
+#if BENCH_ARDUINOJSON
+  heap_peak = 0;
+  Result aj = run(arduinojson_load);
+  printf("ArduinoJson %d.%d.%d:   %7.1f us/file, %6.1f MB/s, heap %5zu bytes, stack %5zu bytes, %s\n", ARDUINOJSON_VERSION_MAJOR,
+         ARDUINOJSON_VERSION_MINOR, ARDUINOJSON_VERSION_REVISION, aj.ns / 1000, file_bytes * 1000 / aj.ns, heap_peak, aj.stack,
+         aj.same && !aj.fails ? "banks ok" : "BANKS DIFFER");
+  printf("stream reader: %.1fx the throughput\n", aj.ns / js.ns);
+  ok = ok && aj.same && !aj.fails;
+#else
+  printf("ArduinoJson 6 not on the include path: old loader not run\n");
+#endif
+
+  for (uint8_t k = 0; k < layers_cnt; ++k) {
+    for (uint8_t p = 0; p < numpresets; ++p) {
+      std::string f = std::string(dir) + layers[k].files[p];
+      unlink(f.c_str());
+    }
+  }
+  rmdir(sub.c_str());
+  rmdir(dir);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+/**
+ * bench_save.cpp -- Preset store footprint & bank files written by SAVE, for Multitrack Sequencer
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Loads the factory banks into the engine as the device does at a factory reset and gives what
+ * the preset store (preset_store.h) holds them in: arena bytes with shared blocks, what the same
+ * blocks would take unshared, and the raw layers. Then runs SAVE's bank writes (bank_save() in
+ * journal.h, to a scratch folder) after a series of edits and counts the bank files written and
+ * skipped, and the bytes written: every one of the banks was rewritten by each SAVE before bank
+ * hashes, so that's the before. Flash time on the board goes with the files & bytes written
+ * (erase, write, rename); the host times are given, but are the host's file system.
+ *
+ * Build & run (from the sketch folder): g++ -std=c++17 -O2 -o bench_save tools/bench_save.cpp && ./bench_save
+ */
+#include "arduino_host.h"
+#include <chrono>
+#include <string>
+#include <sys/stat.h>
+
+const bool marci_debug = false;
+
+#define Y_DIM 8
+#define X_DIM 8
+#define t_size Y_DIM * X_DIM
+
+const uint8_t numtracks = X_DIM;
+const uint8_t num_steps = t_size / 2;
+const uint8_t numpresets = X_DIM * 2;
+const uint16_t dacrange = 4095;
+const byte numdacs = 2;
+const byte cvpins[2] = { 14, 15 };
+const byte gatepins[numtracks] = { 4, 5, 6, 9, 10, 11, 12, 13 };
+uint8_t sel_track = 1;
+bool hzv[2] = { 0, 0 };
+
+#include "../multisequencer.h"
+#include "../save_locations.h"
+
+MultiStepSequencer<numtracks, numpresets, num_steps, numdacs, numarps> seqr;
+
+#include "../json_stream.h"
+
+void undo_record(uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t) {}
+void undo_close() {}
+
+#include "../journal.h"
+
+const uint16_t bench_banks = journal_layers * numpresets;
+size_t saved_bytes;  // by the last save()
+
+double now_ms() {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+size_t file_size(const char* path) {
+  std::string full = std::string(fatfs.root) + path;
+  struct stat st;
+  return stat(full.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+// every bank through bank_save(), as SAVE does; prints what it wrote
+bool save(const char* what) {
+  uint32_t writes = bank_writes, skips = bank_skips;
+  size_t bytes = 0;
+  double t0 = now_ms();
+  for (uint8_t l = 0; l < journal_layers; ++l) {
+    for (uint8_t p = 0; p < numpresets; ++p) {
+      uint32_t w = bank_writes;
+      if (!bank_save(l, p)) return false;
+      if (bank_writes != w) bytes += file_size(layer_files[l][p]);
+    }
+  }
+  double ms = now_ms() - t0;
+  saved_bytes = bytes;
+  printf("%-40s %3u banks written, %3u unchanged, %6zu bytes, %6.2f ms host\n", what, bank_writes - writes, bank_skips - skips, bytes, ms);
+  return true;
+}
+
+void edit(uint8_t p, uint8_t t, uint8_t l, uint8_t s, uint8_t v) {
+  TrackPreset<num_steps> tp;
+  seqr.get_preset(p, t, tp);
+  tp.layer[l][s] = v;
+  seqr.put_preset(p, t, tp);
+}
+
+void factory() {
+  for (uint8_t p = 0; p < numpresets; ++p) {
+    for (uint8_t t = 0; t < numtracks; ++t) {
+      seqr.set_layer(p, t, SEQ_LAYER, (const uint8_t*)(*patterns[p])[t]);
+      seqr.set_layer(p, t, VEL_LAYER, (*velocities[p])[t]);
+      seqr.set_layer(p, t, NOTE_LAYER, (*notebanks[p])[t]);
+      seqr.set_layer(p, t, PROB_LAYER, (*probabilities[p])[t]);
+      seqr.set_layer(p, t, GATE_LAYER, (*gatebanks[p])[t]);
+      seqr.set_layer(p, t, NUDGE_LAYER, (const uint8_t*)(*nudgebanks[p])[t]);
+      seqr.set_layer(p, t, CHORD_LAYER, (*chordbanks[p])[t]);
+    }
+  }
+}
+
+int main() {
+  factory();
+  uint32_t unshared = 0;
+  for (uint16_t b = 0; b < sizeof(seqr.store.blocks) / sizeof(seqr.store.blocks[0]); ++b) {
+    unshared += (uint32_t)seqr.store.blocks[b].refs * seqr.store.blocks[b].size;
+  }
+  printf("preset store, factory banks: %u bytes in %u blocks, %u unshared, %u raw (%u byte arena)\n", seqr.store.used,
+         seqr.store.blocks_used, unshared, numpresets * numtracks * num_steps * preset_layers, (unsigned)sizeof(seqr.store.arena));
+
+  char dir[] = "/tmp/bench_save_XXXXXX";
+  if (!mkdtemp(dir)) return 1;
+  snprintf(fatfs.root, sizeof(fatfs.root), "%s", dir);
+  std::string sub = std::string(dir) + "/M4SEQ32";
+  mkdir(sub.c_str(), 0755);
+
+  bool ok = save("first SAVE, empty drive:");
+  printf("(before bank hashes, every SAVE wrote all %u banks, %zu bytes)\n", bench_banks, saved_bytes);
+  ok = ok && save("SAVE again, nothing changed:");
+  edit(0, 0, VEL_LAYER, 3, 99);
+  ok = ok && save("one step's velocity edited:");
+  for (uint8_t t = 0; t < numtracks; ++t) edit(t, t, t % preset_layers, t, 1 + t);
+  ok = ok && save("8 single step edits, 8 presets:");
+  randomSeed(2);
+  for (uint8_t p = 0; p < 4; ++p) {
+    for (uint8_t t = 0; t < numtracks; ++t) {
+      for (uint8_t l = 0; l < preset_layers; ++l) edit(p, t, l, random(num_steps), l == SEQ_LAYER ? 1 : 2 + random(100));
+    }
+  }
+  ok = ok && save("every layer of 4 presets edited:");
+  factory();
+  ok = ok && save("factory reset:");
+
+  for (uint8_t l = 0; l < journal_layers; ++l) {
+    for (uint8_t p = 0; p < numpresets; ++p) fatfs.remove(layer_files[l][p]);
+  }
+  rmdir(sub.c_str());
+  rmdir(dir);
+  if (!ok) printf("a bank write FAILED\n");
+  return ok ? 0 : 1;
+}
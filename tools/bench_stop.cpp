@@ -0,0 +1,150 @@
+/**
+ * bench_stop.cpp -- Note offs sent on Stop, old per-mode loop against the sounding-note bitmap, for Multitrack Sequencer
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Plays random patterns (gates up to a whole step) on every mode: TRIGATE, CC, NOTE, CHORD, and ARP
+ * on held notes, for a random while, then stops, again and again. At each stop it counts the note
+ * offs the stop loop before active_notes.h would have sent (one per TRIGATE track, one per step per NOTE track, the
+ * chord voices, nothing for CC or ARP) and which sounding notes it would have left hanging, then
+ * calls stop() (panic()) and counts what it really sends. The device's send_note_on / send_note_off
+ * are mimicked: ons set the bitmap, offs only go out if the note was sounding. The control notes
+ * on channel 16 go the same either way and aren't counted.
+ *
+ * Build & run (from the sketch folder): g++ -std=c++17 -O2 -o bench_stop tools/bench_stop.cpp && ./bench_stop
+ */
+#include "arduino_host.h"
+
+const bool marci_debug = false;
+
+#define Y_DIM 8
+#define X_DIM 8
+#define t_size Y_DIM * X_DIM
+
+const uint8_t numtracks = X_DIM;
+const uint8_t num_steps = t_size / 2;
+const uint8_t numpresets = X_DIM * 2;
+const uint16_t dacrange = 4095;
+const byte numdacs = 2;
+const byte cvpins[2] = { 14, 15 };
+const byte gatepins[numtracks] = { 4, 5, 6, 9, 10, 11, 12, 13 };
+uint8_t sel_track = 1;
+bool hzv[2] = { 0, 0 };
+
+#include "../multisequencer.h"
+
+MultiStepSequencer<numtracks, numpresets, num_steps, numdacs, numarps> seqr;
+
+const uint32_t bench_stops = 10000;
+const uint32_t bench_max_ticks = 4 * ticks_per_quarternote * 4;  // up to 4 bars between stops
+
+uint32_t offs_sent;  // on the track channels
+
+// the device's send_note_on / send_note_off
+void bench_note_on(uint8_t note, uint8_t, uint8_t, bool on, uint8_t chan) {
+  if (on) active_notes.on(note, chan);
+}
+
+void bench_note_off(uint8_t note, uint8_t, uint8_t, bool on, uint8_t chan) {
+  if (on && active_notes.off(note, chan) && chan != seqr.ctrl_chan) offs_sent++;
+}
+
+void bench_cc(uint8_t, uint8_t, bool, uint8_t) {}
+
+// what the old stop loop sent, unconditionally; anything it missed is cleared from sounding
+uint32_t old_stop(uint32_t (&sounding)[16][4]) {
+  uint32_t sent = 0;
+  auto off = [&](uint8_t note, uint8_t chan) {
+    sent++;
+    if (chan >= 1 && chan <= 16 && note <= 127) sounding[chan - 1][note >> 5] &= ~(1UL << (note & 31));
+  };
+  for (uint8_t i = 0; i < numtracks; ++i) {
+    switch (seqr.modes[i]) {
+      case TRIGATE:
+        off(seqr.track_notes[i] + seqr.transpose, seqr.track_chan[i]);
+        break;
+      case NOTE:
+        for (uint8_t k = 0; k < num_steps; ++k) off(seqr.notes[i][k] + seqr.transpose, seqr.track_chan[i]);
+        break;
+      default: break;
+    }
+  }
+  for (uint8_t v = 0; v < seqr.voices.count; ++v) off(seqr.voices.heap[v].note, seqr.voices.heap[v].chan);
+  return sent;
+}
+
+uint16_t count_bits(const uint32_t (&bits)[16][4], uint8_t skip_chan) {
+  uint16_t n = 0;
+  for (uint8_t c = 0; c < 16; ++c) {
+    if (c + 1 == skip_chan) continue;
+    for (uint8_t w = 0; w < 4; ++w) n += __builtin_popcount(bits[c][w]);
+  }
+  return n;
+}
+
+int main() {
+  randomSeed(5);
+  const track_mode modes[numtracks] = { TRIGATE, TRIGATE, CC, NOTE, NOTE, CHORD, ARP, ARP };
+  for (uint8_t i = 0; i < numtracks; ++i) {
+    seqr.modes[i] = modes[i];
+    seqr.track_notes[i] = 36 + i;
+    seqr.track_chan[i] = i + 1;
+    for (uint8_t s = 0; s < num_steps; ++s) {
+      seqr.seqs[i][s] = random(3) != 0;
+      seqr.notes[i][s] = 36 + random(36);
+      seqr.vels[i][s] = 1 + random(127);
+      seqr.probs[i][s] = random(4) ? 10 : random(10);
+      seqr.gates[i][s] = 1 + random(15);
+      seqr.chords[i][s] = random(4);
+    }
+  }
+  uint8_t held[] = { 48, 55, 60, 63 };
+  for (uint8_t n = 0; n < 4; ++n) {
+    arps[6].NoteOn(held[n]);
+    if (n < 3) arps[7].NoteOn(held[n]);
+  }
+  arp_patterns[6] = 3;
+  arp_octaves[6] = 2;
+  arp_patterns[7] = 7;
+  arp_octaves[7] = 1;
+  seqr.on_func = bench_note_on;
+  seqr.off_func = bench_note_off;
+  seqr.cc_func = bench_cc;
+  seqr.set_tempo(120);
+  seqr.touch_all();
+
+  uint64_t old_msgs = 0, new_msgs = 0, old_hanging = 0, new_hanging = 0, sounding_total = 0;
+  uint32_t old_worst = 0, new_worst = 0, old_hung_stops = 0;
+  host_micros = 1000000;
+  for (uint32_t s = 0; s < bench_stops; ++s) {
+    seqr.reset();
+    seqr.play();
+    uint32_t ticks = 1 + random(bench_max_ticks);
+    for (uint32_t t = 0; t < ticks; ++t) {
+      host_micros += seqr.tick_micros;
+      seqr.refresh();
+      seqr.tick(host_micros);
+    }
+    uint32_t sounding[16][4];
+    memcpy(sounding, active_notes.bits, sizeof(sounding));
+    sounding_total += count_bits(sounding, seqr.ctrl_chan);
+    uint32_t o = old_stop(sounding);
+    uint16_t hung = count_bits(sounding, seqr.ctrl_chan);
+    old_msgs += o;
+    old_hanging += hung;
+    old_hung_stops += hung != 0;
+    if (o > old_worst) old_worst = o;
+
+    offs_sent = 0;
+    seqr.stop();
+    new_msgs += offs_sent;
+    new_hanging += active_notes.count();
+    if (offs_sent > new_worst) new_worst = offs_sent;
+  }
+  printf("%u stops, %.2f notes sounding per stop\n", bench_stops, (double)sounding_total / bench_stops);
+  printf("old stop loop: %6.2f note offs/stop (worst %3u), %.2f notes left hanging/stop, on %u stops\n",
+         (double)old_msgs / bench_stops, old_worst, (double)old_hanging / bench_stops, old_hung_stops);
+  printf("bitmap panic:  %6.2f note offs/stop (worst %3u), %.2f notes left hanging/stop\n",
+         (double)new_msgs / bench_stops, new_worst, (double)new_hanging / bench_stops);
+  return new_hanging ? 1 : 0;
+}
@@ -0,0 +1,395 @@
+/**
+ * render_smf.cpp -- Render banks to Standard MIDI Files, for Multitrack Sequencer (for Feather M4 Express)
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Builds the sequencer engine itself (multisequencer.h, as it runs on the board) for the desktop,
+ * loads the banks & settings from a copy of the flash drive, and plays N bars on a virtual clock:
+ * every engine tick runs straight after the last, micros() & millis() reading whatever time that
+ * tick is due, so the file holds exactly what the device would send (microtiming, grooves,
+ * probability, note offs, song hand-overs) as fast as the CPU goes. The engine only moves notes on
+ * its 96 PPQN ticks, so the file uses the same division and nothing is rounded. One file track per
+ * MIDI channel, plus the tempo track. Missing or rejected files fall back to the ROM defaults, as on
+ * the device. ARP tracks follow held MIDI input, so they stay silent here.
+ *
+ * Build (from the sketch folder): g++ -std=c++17 -O2 -o render_smf tools/render_smf.cpp
+ * Usage: render_smf [options] out.mid
+ *   -d dir      folder holding M4SEQ32 (the drive's root, or a copy of it), default .
+ *   -b bars     4/4 bars to render, default 4
+ *   -t bpm      tempo, default the saved one
+ *   -r seed     probability seed, default 1
+ *   -S          play the saved song from its first entry
+ * and per track, as a list (v,v,... one per track, blank = as saved):
+ *   -p presets (0 - 15)   -m mutes (0 / 1)      -l lengths (1 - 32)   -o offsets (0 - 32)
+ *   -v divs (0 - 7)       -x muls (0 - 7)       -g grooves (0 - 7, see grooves.h)
+ */
+#include "arduino_host.h"
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+
+const bool marci_debug = false;
+
+#define Y_DIM 8
+#define X_DIM 8
+#define t_size Y_DIM * X_DIM
+
+const uint8_t numtracks = X_DIM;
+const uint8_t num_steps = t_size / 2;
+const uint8_t numpresets = X_DIM * 2;
+const uint16_t dacrange = 4095;
+const byte numdacs = 2;
+const byte cvpins[2] = { 14, 15 };
+const byte gatepins[numtracks] = { 4, 5, 6, 9, 10, 11, 12, 13 };
+uint8_t sel_track = 1;
+bool hzv[2] = { 0, 0 };
+
+#include "../multisequencer.h"
+#include "../save_locations.h"
+
+MultiStepSequencer<numtracks, numpresets, num_steps, numdacs, numarps> seqr;
+
+#include "../song.h"
+#include "../json_stream.h"
+
+const uint32_t render_start_micros = 1000000;  // a held gate due at 0 ms would read as none
+const uint8_t render_max_list = numtracks;
+
+typedef struct {
+  uint32_t tick;
+  uint8_t status;
+  uint8_t d1;
+  uint8_t d2;
+} RenderEvent;
+
+std::vector<RenderEvent> render_events[16];  // by channel
+uint32_t render_tick;
+float render_tempo = 120;
+int render_step_size = SIXTEENTH_NOTE;
+
+void render_add(uint8_t status, uint8_t chan, uint8_t d1, uint8_t d2) {
+  if (chan == 0 || chan > 16) return;
+  RenderEvent e = { render_tick, (uint8_t)(status | (chan - 1)), d1, d2 };
+  render_events[chan - 1].push_back(e);
+}
+
+// the device's send_note_on / send_note_off / send_cc, into the file instead
+void render_note_on(uint8_t note, uint8_t vel, uint8_t, bool on, uint8_t chan) {
+  if (!on) return;
+  active_notes.on(note, chan);
+  render_add(0x90, chan, note, vel);
+}
+
+void render_note_off(uint8_t note, uint8_t vel, uint8_t, bool on, uint8_t chan) {
+  if (on && active_notes.off(note, chan)) render_add(0x80, chan, note, vel);
+}
+
+void render_cc(uint8_t cc, uint8_t val, bool on, uint8_t chan) {
+  if (on) render_add(0xB0, chan, cc, val);
+}
+
+// layer l of preset p, as bank_read() does on the device
+template<typename T>
+bool render_bank(const char* path, uint8_t l, uint8_t p, const T (&rom)[numtracks][num_steps], int32_t lo, int32_t hi) {
+  T bank[numtracks][num_steps];
+  File32 file = fatfs.open(path, FILE_READ);
+  bool ok = false;
+  if (file) {
+    ok = json_read_rows(file, &bank[0][0], numtracks, num_steps, lo, hi);
+    file.close();
+    if (!ok) fprintf(stderr, "rejected %s, using ROM default\n", path);
+  }
+  if (!ok) memcpy(bank, rom, sizeof(bank));
+  for (uint8_t t = 0; t < numtracks; ++t) {
+    if (!seqr.set_layer(p, t, l, (const uint8_t*)bank[t])) fprintf(stderr, "preset store full at %s\n", path);
+  }
+  return ok;
+}
+
+// number of bank files found & accepted
+uint16_t render_banks() {
+  uint16_t n = 0;
+  for (uint8_t p = 0; p < numpresets; ++p) {
+    n += render_bank(pfiles[p], SEQ_LAYER, p, *patterns[p], 0, 1);
+    n += render_bank(vfiles[p], VEL_LAYER, p, *velocities[p], 0, 127);
+    n += render_bank(nfiles[p], NOTE_LAYER, p, *notebanks[p], 0, 127);
+    n += render_bank(prbfiles[p], PROB_LAYER, p, *probabilities[p], 0, 255);
+    n += render_bank(gfiles[p], GATE_LAYER, p, *gatebanks[p], 0, 255);
+    n += render_bank(nudgefiles[p], NUDGE_LAYER, p, *nudgebanks[p], -128, 127);
+    n += render_bank(chordfiles[p], CHORD_LAYER, p, *chordbanks[p], 0, 255);
+  }
+  return n;
+}
+
+// the settings the engine plays from, read as settings_read() does (same order & fallbacks,
+// see saved_settings.h); the rest are the grid's & clock's
+bool render_settings() {
+  int16_t set_array[settings_fields];
+  uint8_t set_len = settings_fields;
+  File32 file = fatfs.open(settings_file, FILE_READ);
+  bool ok = file && json_read_rows(file, set_array, 1, settings_fields, -32768, 32767, &set_len);
+  file.close();
+  if (!ok) {
+    memcpy(set_array, factory_settings, sizeof(set_array));
+    set_len = settings_fields;
+  }
+  render_tempo = set_array[0];
+  render_step_size = set_array[1];
+  seqr.transpose = set_array[2];
+  uint8_t z = 3;
+  for (uint8_t i = 0; i < 8; ++i) seqr.track_notes[i] = set_array[z++];
+  for (uint8_t i = 0; i < 3; ++i) seqr.ctrl_notes[i] = set_array[z++];
+  for (uint8_t i = 0; i < 8; ++i) seqr.track_chan[i] = set_array[z++];
+  seqr.ctrl_chan = set_array[z] > 0 ? set_array[z] : seqr.ctrl_chan;
+  uint8_t legacy_swing = set_array[z + 1];
+  z = z + 3;
+  for (uint8_t i = 0; i < 8; ++i, ++z) seqr.modes[i] = set_array[z] > 0 ? (track_mode)set_array[z] : TRIGATE;
+  z = z + 2;  // Hz/V
+  for (uint8_t i = 0; i < 8; ++i) seqr.divs[i] = set_array[z++];
+  for (uint8_t i = 0; i < 8; ++i) seqr.offsets[i] = set_array[z++];
+  for (uint8_t i = 0; i < 8; ++i) seqr.lengths[i] = set_array[z++];
+  for (uint8_t i = 0; i < 8; ++i) seqr.trig_lens[i] = set_array[z++];
+  z = z + 2;  // clock out & in PPQN
+  for (uint8_t i = 0; i < 8; ++i, ++z) {
+    uint8_t g = set_array[z];
+    seqr.grooves[i] = z >= set_len ? groove_from_swing(legacy_swing) : (g < grooves_cnt ? g : 0);
+  }
+  for (uint8_t i = 0; i < 8; ++i, ++z) {
+    uint8_t m = set_array[z];
+    seqr.muls[i] = m < X_DIM ? m : 0;
+  }
+  z = z + 16;  // MIDI in routes
+  for (uint8_t i = 0; i < 8; ++i, ++z) {
+    uint8_t sc = set_array[z];
+    seqr.scales[i] = sc < scales_cnt ? sc : 0;
+  }
+  for (uint8_t i = 0; i < 8; ++i, ++z) {
+    uint8_t r = set_array[z];
+    seqr.roots[i] = r < 12 ? r : 0;
+  }
+  for (uint8_t i = 0; i < 8; ++i, ++z) {
+    int8_t d = set_array[z];
+    seqr.degrees[i] = constrain(d, -scale_max_degrees, scale_max_degrees);
+    seqr.set_scale(i);
+  }
+  return ok;
+}
+
+// saved song, as song_read() does (no file = no song)
+bool render_song() {
+  song_len = 0;
+  File32 file = fatfs.open(song_file, FILE_READ);
+  if (!file) return false;
+  uint8_t entries[song_max][numtracks + 1];
+  uint8_t lens[song_max];
+  bool ok = json_read_rows(file, &entries[0][0], song_max, numtracks + 1, 0, 255, lens);
+  file.close();
+  if (!ok) return false;
+  for (uint8_t e = 0; e < song_max; ++e) {
+    if (lens[e] <= numtracks) break;
+    for (uint8_t i = 0; i < numtracks; ++i) {
+      uint8_t p = entries[e][i];
+      song[e].presets[i] = p < numpresets ? p : 0;
+    }
+    uint8_t r = entries[e][numtracks];
+    song[e].repeats = constrain(r, 1, song_max_repeats);
+    song_len++;
+  }
+  return song_len > 0;
+}
+
+// "v,v,..." into vals, given[t] = track t had one. false = not a number or outside lo - hi
+bool render_list(const char* arg, int32_t lo, int32_t hi, int32_t* vals, bool* given) {
+  for (uint8_t t = 0; t < render_max_list; ++t) given[t] = false;
+  for (uint8_t t = 0; *arg && t < render_max_list; ++t) {
+    if (*arg != ',') {
+      char* end;
+      long v = strtol(arg, &end, 10);
+      if (end == arg || v < lo || v > hi) return false;
+      vals[t] = v;
+      given[t] = true;
+      arg = end;
+    }
+    if (*arg == ',') arg++;
+    else if (*arg) return false;
+  }
+  return *arg == 0;
+}
+
+void put_be(std::vector<uint8_t>& out, uint32_t v, uint8_t n) {
+  while (n--) out.push_back(v >> (8 * n));
+}
+
+void put_vlq(std::vector<uint8_t>& out, uint32_t v) {
+  uint8_t b[5];
+  uint8_t n = 0;
+  do {
+    b[n++] = v & 0x7F;
+    v >>= 7;
+  } while (v);
+  while (n--) out.push_back(b[n] | (n ? 0x80 : 0));
+}
+
+void put_name(std::vector<uint8_t>& out, const char* name) {
+  put_vlq(out, 0);
+  out.push_back(0xFF);
+  out.push_back(0x03);
+  put_vlq(out, strlen(name));
+  out.insert(out.end(), name, name + strlen(name));
+}
+
+void put_track(std::vector<uint8_t>& file, const std::vector<uint8_t>& trk) {
+  file.insert(file.end(), { 'M', 'T', 'r', 'k' });
+  put_be(file, trk.size(), 4);
+  file.insert(file.end(), trk.begin(), trk.end());
+}
+
+// type 1 file: tempo track, then a track per channel that played. Returns tracks written
+uint8_t render_write(FILE* f, uint32_t end_tick) {
+  std::vector<uint8_t> file;
+  uint8_t tracks = 1;
+  for (uint8_t c = 0; c < 16; ++c) tracks += !render_events[c].empty();
+  file.insert(file.end(), { 'M', 'T', 'h', 'd' });
+  put_be(file, 6, 4);
+  put_be(file, 1, 2);
+  put_be(file, tracks, 2);
+  put_be(file, ticks_per_quarternote, 2);
+
+  std::vector<uint8_t> trk;
+  put_name(trk, "M4SEQ32");
+  put_vlq(trk, 0);
+  trk.insert(trk.end(), { 0xFF, 0x51, 0x03 });
+  put_be(trk, seqr.tick_micros * ticks_per_quarternote, 3);  // the device's own rounding
+  put_vlq(trk, 0);
+  trk.insert(trk.end(), { 0xFF, 0x58, 0x04, 0x04, 0x02, 0x18, 0x08 });
+  put_vlq(trk, end_tick);
+  trk.insert(trk.end(), { 0xFF, 0x2F, 0x00 });
+  put_track(file, trk);
+
+  for (uint8_t c = 0; c < 16; ++c) {
+    if (render_events[c].empty()) continue;
+    trk.clear();
+    char name[16];
+    snprintf(name, sizeof(name), "Channel %d", c + 1);
+    put_name(trk, name);
+    uint32_t at = 0;
+    for (const RenderEvent& e : render_events[c]) {
+      put_vlq(trk, e.tick - at);
+      at = e.tick;
+      trk.insert(trk.end(), { e.status, e.d1, e.d2 });
+    }
+    put_vlq(trk, end_tick > at ? end_tick - at : 0);
+    trk.insert(trk.end(), { 0xFF, 0x2F, 0x00 });
+    put_track(file, trk);
+  }
+  fwrite(file.data(), 1, file.size(), f);
+  return tracks;
+}
+
+void usage() {
+  fprintf(stderr, "usage: render_smf [-d dir] [-b bars] [-t bpm] [-r seed] [-S] [-p presets] [-m mutes]\n"
+                  "                  [-l lengths] [-o offsets] [-v divs] [-x muls] [-g grooves] out.mid\n");
+  exit(2);
+}
+
+int main(int argc, char** argv) {
+  uint32_t bars = 4;
+  float bpm = 0;
+  uint32_t seed = 1;
+  bool follow_song = false;
+  const char* lists[7] = {};  // presets, mutes, lengths, offsets, divs, muls, grooves
+  const char* list_opts = "pmlovxg";
+  int opt;
+  while ((opt = getopt(argc, argv, "d:b:t:r:Sp:m:l:o:v:x:g:")) != -1) {
+    const char* l = strchr(list_opts, opt);
+    if (l) {
+      lists[l - list_opts] = optarg;
+      continue;
+    }
+    switch (opt) {
+      case 'd': snprintf(fatfs.root, sizeof(fatfs.root), "%s", optarg); break;
+      case 'b': bars = strtoul(optarg, nullptr, 10); break;
+      case 't': bpm = atof(optarg); break;
+      case 'r': seed = strtoul(optarg, nullptr, 10); break;
+      case 'S': follow_song = true; break;
+      default: usage();
+    }
+  }
+  if (optind != argc - 1 || bars == 0 || bpm < 0) usage();
+
+  uint16_t found = render_banks();
+  bool saved = render_settings();
+  fprintf(stderr, "%d of %d bank files, settings %s\n", found, numpresets * preset_layers, saved ? "saved" : "factory");
+  if (follow_song && !render_song()) {
+    fprintf(stderr, "no saved song\n");
+    return 1;
+  }
+
+  const int32_t lo[7] = { 0, 0, 1, 0, 0, 0, 0 };
+  const int32_t hi[7] = { numpresets - 1, 1, num_steps, num_steps, X_DIM - 1, X_DIM - 1, grooves_cnt - 1 };
+  for (uint8_t k = 0; k < 7; ++k) {
+    if (!lists[k]) continue;
+    int32_t v[render_max_list];
+    bool given[render_max_list];
+    if (!render_list(lists[k], lo[k], hi[k], v, given)) {
+      fprintf(stderr, "bad -%c list: %s (%d - %d per track)\n", list_opts[k], lists[k], lo[k], hi[k]);
+      return 2;
+    }
+    for (uint8_t t = 0; t < numtracks; ++t) {
+      if (!given[t]) continue;
+      switch (k) {
+        case 0: seqr.set_preset(t, v[t]); break;
+        case 1: seqr.mutes[t] = v[t]; break;
+        case 2: seqr.lengths[t] = v[t]; break;
+        case 3: seqr.offsets[t] = v[t]; break;
+        case 4: seqr.divs[t] = v[t]; break;
+        case 5: seqr.muls[t] = v[t]; break;
+        default: seqr.grooves[t] = v[t]; break;
+      }
+    }
+  }
+
+  // configure_sequencer() & play from the top, as the device does
+  host_micros = render_start_micros;
+  randomSeed(seed);
+  seqr.set_tempo(bpm > 0 ? bpm : render_tempo);
+  seqr.ticks_per_step = render_step_size * ticks_per_clock;
+  seqr.touch_all();
+  if (follow_song) {
+    song_on = true;
+    song_start();
+  }
+  seqr.reset();
+  seqr.resetflag = 0;  // reset done, not left for the first step
+  seqr.play();
+  seqr.on_func = render_note_on;  // control notes (play / reset) aren't part of the pattern
+  seqr.off_func = render_note_off;
+  seqr.cc_func = render_cc;
+
+  uint32_t end_tick = bars * 4 * ticks_per_quarternote;
+  auto start = std::chrono::steady_clock::now();
+  for (render_tick = 0; render_tick < end_tick; ++render_tick) {
+    host_micros = render_start_micros + render_tick * seqr.tick_micros;
+    if (follow_song) song_update();
+    seqr.refresh();
+    seqr.tick(host_micros);
+  }
+  host_micros = render_start_micros + end_tick * seqr.tick_micros;
+  seqr.panic();  // anything still sounding ends with the last bar
+  double took = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  FILE* f = fopen(argv[optind], "wb");
+  if (!f) {
+    perror(argv[optind]);
+    return 1;
+  }
+  uint8_t tracks = render_write(f, end_tick);
+  fclose(f);
+  size_t events = 0;
+  for (uint8_t c = 0; c < 16; ++c) events += render_events[c].size();
+  double real = end_tick * (double)seqr.tick_micros / 1e6;
+  fprintf(stderr, "%u bars at %.2f BPM: %zu events on %d tracks, %.3fs of music in %.4fs (%.0fx real time)\n",
+          bars, seqr.tempo(), events, tracks - 1, real, took, took > 0 ? real / took : 0.0);
+  seqr.report();
+  return 0;
+}
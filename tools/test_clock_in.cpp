@@ -0,0 +1,122 @@
+/**
+ * test_clock_in.cpp -- Host test of the analog clock input (clock_in.h), for Multitrack Sequencer
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Feeds ClockIn pulse trains at every input PPQN (steady, jittery, tempo ramp & jump, stop / start)
+ * through its interrupt & main loop entry points on a virtual clock, polling as often as the main
+ * loop does, and checks every 24PPQN clock it sends: never ahead of the pulses seen, never more
+ * than the current pulse behind them, and none lost by the end, however the lock comes and goes.
+ *
+ * Build & run (from the sketch folder): g++ -std=c++17 -O2 -o test_clock_in tools/test_clock_in.cpp && ./test_clock_in
+ */
+#include "arduino_host.h"
+#include <vector>
+
+const int midi_ppqn = 24;
+const int ticks_per_quarternote = 96;
+
+// what ClockIn drives: the sequencer's tempo & reset, the clock outs
+struct {
+  uint32_t tick_micros = 5208;
+  bool playing = true;
+  bool resetflag = false;
+  void reset() {}
+} seqr;
+
+struct {
+  void ext_reset() {}
+} clock_timer;
+
+uint8_t midiclk_cnt;
+std::vector<uint32_t> clocks;  // when each 24PPQN clock went
+
+void ext_clock_tick(uint32_t now_micros) {
+  clocks.push_back(now_micros);
+}
+
+#include "../clock_in.h"
+
+const uint32_t poll_micros = 250;  // a busy main loop pass
+
+uint32_t rnd(uint32_t n) {
+  return random(n);
+}
+
+// pulse train of beats quarter notes at ppqn, bpm(beat) giving the tempo, jitter in % either way
+template<typename Tempo>
+void train(std::vector<uint32_t>& edges, uint8_t ppqn, uint32_t beats, Tempo bpm, uint8_t jitter) {
+  uint32_t at = edges.empty() ? 1000000 : edges.back();
+  for (uint32_t p = 0; p < beats * ppqn; ++p) {
+    float interval = 60e6f / bpm((float)p / ppqn) / ppqn;
+    if (jitter) interval = interval * (100 - jitter + (float)rnd(2 * jitter * 100) / 100) / 100;
+    edges.push_back(at += (uint32_t)interval);
+  }
+}
+
+// one run through ClockIn, false = a check failed
+bool run(const char* name, uint8_t ppqn, const std::vector<uint32_t>& edges) {
+  ClockIn<> in;
+  in.ppqn = ppqn;
+  clocks.clear();
+  uint32_t per = midi_ppqn / ppqn;
+  uint32_t ahead = 0, behind = 0, locked_at = 0, worst_burst = 0;
+  size_t k = 0;
+  uint32_t end = edges.back() + 3 * (edges.back() - edges[edges.size() - 2]);
+  for (uint32_t now = edges[0] - 1000; (int32_t)(now - end) < 0; now += poll_micros) {
+    while (k < edges.size() && (int32_t)(edges[k] - now) <= 0) {
+      if (clocks.size() > k * per) ahead++;  // before the edge is seen, only earlier pulses' clocks
+      in.capture(edges[k++]);
+    }
+    size_t before = clocks.size();
+    in.poll(now);
+    if (clocks.size() - before > worst_burst && in.locked) worst_burst = clocks.size() - before;
+    if (!locked_at && in.locked) locked_at = k;
+    if (k && clocks.size() < (k - 1) * per + 1) behind++;  // every pulse so far has started
+  }
+  long lost = (long)(edges.size() * per) - (long)clocks.size();
+  bool ok = ahead == 0 && behind == 0 && lost == 0;
+  printf("%-14s %2d PPQN: %5zu pulses, %6zu clocks, locked at pulse %3u, lock losses %2u, jitter max %5u us, "
+         "locked burst %2u, ahead %u, behind %u, lost %ld  %s\n",
+         name, ppqn, edges.size(), clocks.size(), locked_at, in.lock_losses, in.jitter_max, worst_burst, ahead, behind, lost,
+         ok ? "ok" : "FAIL");
+  return ok;
+}
+
+int main() {
+  uint32_t fails = 0;
+  for (uint8_t i = 0; i < clk_in_ppqns_cnt; ++i) {
+    uint8_t ppqn = clk_in_ppqns[i];
+    std::vector<uint32_t> e;
+    randomSeed(1 + i);
+
+    train(e, ppqn, 64, [](float) { return 120.0f; }, 0);
+    fails += !run("steady", ppqn, e);
+
+    e.clear();
+    train(e, ppqn, 64, [](float) { return 120.0f; }, 8);
+    fails += !run("jitter 8%", ppqn, e);
+
+    e.clear();
+    train(e, ppqn, 64, [](float) { return 120.0f; }, 30);
+    fails += !run("jitter 30%", ppqn, e);
+
+    e.clear();
+    train(e, ppqn, 64, [](float b) { return 90.0f + 90.0f * b / 64; }, 0);
+    fails += !run("ramp 90-180", ppqn, e);
+
+    e.clear();
+    train(e, ppqn, 16, [](float) { return 120.0f; }, 0);
+    train(e, ppqn, 16, [](float) { return 150.0f; }, 0);
+    fails += !run("jump 120-150", ppqn, e);
+
+    e.clear();
+    train(e, ppqn, 16, [](float) { return 120.0f; }, 2);
+    uint32_t stopped = e.back() + 2000000;  // 2 s stopped, then the first pulse of the restart
+    e.push_back(stopped);
+    train(e, ppqn, 16, [](float) { return 100.0f; }, 2);
+    fails += !run("stop / start", ppqn, e);
+  }
+  printf(fails ? "%u runs FAILED\n" : "all runs ok\n", fails);
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,294 @@
+/**
+ * test_editor.cpp -- Host test of the live-edit protocol's command rate (editor.h), for Multitrack Sequencer
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Runs the device's main loop (editor_read(), then editor_update(seqr.update()), every pass) with
+ * ticks handed over on time as the clock timer does, against an editor at the other end of the
+ * USB serial port that moves bytes once a 1 ms frame each way. The editor keeps as many step sets
+ * & row writes out as the device queues (editor_queue_size), to random tracks, layers & presets,
+ * mostly the ones playing, with a few debug lines and corrupted frames mixed in; a corrupted frame
+ * is never answered, and is sent again after test_wait_millis. Each run is 20 s at a tempo, or
+ * with the clock held (the editor_idle_millis path). Checks every answer is for the command it
+ * should be, none is busy, and every acked write is in the presets with nothing else changed.
+ * Gives commands run a second against editor_per_tick a tick, and host time per command.
+ *
+ * Build & run (from the sketch folder): g++ -std=c++17 -O2 -o test_editor tools/test_editor.cpp && ./test_editor
+ */
+#include "arduino_host.h"
+#include <chrono>
+#include <deque>
+#include <vector>
+
+const bool marci_debug = false;
+
+#define Y_DIM 8
+#define X_DIM 8
+#define t_size Y_DIM * X_DIM
+
+const uint8_t numtracks = X_DIM;
+const uint8_t num_steps = t_size / 2;
+const uint8_t numpresets = X_DIM * 2;
+const uint16_t dacrange = 4095;
+const byte numdacs = 2;
+const byte cvpins[2] = { 14, 15 };
+const byte gatepins[numtracks] = { 4, 5, 6, 9, 10, 11, 12, 13 };
+uint8_t sel_track = 1;
+bool hzv[2] = { 0, 0 };
+
+#include "../multisequencer.h"
+#include "../save_locations.h"
+
+MultiStepSequencer<numtracks, numpresets, num_steps, numdacs, numarps> seqr;
+
+#include "../json_stream.h"
+
+void undo_record(uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t) {}
+void undo_close() {}
+
+#include "../journal.h"
+#include "../editor.h"
+
+const uint32_t test_run_micros = 20000000;
+const uint32_t test_pass_micros = 250;    // main loop pass
+const uint32_t test_frame_micros = 1000;  // USB frame
+const uint32_t test_wait_millis = 50;     // editor sends again a command not answered by then
+const uint8_t test_window = editor_queue_size;  // commands the editor has out at once, so never busy
+
+typedef std::vector<uint8_t> Bytes;
+Bytes to_device, to_editor;  // waiting for the next USB frame
+Bytes editor_in;             // arrived, not yet parsed
+
+void device_tx(uint8_t c) {
+  to_editor.push_back(c);
+}
+
+uint8_t want[numpresets][numtracks][preset_layers][num_steps];
+
+// the editor's own dice, so the engine's random() plays the same whatever it sends
+uint32_t dice_state = 77;
+
+uint32_t dice(uint32_t n) {
+  dice_state ^= dice_state << 13;
+  dice_state ^= dice_state >> 17;
+  dice_state ^= dice_state << 5;
+  return dice_state % n;
+}
+
+struct Command {
+  Bytes frame;
+  uint8_t p, t, l, first, n;
+  uint8_t v[num_steps];
+  uint32_t sent_at;
+};
+
+// a command to preset p (FF = playing) of a random track, values that keep the store from filling
+Command make_command() {
+  Command c = {};
+  c.t = dice(numtracks);
+  c.l = dice(preset_layers);
+  uint8_t p = dice(4) ? editor_current : 1 + dice(3);
+  c.p = p == editor_current ? seqr.presets[c.t] : p;
+  bool row = dice(4) == 0;
+  c.first = row ? 0 : dice(num_steps);
+  c.n = row ? num_steps : 1;
+  for (uint8_t s = 0; s < c.n; ++s) {
+    uint8_t lo = c.l == SEQ_LAYER ? 0 : 1;
+    c.v[s] = c.l == SEQ_LAYER ? dice(2) : lo + dice(4) * (layer_max[c.l] / 4);
+    if (c.l == NUDGE_LAYER) c.v[s] = (uint8_t)(int8_t)(dice(5) - 2);
+  }
+  Bytes d = { p, c.t, c.l };
+  if (!row) d.push_back(c.first);
+  d.insert(d.end(), c.v, c.v + c.n);
+  uint8_t cmd = row ? editor_write_row : editor_set_step;
+  c.frame = { editor_sync, (uint8_t)d.size(), cmd };
+  uint8_t sum = d.size() + cmd;
+  for (uint8_t b : d) {
+    c.frame.push_back(b);
+    sum += b;
+  }
+  c.frame.push_back(-sum);
+  return c;
+}
+
+struct Editor {
+  std::deque<Command> out;    // sent, answer due, oldest first (the device answers in order)
+  std::deque<Command> retry;  // sent corrupted, so never answered: sent again after test_wait_millis
+  uint32_t acked = 0, busy = 0, full = 0, corrupted = 0, noise = 0, mismatched = 0;
+
+  void send(Command c) {
+    Bytes f = c.frame;
+    bool bad = dice(200) == 0;
+    if (bad) f[f.size() - 1] ^= 0x5A;  // fails the sum
+    if (dice(100) == 0) {
+      const char* line = "Turning EXT CLOCK off\n";
+      to_device.insert(to_device.end(), line, line + strlen(line));
+      noise++;
+    }
+    to_device.insert(to_device.end(), f.begin(), f.end());
+    c.sent_at = millis();
+    if (bad) {
+      corrupted++;
+      retry.push_back(c);
+    } else {
+      out.push_back(c);
+    }
+  }
+
+  void top_up() {
+    while (host_micros < test_run_micros && out.size() + retry.size() < test_window) send(make_command());
+  }
+
+  void answer(uint8_t cmd, uint8_t status) {
+    if (out.empty() || out.front().frame[2] != cmd) {
+      mismatched++;
+      return;
+    }
+    Command c = out.front();
+    out.pop_front();
+    if (status == editor_busy) {
+      busy++;
+      send(c);
+    } else if (status == editor_full) {
+      full++;
+    } else if (status == editor_ok) {
+      acked++;
+      memcpy(&want[c.p][c.t][c.l][c.first], c.v, c.n);
+    }
+  }
+
+  void receive() {
+    size_t i = 0;
+    while (i + 4 <= editor_in.size()) {
+      if (editor_in[i] != editor_sync) {
+        i++;
+        continue;
+      }
+      uint8_t len = editor_in[i + 1];
+      if (i + len + 4 > editor_in.size()) break;
+      if (editor_in[i + 2] == editor_ack && len == 2) answer(editor_in[i + 3], editor_in[i + 4]);
+      i += len + 4;
+    }
+    editor_in.erase(editor_in.begin(), editor_in.begin() + i);
+  }
+
+  void update() {
+    while (!retry.empty() && millis() - retry.front().sent_at >= test_wait_millis) {
+      Command c = retry.front();
+      retry.pop_front();
+      send(c);
+    }
+  }
+};
+
+void load_patterns() {
+  for (uint8_t p = 1; p < numpresets; ++p) {
+    for (uint8_t t = 0; t < numtracks; ++t) {
+      seqr.set_layer(p, t, SEQ_LAYER, (const uint8_t*)(*patterns[p])[t]);
+      seqr.set_layer(p, t, VEL_LAYER, (*velocities[p])[t]);
+      seqr.set_layer(p, t, NOTE_LAYER, (*notebanks[p])[t]);
+      seqr.set_layer(p, t, PROB_LAYER, (*probabilities[p])[t]);
+      seqr.set_layer(p, t, GATE_LAYER, (*gatebanks[p])[t]);
+      seqr.set_layer(p, t, NUDGE_LAYER, (const uint8_t*)(*nudgebanks[p])[t]);
+      seqr.set_layer(p, t, CHORD_LAYER, (*chordbanks[p])[t]);
+    }
+  }
+  seqr.touch_all();
+}
+
+double now_us() {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 20 s of the main loop, the clock & the port on one virtual clock. bpm 0 = clock held
+bool run(float bpm) {
+  host_micros = 0;
+  to_device.clear();
+  to_editor.clear();
+  editor_in.clear();
+  Serial.rx_count = 0;
+  editor_last_run = 0;
+  editor_rate_at = 0;
+  editor_rate_peak = 0;
+  uint32_t busy = editor_busy_count;
+  seqr.set_tempo(bpm ? bpm : 120);
+  seqr.timer_clocked = true;
+  seqr.ticks_pending = 0;
+  seqr.play();
+  Editor ed;
+  ed.top_up();
+  uint32_t ran = 0;
+  double took = 0;
+  uint32_t next_tick = 0, next_pass = 0, next_frame = test_frame_micros;
+  // then on till everything sent is answered
+  while (host_micros < test_run_micros || !ed.out.empty() || !ed.retry.empty()) {
+    uint32_t now = next_pass;
+    if (bpm && (int32_t)(next_tick - now) < 0) now = next_tick;
+    if ((int32_t)(next_frame - now) < 0) now = next_frame;
+    host_micros = now;
+    if (bpm && now == next_tick) {
+      seqr.ticks_pending = seqr.ticks_pending + 1;  // the clock timer's interrupt
+      next_tick += seqr.tick_micros;
+    } else if (now == next_pass) {
+      editor_read();
+      bool ticked = seqr.update();
+      uint8_t queued = editor_count;
+      double t0 = now_us();
+      editor_update(ticked);
+      if (editor_count != queued && host_micros < test_run_micros) {
+        took += now_us() - t0;
+        ran += queued - editor_count;
+      }
+      ed.update();
+      next_pass += test_pass_micros;
+    } else {
+      // a USB frame: what each side sent since the last one arrives
+      for (uint8_t b : to_device) Serial.feed(b);
+      to_device.clear();
+      editor_in.insert(editor_in.end(), to_editor.begin(), to_editor.end());
+      to_editor.clear();
+      ed.receive();
+      ed.top_up();
+      next_frame += test_frame_micros;
+    }
+  }
+  seqr.stop();
+
+  uint32_t wrong = 0;
+  for (uint8_t p = 0; p < numpresets; ++p) {
+    for (uint8_t t = 0; t < numtracks; ++t) {
+      for (uint8_t l = 0; l < preset_layers; ++l) {
+        uint8_t row[num_steps];
+        seqr.get_layer(p, t, l, row);
+        wrong += memcmp(row, want[p][t][l], num_steps) != 0;
+      }
+    }
+  }
+  char name[16];
+  if (bpm) snprintf(name, sizeof(name), "%3.0f BPM:", bpm);
+  else snprintf(name, sizeof(name), "clock held:");
+  float per_sec = ran * 1e6f / test_run_micros;
+  float ticks_sec = bpm ? bpm * ticks_per_quarternote / 60 : 1000.0f / editor_idle_millis;
+  printf("%-12s %5.0f commands/s (cap %4.0f), %6u acked, %u store full, %u busy, %3u corrupted & sent again, %u rows wrong, %.2f us a command (host)\n",
+         name, per_sec, ticks_sec * editor_per_tick, ed.acked, ed.full, editor_busy_count - busy, ed.corrupted, wrong, took / ran);
+  return wrong == 0 && ed.acked > 0 && ed.mismatched == 0 && editor_busy_count == busy;
+}
+
+int main() {
+  load_patterns();
+  for (uint8_t p = 0; p < numpresets; ++p) {
+    for (uint8_t t = 0; t < numtracks; ++t) {
+      for (uint8_t l = 0; l < preset_layers; ++l) seqr.get_layer(p, t, l, want[p][t][l]);
+    }
+  }
+  Serial.tx = device_tx;
+  Serial.tx_room = 1024;
+  printf("editor keeps %u commands out (queue %u), USB frame every %u us, main loop pass every %u us, %u s a run\n", test_window,
+         editor_queue_size, test_frame_micros, test_pass_micros, test_run_micros / 1000000);
+  bool ok = true;
+  const float tempos[] = { 0, 60, 120, 180, 240 };
+  for (float bpm : tempos) ok = run(bpm) && ok;
+  printf("%u frames, %u failed the sum\n", editor_frames, editor_bad_frames);
+  printf(ok ? "ok\n" : "FAIL\n");
+  return ok ? 0 : 1;
+}
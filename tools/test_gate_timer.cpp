@@ -0,0 +1,179 @@
+/**
+ * test_gate_timer.cpp -- Host test of gate & trigger falling edge timing (gate_timer.h), for Multitrack Sequencer
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Plays the same random gates & 1 / 5 ms triggers on the eight track outputs, 16ths at 120 BPM,
+ * three ways, and measures each falling edge against when it was asked for (rising edge + length):
+ *  - before gate_timer.h: the edge waited for the next tick update() ran from the main loop, and
+ *    was due at the millisecond the gate ends in (held_gate_millis), so it could also come early
+ *  - GateTimer polled from the main loop (gate_timer_poll(), the non-SAMD51 fallback)
+ *  - GateTimer on its one-shot compare, modelled here as an interrupt at the armed time, the
+ *    16 bit TC3 count (about 21.8 ms a shot) re-armed for the rest of a longer gate as on the M4
+ * The main loop comes round every 100 - 1000 us, at random. An edge that's still pending when its
+ * output fires again is merged into the next gate (the output never goes low between them); one
+ * that falls due the very microsecond its output fires again is legato anyway, and the polled row
+ * doesn't count those as edges. The compare row leaves out the M4's interrupt entry & handler
+ * time, so it checks the scheduling; the other two are what the board would see.
+ *
+ * Build & run (from the sketch folder): g++ -std=c++17 -O2 -o test_gate_timer tools/test_gate_timer.cpp && ./test_gate_timer
+ */
+#include "arduino_host.h"
+#include <vector>
+
+#define HIGH 1
+#define LOW 0
+
+const uint8_t numtracks = 8;
+const int ticks_per_quarternote = 96;
+
+#include "../gate_timer.h"
+
+const uint32_t test_steps = 20000;
+const uint32_t test_tick_micros = 60000000UL / (120 * ticks_per_quarternote);
+const uint8_t test_ticks_per_step = ticks_per_quarternote / 4;
+const uint32_t test_shot_micros = 0xFFFF / 3;  // longest TC3 one-shot
+
+struct Gate {
+  uint8_t out;
+  uint32_t len;  // micros
+};
+
+// the gates fired on step s, the same for every run
+std::vector<Gate> step_gates(uint32_t s) {
+  randomSeed(1 + s);
+  std::vector<Gate> g;
+  uint32_t step_micros = test_ticks_per_step * test_tick_micros;
+  for (uint8_t i = 0; i < numtracks; ++i) {
+    if (random(3) == 0) continue;
+    uint8_t w = trig_widths[i % trig_widths_cnt];
+    g.push_back({ i, (uint32_t)(w ? w * 1000UL : (1 + random(16)) * step_micros / 16) });
+  }
+  return g;
+}
+
+uint32_t loop_pass() {
+  return 100 + random(900);
+}
+
+struct Edges {
+  uint32_t edges;
+  uint32_t early;
+  uint32_t early_max;
+  uint32_t late_max;
+  uint64_t late_total;
+  uint32_t merged;  // still pending when its output fired again
+
+  void add(int32_t late) {
+    edges++;
+    if (late < 0) {
+      early++;
+      if ((uint32_t)-late > early_max) early_max = -late;
+      return;
+    }
+    late_total += late;
+    if ((uint32_t)late > late_max) late_max = late;
+  }
+
+  void print(const char* name) {
+    printf("%-32s %6u edges, late avg %5.0f us, max %5u us, early %5u (max %4u us), merged %u\n", name, edges,
+           edges > early ? (double)late_total / (edges - early) : 0.0, late_max, early, early_max, merged);
+  }
+};
+
+// before gate_timer.h: ticks polled from the main loop, edges at the tick that sees millis() reach the ms they're due in
+Edges run_ticks() {
+  Edges e = {};
+  uint32_t held_millis[numtracks] = {};
+  uint32_t off_at[numtracks] = {};
+  uint32_t rng = 7, last_tick = 0, now = 0;
+  uint32_t ticki = 0, step = 0;
+  while (step < test_steps) {
+    host_random_state = rng;
+    now += loop_pass();
+    rng = host_random_state;
+    if (now - last_tick < test_tick_micros) continue;
+    last_tick = now;
+    host_micros = now;
+    for (uint8_t i = 0; i < numtracks; ++i) {
+      if (held_millis[i] != 0 && millis() >= held_millis[i]) {
+        held_millis[i] = 0;
+        e.add((int32_t)(now - off_at[i]));
+      }
+    }
+    if (ticki++ % test_ticks_per_step) continue;
+    for (const Gate& g : step_gates(step++)) {
+      if (held_millis[g.out] && (int32_t)(now - off_at[g.out]) > 0) e.merged++;
+      off_at[g.out] = now + g.len;
+      held_millis[g.out] = (now + g.len) / 1000;
+    }
+  }
+  return e;
+}
+
+// GateTimer, from ticks on time: polled each main loop pass, or serviced at its compare
+Edges run_gate_timer(bool compare) {
+  Edges e = {};
+  gate_timer = GateTimer<numtracks + 2>();
+  for (uint8_t i = 0; i < numtracks; ++i) gate_timer.attach(i, i);
+  gate_timer_pending = false;
+  uint32_t off_at[numtracks] = {};
+  uint32_t rng = 7, next_pass = 0, armed_at = 0;
+  uint32_t step = 0;
+  auto service = [&](uint32_t now) {
+    host_micros = now;
+    uint32_t fired = gate_timer.edges;
+    bool was[numtracks];
+    for (uint8_t i = 0; i < numtracks; ++i) was[i] = gate_timer.armed[i];
+    if (compare) {
+      gate_timer_pending = false;
+      gate_timer.service(now);
+    } else {
+      gate_timer_poll(now);
+    }
+    if (gate_timer.edges != fired) {
+      for (uint8_t i = 0; i < numtracks; ++i) {
+        if (was[i] && !gate_timer.armed[i]) e.add((int32_t)(now - off_at[i]));
+      }
+    }
+    armed_at = now;
+  };
+  for (uint32_t t = 0; step < test_steps; t += test_ticks_per_step * test_tick_micros) {
+    // everything up to this step: loop passes, and compares (each shot at most test_shot_micros)
+    for (;;) {
+      uint32_t due = gate_timer_due;
+      if (compare && gate_timer_pending && due - armed_at > test_shot_micros) due = armed_at + test_shot_micros;
+      bool irq = compare && gate_timer_pending && (int32_t)(due - t) <= 0 && (int32_t)(due - next_pass) <= 0;
+      if (!irq && (int32_t)(next_pass - t) >= 0) break;
+      if (irq) {
+        service(due);
+      } else {
+        if (!compare) service(next_pass);
+        host_random_state = rng;
+        next_pass += loop_pass();
+        rng = host_random_state;
+      }
+    }
+    host_micros = t;
+    for (const Gate& g : step_gates(step++)) {
+      if (gate_timer.armed[g.out] && (int32_t)(t - off_at[g.out]) > 0) e.merged++;
+      off_at[g.out] = t + g.len;
+      gate_timer.pulse(g.out, g.len);
+      armed_at = t;
+    }
+  }
+  return e;
+}
+
+int main() {
+  printf("%u steps of 16ths at 120 BPM, %d outputs, gates & 1 / 5 ms triggers, main loop every 100 - 1000 us\n", test_steps, numtracks);
+  Edges ticks = run_ticks();
+  ticks.print("polled ticks, ms deadlines:");
+  Edges polled = run_gate_timer(false);
+  polled.print("GateTimer, polled:");
+  Edges cmp = run_gate_timer(true);
+  cmp.print("GateTimer, compare:");
+  bool ok = polled.early == 0 && cmp.early == 0 && cmp.late_max == 0 && cmp.merged == 0;
+  printf(ok ? "ok\n" : "FAIL\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+/**
+ * test_live_entry.cpp -- Host check of live CC entry staying inside the row, for Multitrack Sequencer
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Sends a CC into each CC & NOTE track as handle_midi_in_CC() does with SHIFT held (into
+ * live_step(), the step playing) while stopped, straight after play() before the first step,
+ * and while playing. multistepi is -1 in the first two, and the step must come out inside the
+ * row. After each CC the whole engine is compared with how it was: only the edited step's value
+ * & event (and the rebuild count) may have changed.
+ *
+ * Build & run (from the sketch folder): g++ -std=c++17 -O2 -o test_live_entry tools/test_live_entry.cpp && ./test_live_entry
+ */
+#include "arduino_host.h"
+
+const bool marci_debug = false;
+
+#define Y_DIM 8
+#define X_DIM 8
+#define t_size Y_DIM * X_DIM
+
+const uint8_t numtracks = X_DIM;
+const uint8_t num_steps = t_size / 2;
+const uint8_t numpresets = X_DIM * 2;
+const uint16_t dacrange = 4095;
+const byte numdacs = 2;
+const byte cvpins[2] = { 14, 15 };
+const byte gatepins[numtracks] = { 4, 5, 6, 9, 10, 11, 12, 13 };
+uint8_t sel_track = 1;
+bool hzv[2] = { 0, 0 };
+
+#include "../multisequencer.h"
+
+MultiStepSequencer<numtracks, numpresets, num_steps, numdacs, numarps> seqr;
+
+uint8_t before[sizeof(seqr)];
+
+struct Range {
+  const void* at;
+  size_t n;
+};
+
+// bytes of the engine that changed outside the given ranges
+uint32_t changed_outside(const Range* ok, uint8_t ok_cnt) {
+  const uint8_t* now = (const uint8_t*)(const void*)&seqr;
+  uint32_t n = 0;
+  for (size_t i = 0; i < sizeof(seqr); ++i) {
+    if (now[i] == before[i]) continue;
+    bool allowed = false;
+    for (uint8_t k = 0; k < ok_cnt; ++k) {
+      const uint8_t* a = (const uint8_t*)ok[k].at;
+      allowed |= now + i >= a && now + i < a + ok[k].n;
+    }
+    n += !allowed;
+  }
+  return n;
+}
+
+// a CC with SHIFT held into track t: false = it landed outside the row or touched anything else
+bool shifted_cc(uint8_t t, const char* when) {
+  seqr.refresh();  // compiled, so the event's rebuilt in place
+  memcpy(before, (const void*)&seqr, sizeof(seqr));
+  short int playing_step = seqr.multistepi[t];
+  uint8_t s = seqr.live_step(t);
+  uint8_t val = 1 + (seqr.vels[t][s] + 1) % 127;
+  seqr.cc_edit(t, s, seqr.track_notes[t], val);
+  const Range ok[] = {
+    { &seqr.vels[t][s], 1 },
+    { &seqr.events[t][s < num_steps ? s : 0], sizeof(seqr.events[t][0]) },
+    { &seqr.step_rebuilds, sizeof(seqr.step_rebuilds) },
+    { &seqr.prepared[t], sizeof(seqr.prepared[t]) },
+  };
+  uint32_t stray = changed_outside(ok, sizeof(ok) / sizeof(ok[0]));
+  bool in_row = s < num_steps && s == (playing_step < 0 ? 0 : playing_step);
+  bool landed = seqr.vels[t][s] == val;
+  if (!in_row || !landed || stray) {
+    printf("  track %d %s (multistepi %d): step %d, %s, %u stray bytes\n", t + 1, when, playing_step, s,
+           landed ? "value in" : "value NOT in", stray);
+    return false;
+  }
+  return true;
+}
+
+int main() {
+  const track_mode modes[numtracks] = { CC, NOTE, CC, NOTE, TRIGATE, CHORD, CC, NOTE };
+  for (uint8_t t = 0; t < numtracks; ++t) {
+    seqr.modes[t] = modes[t];
+    seqr.track_notes[t] = 20 + t;
+    seqr.seqs[t][3] = 1;
+    seqr.touch(t);
+  }
+  uint32_t fails = 0, sent = 0;
+  seqr.stop();
+  for (uint8_t t = 0; t < numtracks; ++t) {
+    if (modes[t] != CC && modes[t] != NOTE) continue;
+    fails += !shifted_cc(t, "stopped");
+    sent++;
+  }
+  seqr.play();
+  for (uint8_t t = 0; t < numtracks; ++t) {
+    if (modes[t] != CC && modes[t] != NOTE) continue;
+    fails += !shifted_cc(t, "before the first step");
+    sent++;
+  }
+  for (uint32_t k = 0; k < 200; ++k) {
+    host_micros += seqr.tick_micros;
+    seqr.refresh();
+    seqr.tick(host_micros);
+    if (k % 7) continue;
+    for (uint8_t t = 0; t < numtracks; ++t) {
+      if (modes[t] != CC && modes[t] != NOTE) continue;
+      fails += !shifted_cc(t, "playing");
+      sent++;
+    }
+  }
+  seqr.stop();
+  printf("%u CCs with SHIFT held, %u outside the row or touching anything else\n", sent, fails);
+  printf(fails ? "FAIL\n" : "ok\n");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,152 @@
+/**
+ * test_preset_store.cpp -- Host test of the compressed preset store (preset_store.h), for Multitrack Sequencer
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Loads the factory banks into a store the size the engine builds, then makes 200k random edits
+ * (a few steps of a few layers of a random track & preset each, values often copying a neighbour
+ * so runs & phrases come and go) against a plain copy of every preset. After each edit a random
+ * preset is read back and compared with the copy; every 5000 edits the whole store is checked:
+ * block refs against the presets using them, arena bytes & blocks in use, each block's hash.
+ * Now and then a snapshot is taken and later restored, as undoing a factory reset does, and every
+ * preset compared with the copy from the snapshot. Edits the arena can't take must leave the
+ * preset as it was. Also gives host time per put().
+ *
+ * Build & run (from the sketch folder): g++ -std=c++17 -O2 -o test_preset_store tools/test_preset_store.cpp && ./test_preset_store
+ */
+#include "arduino_host.h"
+#include <chrono>
+
+const bool marci_debug = false;
+
+#define Y_DIM 8
+#define X_DIM 8
+#define t_size Y_DIM * X_DIM
+
+const uint8_t numtracks = X_DIM;
+const uint8_t num_steps = t_size / 2;
+const uint8_t numpresets = X_DIM * 2;
+const uint16_t dacrange = 4095;
+const byte numdacs = 2;
+const byte cvpins[2] = { 14, 15 };
+const byte gatepins[numtracks] = { 4, 5, 6, 9, 10, 11, 12, 13 };
+uint8_t sel_track = 1;
+bool hzv[2] = { 0, 0 };
+
+#include "../multisequencer.h"
+#include "../save_locations.h"
+
+typedef decltype(MultiStepSequencer<numtracks, numpresets, num_steps, numdacs, numarps>::store) Store;
+typedef TrackPreset<num_steps> Preset;
+
+const uint32_t test_edits = 200000;
+const uint32_t test_check_every = 5000;
+const uint32_t test_snapshot_every = 20000;
+
+Store store;
+const uint16_t store_blocks = sizeof(store.blocks) / sizeof(store.blocks[0]);
+Preset ref[numpresets][numtracks];
+Preset held[numpresets][numtracks];
+
+// refs, bytes & blocks in use, hashes: false = the store's books don't add up
+bool consistent() {
+  static uint16_t refs[store_blocks];
+  memset(refs, 0, sizeof(refs));
+  for (uint8_t p = 0; p < numpresets; ++p) {
+    for (uint8_t t = 0; t < numtracks; ++t) {
+      for (uint8_t l = 0; l < preset_layers; ++l) {
+        refs[store.block_of[p][t][l]]++;
+        if (store.held) refs[store.held_of[p][t][l]]++;
+      }
+    }
+  }
+  uint32_t bytes = 0;
+  uint16_t blocks = 0;
+  for (uint16_t b = 0; b < store_blocks; ++b) {
+    if (refs[b] != store.blocks[b].refs) return false;
+    if (!refs[b]) continue;
+    bytes += store.blocks[b].size;
+    blocks++;
+    if ((uint16_t)content_hash(store.arena + store.blocks[b].start, store.blocks[b].size) != store.blocks[b].hash) return false;
+  }
+  return bytes == store.used && blocks == store.blocks_used;
+}
+
+bool matches(uint8_t p, uint8_t t, const Preset& want) {
+  Preset got;
+  store.get(p, t, got);
+  return !memcmp(&got, &want, sizeof(got));
+}
+
+double now_us() {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main() {
+  for (uint8_t p = 0; p < numpresets; ++p) {
+    for (uint8_t t = 0; t < numtracks; ++t) {
+      Preset& r = ref[p][t];
+      memcpy(r.layer[SEQ_LAYER], (*patterns[p])[t], num_steps);
+      memcpy(r.layer[NOTE_LAYER], (*notebanks[p])[t], num_steps);
+      memcpy(r.layer[VEL_LAYER], (*velocities[p])[t], num_steps);
+      memcpy(r.layer[PROB_LAYER], (*probabilities[p])[t], num_steps);
+      memcpy(r.layer[GATE_LAYER], (*gatebanks[p])[t], num_steps);
+      memcpy(r.layer[NUDGE_LAYER], (*nudgebanks[p])[t], num_steps);
+      memcpy(r.layer[CHORD_LAYER], (*chordbanks[p])[t], num_steps);
+      if (!store.put(p, t, r)) {
+        printf("factory banks don't fit\n");
+        return 1;
+      }
+    }
+  }
+  printf("factory banks: %u bytes in %u blocks, in a %u byte arena with %u block slots\n", store.used, store.blocks_used,
+         (unsigned)sizeof(store.arena), store_blocks);
+
+  randomSeed(1);
+  uint32_t fails = 0, refused = 0, snapshots = 0, restores = 0;
+  double put_total = 0;
+  for (uint32_t e = 1; e <= test_edits; ++e) {
+    uint8_t p = random(numpresets), t = random(numtracks);
+    Preset edit = ref[p][t];
+    for (uint8_t k = random(4); k > 0; --k) {
+      uint8_t l = random(preset_layers), s = random(num_steps);
+      if (l == SEQ_LAYER) edit.layer[l][s] = random(2);
+      else edit.layer[l][s] = random(3) ? edit.layer[l][(s + 1) % num_steps] : random(l == NUDGE_LAYER ? 256 : layer_max[l] + 1);
+    }
+    double t0 = now_us();
+    bool ok = store.put(p, t, edit);
+    put_total += now_us() - t0;
+    if (ok) ref[p][t] = edit;
+    else refused++;
+    if (!matches(p, t, ref[p][t])) {
+      if (fails++ < 3) printf("  edit %u: preset %d track %d %s\n", e, p, t, ok ? "reads back wrong" : "changed by a refused put");
+    }
+    uint8_t q = random(numpresets), u = random(numtracks);
+    if (!matches(q, u, ref[q][u]) && fails++ < 3) printf("  edit %u: preset %d track %d reads back wrong\n", e, q, u);
+    if (e % test_check_every == 0 && !consistent() && fails++ < 3) printf("  edit %u: store books don't add up\n", e);
+    if (e % test_snapshot_every == 0) {
+      if (store.held && random(2)) {
+        store.restore();
+        memcpy(ref, held, sizeof(ref));
+        restores++;
+        for (uint8_t p = 0; p < numpresets; ++p) {
+          for (uint8_t t = 0; t < numtracks; ++t) {
+            if (!matches(p, t, ref[p][t]) && fails++ < 3) printf("  edit %u: preset %d track %d not restored\n", e, p, t);
+          }
+        }
+      } else {
+        store.snapshot();
+        memcpy(held, ref, sizeof(held));
+        snapshots++;
+      }
+      if (!consistent() && fails++ < 3) printf("  edit %u: store books don't add up after snapshot / restore\n", e);
+    }
+  }
+  store.drop_snapshot();
+  if (!consistent()) fails++;
+  printf("%u edits: %u refused (arena full), %u snapshots, %u restored, %u bytes in use, peak %u\n", test_edits, refused, snapshots,
+         restores, store.used, store.peak);
+  printf("put: %.2f us avg (host)\n", put_total / test_edits);
+  printf(fails ? "%u checks FAILED\n" : "all checks ok\n", fails);
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,242 @@
+/**
+ * test_seek.cpp -- Host test of Song Position Pointer seeking (seek() in multisequencer.h), for Multitrack Sequencer
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Plays the engine tick by tick from a reset and, at random song positions on the way, checks that
+ * seek() straight there from another reset lands in the same state: master step, tick & position,
+ * and each track's step, last step, next step, phase to the grid, probability roll number & arp
+ * position. Then plays a bar on from the seek and checks it sends the same notes & CCs as the
+ * tick by tick run did. Every division & multiplier, at each base step size, with random lengths,
+ * loop offsets, microtiming, grooves, probabilities, a muted track and held arps on two tracks.
+ * (There are no ratchets in the engine, so nothing of theirs to check.)
+ *
+ * Build & run (from the sketch folder): g++ -std=c++17 -O2 -o test_seek tools/test_seek.cpp && ./test_seek
+ */
+#include "arduino_host.h"
+#include <vector>
+
+const bool marci_debug = false;
+
+#define Y_DIM 8
+#define X_DIM 8
+#define t_size Y_DIM * X_DIM
+
+const uint8_t numtracks = X_DIM;
+const uint8_t num_steps = t_size / 2;
+const uint8_t numpresets = X_DIM * 2;
+const uint16_t dacrange = 4095;
+const byte numdacs = 2;
+const byte cvpins[2] = { 14, 15 };
+const byte gatepins[numtracks] = { 4, 5, 6, 9, 10, 11, 12, 13 };
+uint8_t sel_track = 1;
+bool hzv[2] = { 0, 0 };
+
+#include "../multisequencer.h"
+
+MultiStepSequencer<numtracks, numpresets, num_steps, numdacs, numarps> seqr;
+
+const uint8_t seek_positions = 12;     // per setup
+const uint16_t seek_max_sixteenths = 1024;
+const uint32_t seek_ticks_per_sixteenth = SIXTEENTH_NOTE * ticks_per_clock;
+const uint32_t seek_window = 16 * seek_ticks_per_sixteenth;  // played on after each seek
+
+struct Sent {
+  uint32_t tick;
+  uint8_t status;
+  uint8_t d1;
+  uint8_t d2;
+};
+
+std::vector<Sent> sent;
+uint32_t tick_no;
+
+void on_note(uint8_t note, uint8_t vel, uint8_t, bool on, uint8_t chan) {
+  if (on) sent.push_back({ tick_no, (uint8_t)(0x90 | chan), note, vel });
+}
+
+void off_note(uint8_t, uint8_t, uint8_t, bool, uint8_t) {}  // note offs of notes from before a seek differ
+
+void on_cc(uint8_t cc, uint8_t val, bool on, uint8_t chan) {
+  if (on) sent.push_back({ tick_no, (uint8_t)(0xB0 | chan), cc, val });
+}
+
+struct State {
+  short int stepi, ticki, pos;
+  uint8_t laststep;
+  short int multistepi[numtracks], laststeps[numtracks];
+  uint8_t next_steps[numtracks];
+  int32_t to_grid[numtracks];
+  uint32_t track_steps[numtracks];
+  short int arp_step[numtracks];
+};
+
+State state() {
+  State s;
+  memset(&s, 0, sizeof(s));
+  s.stepi = seqr.stepi;
+  s.ticki = seqr.ticki;
+  s.pos = seqr.pos;
+  s.laststep = seqr.laststep;
+  for (uint8_t i = 0; i < numtracks; ++i) {
+    s.multistepi[i] = seqr.multistepi[i];
+    s.laststeps[i] = seqr.laststeps[i];
+    s.next_steps[i] = seqr.next_steps[i];
+    s.to_grid[i] = seqr.to_grid[i];
+    s.track_steps[i] = seqr.track_steps[i];
+    s.arp_step[i] = arps[i]._step;
+  }
+  return s;
+}
+
+// first difference, or nullptr
+const char* differs(const State& a, const State& b, uint8_t& trk) {
+  trk = 0;
+  if (a.stepi != b.stepi) return "stepi";
+  if (a.ticki != b.ticki) return "ticki";
+  if (a.pos != b.pos) return "pos";
+  if (a.laststep != b.laststep) return "laststep";
+  for (trk = 0; trk < numtracks; ++trk) {
+    if (a.multistepi[trk] != b.multistepi[trk]) return "multistepi";
+    if (a.laststeps[trk] != b.laststeps[trk]) return "laststeps";
+    if (a.next_steps[trk] != b.next_steps[trk]) return "next_steps";
+    if (a.to_grid[trk] != b.to_grid[trk]) return "to_grid";
+    if (a.track_steps[trk] != b.track_steps[trk]) return "track_steps (probability roll)";
+    if (a.arp_step[trk] != b.arp_step[trk]) return "arp step";
+  }
+  return nullptr;
+}
+
+void play_tick() {
+  tick_no++;
+  host_micros += seqr.tick_micros;
+  seqr.refresh();
+  seqr.tick(host_micros);
+}
+
+// a random pattern on every track, then div & mul as given
+void setup_tracks(uint8_t div, uint8_t mul) {
+  const track_mode modes[numtracks] = { TRIGATE, TRIGATE, CC, NOTE, CHORD, ARP, ARP, NOTE };
+  for (uint8_t i = 0; i < numtracks; ++i) {
+    seqr.modes[i] = modes[i];
+    seqr.track_notes[i] = 36 + i;
+    seqr.track_chan[i] = i + 1;
+    seqr.divs[i] = div;
+    seqr.muls[i] = mul;
+    seqr.lengths[i] = 1 + random(num_steps);
+    seqr.offsets[i] = random(seqr.lengths[i] + 1);
+    seqr.grooves[i] = random(grooves_cnt);
+    seqr.mutes[i] = i == 1;
+    for (uint8_t s = 0; s < num_steps; ++s) {
+      seqr.seqs[i][s] = random(3) != 0;
+      seqr.notes[i][s] = 36 + random(36);
+      seqr.vels[i][s] = random(128);
+      seqr.probs[i][s] = random(4) ? 10 : random(10);
+      seqr.gates[i][s] = 1 + random(15);
+      seqr.nudges[i][s] = (int8_t)(random(24) - 12);
+      seqr.chords[i][s] = random(4);
+    }
+  }
+  seqr.touch_all();
+}
+
+// one setup: tick by tick to each random position, seek there from a reset, compare
+uint32_t run(uint8_t step_size, uint8_t div, uint8_t mul) {
+  seqr.ticks_per_step = step_size * ticks_per_clock;
+  setup_tracks(div, mul);
+  uint16_t at[seek_positions];
+  at[0] = 0;
+  at[1] = 1;
+  for (uint8_t k = 2; k < seek_positions; ++k) at[k] = random(seek_max_sixteenths);
+  for (uint8_t k = 1; k < seek_positions; ++k) {
+    for (uint8_t j = k; j > 0 && at[j] < at[j - 1]; --j) {
+      uint16_t x = at[j];
+      at[j] = at[j - 1];
+      at[j - 1] = x;
+    }
+  }
+
+  // the reference: tick by tick from a reset, state at each position & everything sent
+  sent.clear();
+  tick_no = 0;
+  seqr.play();
+  seqr.reset();
+  uint32_t seed = seqr.prob_seed;
+  State ref[seek_positions];
+  uint32_t end = at[seek_positions - 1] * seek_ticks_per_sixteenth + seek_window;
+  uint8_t k = 0;
+  for (uint32_t t = 0; t <= end; ++t) {
+    while (k < seek_positions && at[k] * seek_ticks_per_sixteenth == t) ref[k++] = state();
+    if (t < end) play_tick();
+  }
+  std::vector<Sent> played = sent;
+
+  uint32_t fails = 0;
+  for (k = 0; k < seek_positions; ++k) {
+    seqr.reset();
+    seqr.prob_seed = seed;
+    seqr.seek(at[k]);
+    State got = state();
+    uint8_t trk;
+    const char* what = differs(ref[k], got, trk);
+    if (what) {
+      if (fails++ < 3) printf("  step size %d, div %d, mul %d, seek to %u: %s differs (track %d)\n", step_size, div, mul, at[k], what, trk + 1);
+      continue;
+    }
+    // play a bar on from the seek: same notes & CCs at the same ticks
+    uint32_t from = at[k] * seek_ticks_per_sixteenth;
+    sent.clear();
+    tick_no = from;
+    for (uint32_t w = 0; w < seek_window; ++w) play_tick();
+    size_t r = 0;
+    while (r < played.size() && played[r].tick <= from) r++;
+    bool same = true;
+    for (size_t q = 0; q < sent.size() && same; ++q, ++r) {
+      same = r < played.size() && played[r].tick == sent[q].tick && played[r].status == sent[q].status && played[r].d1 == sent[q].d1 && played[r].d2 == sent[q].d2;
+    }
+    if (same) same = r == played.size() || played[r].tick > from + seek_window;
+    if (!same && fails++ < 3) {
+      printf("  step size %d, div %d, mul %d, seek to %u: plays on differently\n", step_size, div, mul, at[k]);
+      for (size_t q = 0; q < sent.size() && q < 6; ++q) printf("    %u %02x %d %d\n", sent[q].tick, sent[q].status, sent[q].d1, sent[q].d2);
+      r = 0;
+      while (r < played.size() && played[r].tick <= from) r++;
+      for (size_t q = r; q < played.size() && q < r + 6; ++q) printf("   ref %u %02x %d %d\n", played[q].tick, played[q].status, played[q].d1, played[q].d2);
+    }
+  }
+  return fails;
+}
+
+int main() {
+  seqr.on_func = on_note;
+  seqr.off_func = off_note;
+  seqr.cc_func = on_cc;
+  seqr.set_tempo(120);
+  randomSeed(3);
+  uint8_t held[] = { 48, 55, 60, 63 };
+  for (uint8_t n = 0; n < 4; ++n) {
+    arps[5].NoteOn(held[n]);
+    if (n < 3) arps[6].NoteOn(held[n]);
+  }
+  arp_patterns[5] = 3;
+  arp_octaves[5] = 2;
+  arp_patterns[6] = 7;
+  arp_octaves[6] = 1;
+
+  const uint8_t step_sizes[] = { SIXTEENTH_NOTE, EIGHTH_NOTE, QUARTER_NOTE };
+  const uint8_t divs[] = { 0, 1, 2, 3, 4, 5, 6, 7, 15, 31 };
+  uint32_t fails = 0, runs = 0;
+  for (uint8_t step_size : step_sizes) {
+    uint32_t before = fails;
+    for (uint8_t div : divs) {
+      for (uint8_t mul = 0; mul < 8; ++mul) {
+        fails += run(step_size, div, mul);
+        runs++;
+      }
+    }
+    printf("step size %2d ticks/clock: %3d divs x muls, %4d seeks, %s\n", step_size, (int)sizeof(divs) * 8,
+           (int)sizeof(divs) * 8 * seek_positions, fails == before ? "ok" : "FAIL");
+  }
+  if (fails) printf("%u of %u seeks FAILED\n", fails, runs * seek_positions);
+  else printf("all %u seeks ok\n", runs * seek_positions);
+  return fails ? 1 : 0;
+}
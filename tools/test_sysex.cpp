@@ -0,0 +1,391 @@
+/**
+ * test_sysex.cpp -- Host test of SysEx bank dump & restore (sysex.h) alongside playback, for Multitrack Sequencer
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * Runs the device's main loop (one MIDI message read, then sysex_update(), every pass) against a
+ * host at the other end of a USB link that moves messages once a 1 ms frame each way, while the
+ * engine plays random patterns on every track, its ticks on time as the clock timer fires them.
+ * The host dumps every bank, then restores all the presets no track is playing (the dump, with
+ * some velocities changed): once with a clean link, then with 5% of chunks arriving corrupted &
+ * 5% of acks going missing, both ways. Checks the dump matches the store, the restore lands, and
+ * the engine sends exactly the notes & CCs, at the same ticks, as it does with no SysEx going on.
+ * Gives chunks, bytes & time on the link, and the host time of a main loop pass's SysEx work (the
+ * board's will be longer, but its ticks come from the timer interrupt, see clock_timer.h, so main
+ * loop time doesn't move them).
+ *
+ * Build & run (from the sketch folder): g++ -std=c++17 -O2 -o test_sysex tools/test_sysex.cpp && ./test_sysex
+ */
+#include "arduino_host.h"
+#include <chrono>
+#include <deque>
+#include <vector>
+
+const bool marci_debug = false;
+
+#define Y_DIM 8
+#define X_DIM 8
+#define t_size Y_DIM * X_DIM
+
+const uint8_t numtracks = X_DIM;
+const uint8_t num_steps = t_size / 2;
+const uint8_t numpresets = X_DIM * 2;
+const uint16_t dacrange = 4095;
+const byte numdacs = 2;
+const byte cvpins[2] = { 14, 15 };
+const byte gatepins[numtracks] = { 4, 5, 6, 9, 10, 11, 12, 13 };
+uint8_t sel_track = 1;
+bool hzv[2] = { 0, 0 };
+
+#include "../multisequencer.h"
+#include "../save_locations.h"
+
+MultiStepSequencer<numtracks, numpresets, num_steps, numdacs, numarps> seqr;
+
+#include "../json_stream.h"
+
+void undo_record(uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t) {}
+void undo_close() {}
+
+#include "../journal.h"
+
+typedef std::vector<uint8_t> Message;
+std::deque<Message> to_host, to_device;  // waiting for the next USB frame
+std::deque<Message> host_in, device_in;  // arrived
+
+struct {
+  void sendSysEx(unsigned n, const byte* a) {
+    Message m(a, a + n);
+    m.insert(m.begin(), 0xF0);
+    m.push_back(0xF7);
+    to_host.push_back(m);
+  }
+} MIDIusb;
+
+#include "../sysex.h"
+
+const uint32_t test_pass_micros = 250;   // main loop pass
+const uint32_t test_frame_micros = 1000;  // USB frame
+const uint8_t test_loss_pc = 5;  // second session; the first loses nothing
+const uint32_t test_host_wait_millis = 20;  // host resends a restore chunk not acked by then
+const uint32_t test_max_micros = 60000000;
+
+// the link's own dice, so the engine's random() runs the same with or without SysEx
+uint32_t loss_state = 99;
+uint8_t loss_pc;
+
+bool lose() {
+  loss_state ^= loss_state << 13;
+  loss_state ^= loss_state >> 17;
+  loss_state ^= loss_state << 5;
+  return loss_state % 100 < loss_pc;
+}
+
+struct Sent {
+  uint32_t tick;
+  uint8_t status;
+  uint8_t d1;
+  uint8_t d2;
+};
+
+std::vector<Sent> sent;
+uint32_t tick_no;
+
+void on_note(uint8_t note, uint8_t vel, uint8_t, bool on, uint8_t chan) {
+  if (on) sent.push_back({ tick_no, (uint8_t)(0x90 | chan), note, vel });
+}
+
+void off_note(uint8_t note, uint8_t, uint8_t, bool on, uint8_t chan) {
+  if (on) sent.push_back({ tick_no, (uint8_t)(0x80 | chan), note, 0 });
+}
+
+void on_cc(uint8_t cc, uint8_t val, bool on, uint8_t chan) {
+  if (on) sent.push_back({ tick_no, (uint8_t)(0xB0 | chan), cc, val });
+}
+
+uint8_t want[numpresets][preset_layers][numtracks][num_steps];  // restored
+uint8_t got[numpresets][preset_layers][numtracks][num_steps];   // dumped
+
+Message host_msg(uint8_t cmd, const uint8_t* d, uint8_t n) {
+  Message m = { 0xF0, sysex_id[0], sysex_id[1], sysex_id[2], cmd };
+  for (uint8_t i = 0; i < n; ++i) m.push_back(d[i]);
+  m.push_back(0xF7);
+  return m;
+}
+
+// the host end: dump everything, then restore every preset but 0 (which every track plays)
+struct Host {
+  enum { DUMPING, BEGIN, RESTORING, DONE } state = DUMPING;
+  uint32_t dumped = 0;       // chunks in, each once
+  bool seen[sysex_chunks * numpresets] = {};
+  uint16_t chunk = 0;       // restore: next to send
+  uint8_t seq = 0;
+  bool waiting = false;
+  uint32_t sent_at = 0;
+  uint32_t resent = 0;
+  uint32_t dump_millis = 0, restore_millis = 0;
+  uint32_t dump_bytes = 0, restore_bytes = 0;
+
+  void send(Message m) {
+    if (state == RESTORING) restore_bytes += m.size();
+    else dump_bytes += m.size();
+    to_device.push_back(m);
+  }
+
+  void send_chunk() {
+    uint16_t c = chunk + sysex_chunks;  // from preset 1
+    uint8_t d[4 + sysex_packed + 1];
+    d[0] = seq;
+    d[1] = c / sysex_chunks;
+    d[2] = c / numtracks % preset_layers;
+    d[3] = c % numtracks;
+    sysex_pack(want[d[1]][d[2]][d[3]], num_steps, d + 4);
+    d[sizeof(d) - 1] = sysex_sum(d, sizeof(d) - 1);
+    if (lose()) d[5] ^= 0x01;  // corrupted on the way
+    send(host_msg(sysex_data, d, sizeof(d)));
+    waiting = true;
+    sent_at = millis();
+  }
+
+  void receive(const Message& m) {
+    uint8_t cmd = m[4];
+    const uint8_t* d = m.data() + 5;
+    uint8_t n = m.size() - 6;
+    if (state == DUMPING) {
+      dump_bytes += m.size();
+      if (cmd == sysex_end) {
+        dump_millis = millis();
+        state = BEGIN;
+        send(host_msg(sysex_begin, nullptr, 0));
+        return;
+      }
+      if (cmd != sysex_data) return;
+      Message c = m;
+      if (lose()) c[5 + 6] ^= 0x01;  // corrupted on the way
+      d = c.data() + 5;
+      if (sysex_sum(d, n - 1) != d[n - 1]) {
+        uint8_t r[2] = { d[0], sysex_bad_sum };
+        send(host_msg(sysex_nak, r, 2));
+        return;
+      }
+      sysex_unpack(d + 4, num_steps, got[d[1]][d[2]][d[3]]);
+      uint16_t k = (d[1] * preset_layers + d[2]) * numtracks + d[3];
+      if (!seen[k]) dumped++;
+      seen[k] = true;
+      if (!lose()) send(host_msg(sysex_ack, d, 1));  // else the ack goes missing
+      return;
+    }
+    if (state == BEGIN && cmd == sysex_ack && d[0] == 0x7F) {
+      state = RESTORING;
+      restore_millis = millis();
+      send_chunk();
+      return;
+    }
+    if (state != RESTORING || !waiting) return;
+    restore_bytes += m.size();
+    if (lose()) return;  // the reply goes missing, the chunk's sent again when the host gives up on it
+    if (cmd == sysex_ack && d[0] == seq) {
+      waiting = false;
+      seq = (seq + 1) & 0x7F;
+      if (++chunk == sysex_chunks * (numpresets - 1)) {
+        state = DONE;
+        restore_millis = millis() - restore_millis;
+      } else {
+        send_chunk();
+      }
+    } else if (cmd == sysex_nak && d[0] == seq) {
+      resent++;
+      send_chunk();
+    }
+  }
+
+  void update() {
+    if (state == RESTORING && waiting && millis() - sent_at >= test_host_wait_millis) {
+      resent++;
+      send_chunk();
+    }
+  }
+};
+
+// random patterns on preset 0, the one every track plays (its working slots, so the store isn't
+// filled with noise), the factory banks on the rest
+void load_patterns() {
+  randomSeed(5);
+  const track_mode modes[numtracks] = { TRIGATE, TRIGATE, CC, NOTE, NOTE, CHORD, NOTE, TRIGATE };
+  for (uint8_t i = 0; i < numtracks; ++i) {
+    seqr.modes[i] = modes[i];
+    seqr.track_notes[i] = 36 + i;
+    seqr.track_chan[i] = i + 1;
+    seqr.lengths[i] = 8 + random(num_steps - 7);
+  }
+  for (uint8_t p = 1; p < numpresets; ++p) {
+    for (uint8_t t = 0; t < numtracks; ++t) {
+      seqr.set_layer(p, t, SEQ_LAYER, (const uint8_t*)(*patterns[p])[t]);
+      seqr.set_layer(p, t, VEL_LAYER, (*velocities[p])[t]);
+      seqr.set_layer(p, t, NOTE_LAYER, (*notebanks[p])[t]);
+      seqr.set_layer(p, t, PROB_LAYER, (*probabilities[p])[t]);
+      seqr.set_layer(p, t, GATE_LAYER, (*gatebanks[p])[t]);
+      seqr.set_layer(p, t, NUDGE_LAYER, (const uint8_t*)(*nudgebanks[p])[t]);
+      seqr.set_layer(p, t, CHORD_LAYER, (*chordbanks[p])[t]);
+    }
+  }
+  for (uint8_t t = 0; t < numtracks; ++t) {
+    TrackPreset<num_steps> tp;
+    for (uint8_t s = 0; s < num_steps; ++s) {
+      tp.layer[SEQ_LAYER][s] = random(3) != 0;
+      tp.layer[NOTE_LAYER][s] = 36 + random(36);
+      tp.layer[VEL_LAYER][s] = 1 + random(127);
+      tp.layer[PROB_LAYER][s] = random(4) ? 10 : random(10);
+      tp.layer[GATE_LAYER][s] = 1 + random(15);
+      tp.layer[NUDGE_LAYER][s] = (uint8_t)(int8_t)(random(12) - 6);
+      tp.layer[CHORD_LAYER][s] = random(4);
+    }
+    seqr.put_preset(0, t, tp);
+  }
+  seqr.touch_all();
+}
+
+double now_us() {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Run {
+  uint32_t passes;
+  uint32_t busy;         // passes that took in or sent SysEx
+  double busy_us_total;  // ...their SysEx time
+};
+
+// the main loop, the engine's ticks & the USB link on one virtual clock, till the host's done
+// (or for the same time again, without SysEx)
+Run run(Host* host, uint32_t until_micros) {
+  Run r = {};
+  sent.clear();
+  tick_no = 0;
+  host_micros = 0;
+  seqr.play();
+  seqr.reset();
+  seqr.prob_seed = 1;
+  uint32_t next_tick = 0, next_pass = 0, next_frame = test_frame_micros;
+  while (host ? host->state != Host::DONE : host_micros < until_micros) {
+    uint32_t now = next_tick;
+    if ((int32_t)(next_pass - now) < 0) now = next_pass;
+    if ((int32_t)(next_frame - now) < 0) now = next_frame;
+    host_micros = now;
+    if (now == next_tick) {
+      tick_no++;
+      seqr.tick(now);
+      next_tick += seqr.tick_micros;
+    } else if (now == next_pass) {
+      r.passes++;
+      if (host) {
+        Message m;
+        if (!device_in.empty()) {
+          m = device_in.front();
+          device_in.pop_front();
+        }
+        uint32_t out = sysex_bytes;
+        double t0 = now_us();
+        if (!m.empty()) handle_sysex(m.data(), m.size());
+        sysex_update();
+        double took = now_us() - t0;
+        if (!m.empty() || sysex_bytes != out) {
+          r.busy++;
+          r.busy_us_total += took;
+        }
+        host->update();
+      }
+      seqr.refresh();
+      next_pass += test_pass_micros;
+    } else {
+      // a USB frame: what each side sent since the last one arrives
+      while (!to_device.empty()) {
+        device_in.push_back(to_device.front());
+        to_device.pop_front();
+      }
+      std::deque<Message> in;
+      in.swap(to_host);
+      for (const Message& m : in) host->receive(m);
+      next_frame += test_frame_micros;
+    }
+    if (host_micros > test_max_micros) break;
+  }
+  return r;
+}
+
+uint8_t before[numpresets][preset_layers][numtracks][num_steps];
+uint8_t fresh[sizeof(seqr)];  // the engine before a session, to play the same again without SysEx
+uint32_t fresh_random;
+
+// the host dumps everything then restores, while the engine plays; then the engine plays the
+// same time again from the same start without SysEx. false = something didn't add up
+bool session(uint8_t loss) {
+  memcpy((void*)&seqr, fresh, sizeof(seqr));
+  host_random_state = fresh_random;
+  loss_pc = loss;
+  sysex_resends = 0;
+  sysex_rejects = 0;
+  memset(got, 0, sizeof(got));
+  Host host;
+  const uint8_t all = 0x7F;
+  to_device.push_back(host_msg(sysex_dump, &all, 1));
+  Run with = run(&host, 0);
+  std::vector<Sent> played = sent;
+  uint32_t took = host_micros;
+  bool done = host.state == Host::DONE;
+
+  bool dump_ok = !memcmp(got, before, sizeof(got));
+  uint32_t rows_wrong = 0;
+  for (uint8_t p = 0; p < numpresets; ++p) {
+    for (uint8_t l = 0; l < preset_layers; ++l) {
+      for (uint8_t t = 0; t < numtracks; ++t) {
+        uint8_t row[num_steps];
+        seqr.get_layer(p, t, l, row);
+        rows_wrong += memcmp(row, p ? want[p][l][t] : before[p][l][t], num_steps) != 0;
+      }
+    }
+  }
+
+  // preset 0 is the same, so should the notes be
+  memcpy((void*)&seqr, fresh, sizeof(seqr));
+  host_random_state = fresh_random;
+  run(nullptr, took);
+  bool same = sent.size() == played.size();
+  for (size_t k = 0; k < sent.size() && same; ++k) {
+    same = sent[k].tick == played[k].tick && sent[k].status == played[k].status && sent[k].d1 == played[k].d1 && sent[k].d2 == played[k].d2;
+  }
+
+  printf("%u%% of chunks corrupted & %u%% of acks lost, each way:\n", loss, loss);
+  printf("  dump:      %u of %u chunks, %u bytes over the link (both ways), %u ms, %u resent, %s\n", host.dumped, sysex_chunks * numpresets,
+         host.dump_bytes, host.dump_millis, sysex_resends, dump_ok ? "matches the store" : "DIFFERS");
+  printf("  restore:   %u chunks, %u bytes over the link (both ways), %u ms, %u nakked, %u resent, %u rows wrong\n", sysex_chunks * (numpresets - 1),
+         host.restore_bytes, host.restore_millis, sysex_rejects, host.resent, rows_wrong);
+  printf("  main loop: %u passes, %u with SysEx work, %.2f us each (host)\n", with.passes, with.busy, with.busy_us_total / with.busy);
+  printf("  playback:  %zu notes & CCs, %s\n", played.size(), same ? "same ticks as without SysEx" : "DIFFERS from without SysEx");
+  return done && dump_ok && rows_wrong == 0 && same;
+}
+
+int main() {
+  seqr.on_func = on_note;
+  seqr.off_func = off_note;
+  seqr.cc_func = on_cc;
+  seqr.set_tempo(120);
+  load_patterns();
+  for (uint8_t p = 0; p < numpresets; ++p) {
+    for (uint8_t l = 0; l < preset_layers; ++l) {
+      for (uint8_t t = 0; t < numtracks; ++t) {
+        seqr.get_layer(p, t, l, before[p][l][t]);
+        memcpy(want[p][l][t], before[p][l][t], num_steps);
+        for (uint8_t s = 0; s < num_steps; s += 5) {
+          if (l == VEL_LAYER) want[p][l][t][s] = want[p][l][t][s] % 127 + 1;
+        }
+      }
+    }
+  }
+  memcpy(fresh, (void*)&seqr, sizeof(seqr));
+  fresh_random = host_random_state;
+  printf("USB frame every %u us, main loop pass every %u us, 120 BPM\n", test_frame_micros, test_pass_micros);
+  bool ok = session(0);
+  ok = session(test_loss_pc) && ok;
+  printf(ok ? "ok\n" : "FAIL\n");
+  return ok ? 0 : 1;
+}
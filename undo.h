@@ -0,0 +1,192 @@
+/**
+ * undo.h -- Undo / redo history for Multitrack Sequencer (for Feather M4 Express)
+ * Part of https://github.com/PatchworkBoy/Neotrellis-Gate-Sequencer
+ * 04 Nov 2023 - @apatchworkboy / Marci
+ *
+ * The journal's scan already finds every pattern edit as (layer, preset, track, step, old, new),
+ * so the history is fed from there into a fixed ring of 5 byte deltas. Neighbouring steps that
+ * went from the same old value to the same new one (clearing a track, nudging all velocities) are
+ * one delta with a length. What one scan finds is one group, behind a mark, and undo / redo walk
+ * just that group's deltas, writing them back through the journal like any other edit. When the
+ * ring is full the oldest group goes.
+ * A factory reset is far too big for the ring: it leaves a mark, and holds a snapshot of the
+ * preset store (see PresetStore::snapshot()) plus the settings & song it replaced, till it's
+ * undone or editing carries on.
+ */
+#ifndef MULTI_SEQUENCER_UNDO
+#define MULTI_SEQUENCER_UNDO
+
+const uint16_t undo_size = 512;  // deltas (2.5KB)
+const uint8_t undo_reset = 0xFF;   // a mark's ts: the group is a factory reset
+
+typedef struct {
+  uint8_t lp;   // layer << 4 | preset, MARK_LAYER = group start
+  uint8_t ts;   // track << 5 | first step
+  uint8_t len;  // steps after the first
+  uint8_t old;
+  uint8_t now;
+} UndoDelta;
+
+UndoDelta undo_ring[undo_size];
+uint16_t undo_head;   // next free
+uint16_t undo_count;  // behind undo_head, can be undone (oldest is always a mark)
+uint16_t redo_count;  // from undo_head on, can be redone
+bool undo_open;       // this scan's group has its mark
+int16_t reset_settings[settings_fields];  // what the held factory reset replaced
+SongEntry reset_song[song_max];
+uint8_t reset_song_len;
+// stats
+uint32_t undo_deltas;   // recorded
+uint32_t undo_dropped;  // groups lost off the end of the ring
+uint32_t undos;
+uint32_t redos;
+
+void undo_push(const UndoDelta& d) {
+  if (undo_count == undo_size) undo_dropped++;
+  undo_ring[undo_head] = d;
+  undo_head = (undo_head + 1) % undo_size;
+  redo_count = 0;  // a new edit: what was undone stays undone
+  if (undo_count < undo_size) undo_count++;
+  // the oldest group lost its mark: the rest of it goes too
+  while (undo_count && undo_ring[(undo_head + undo_size - undo_count) % undo_size].lp >> 4 != MARK_LAYER) undo_count--;
+}
+
+void undo_mark(uint8_t kind) {
+  UndoDelta m = { MARK_LAYER << 4, kind, 0, 0, 0 };
+  undo_push(m);
+}
+
+// carrying on after a factory reset: let its snapshot go, and the history from before it
+void undo_drop_reset() {
+  if (!seqr.store.held) return;
+  seqr.store.drop_snapshot();
+  undo_count = 0;
+  redo_count = 0;
+}
+
+// from journal_diff(): step s of layer l went from old to v
+void undo_record(uint8_t layer, uint8_t p, uint8_t t, uint8_t s, uint8_t old, uint8_t v) {
+  if (!undo_open) {
+    undo_drop_reset();
+    undo_mark(0);
+    undo_open = true;
+  }
+  undo_deltas++;
+  if (undo_count) {
+    UndoDelta& d = undo_ring[(undo_head + undo_size - 1) % undo_size];
+    if (d.lp == (layer << 4 | p) && d.ts >> 5 == t && (d.ts & 0x1F) + d.len + 1 == s && d.old == old && d.now == v) {
+      d.len++;  // carries on its run
+      return;
+    }
+  }
+  UndoDelta d = { (uint8_t)(layer << 4 | p), (uint8_t)(t << 5 | s), 0, old, v };
+  undo_push(d);
+}
+
+// end of a journal scan
+void undo_close() {
+  undo_open = false;
+}
+
+// set the delta's steps to v and journal them (not recorded again)
+void undo_apply(const UndoDelta& d, uint8_t v) {
+  uint8_t l = d.lp >> 4;
+  uint8_t p = d.lp & 0x0F;
+  uint8_t t = d.ts >> 5;
+  uint8_t first = d.ts & 0x1F;
+  TrackPreset<num_steps> tp;
+  seqr.get_preset(p, t, tp);
+  memset(tp.layer[l] + first, v, d.len + 1);
+  if (!seqr.put_preset(p, t, tp)) {
+    if (marci_debug) Serial.println(F("undo: preset store full"));
+    return;
+  }
+  for (uint8_t s = first; s <= first + d.len; ++s) journal_edit(l, p, t, s, v);
+}
+
+// factory reset: hold what it's about to replace
+void undo_hold_reset() {
+  journal_scan();  // edits just before it are a group of their own
+  undo_drop_reset();
+  if (!seqr.snapshot()) {
+    if (marci_debug) Serial.println(F("undo: preset store full, factory reset can't be undone"));
+    undo_count = 0;
+    redo_count = 0;
+    return;
+  }
+  settings_pack(reset_settings);
+  memcpy(reset_song, song, sizeof(song));
+  reset_song_len = song_len;
+  undo_mark(undo_reset);
+}
+
+// presets, settings & song back as they were before the factory reset, and saved
+void undo_restore_reset() {
+  if (!seqr.store.held) return;
+  seqr.restore();
+  settings_reset(reset_settings);
+  memcpy(song, reset_song, sizeof(song));
+  song_len = reset_song_len;
+  song_on = false;
+  configure_sequencer();
+  last_sequence_write_millis = 0;
+  sequences_write();
+}
+
+// step back one group, false = nothing to undo
+bool undo() {
+  journal_scan();
+  if (undo_count == 0) return false;
+  while (undo_count) {
+    undo_head = (undo_head + undo_size - 1) % undo_size;
+    undo_count--;
+    redo_count++;
+    const UndoDelta& d = undo_ring[undo_head];
+    if (d.lp >> 4 == MARK_LAYER) {
+      if (d.ts == undo_reset) undo_restore_reset();
+      break;
+    }
+    undo_apply(d, d.old);
+  }
+  undos++;
+  return true;
+}
+
+// step forward one group, false = nothing to redo
+bool redo() {
+  journal_scan();
+  if (redo_count == 0) return false;
+  redos++;
+  if (undo_ring[undo_head].ts == undo_reset) {
+    pattern_reset();  // holds & marks itself again
+    return true;
+  }
+  do {
+    const UndoDelta& d = undo_ring[undo_head];
+    if (d.lp >> 4 != MARK_LAYER) undo_apply(d, d.now);
+    undo_head = (undo_head + 1) % undo_size;
+    undo_count++;
+    redo_count--;
+  } while (redo_count && undo_ring[undo_head].lp >> 4 != MARK_LAYER);
+  return true;
+}
+
+void undo_report() {
+  Serial.print(F("Undo deltas: "));
+  Serial.print(undo_count);
+  Serial.print(F("/"));
+  Serial.print(undo_size);
+  Serial.print(F(", redo: "));
+  Serial.print(redo_count);
+  Serial.print(F(", recorded: "));
+  Serial.print(undo_deltas);
+  Serial.print(F(", groups dropped: "));
+  Serial.print(undo_dropped);
+  Serial.print(F(", undos: "));
+  Serial.print(undos);
+  Serial.print(F(", redos: "));
+  Serial.print(redos);
+  Serial.print(F(", reset held: "));
+  Serial.println(seqr.store.held);
+}
+#endif